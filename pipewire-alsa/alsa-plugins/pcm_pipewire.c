@@ -62,9 +62,11 @@ typedef struct {
 	int fd;
 	bool activated;		/* PipeWire is activated? */
 	bool error;
+	bool direct;		/* ALSA ring has the same interleaved layout */
+	bool wakeup;		/* eventfd is signaled and not yet consumed */
 
 	unsigned int num_ports;
-	unsigned int hw_ptr;
+	unsigned int hw_ptr;	/* written by the RT thread, read with acquire */
 	unsigned int sample_bits;
 	snd_pcm_uframes_t min_avail;
 
@@ -85,6 +87,16 @@ typedef struct {
 
 static int snd_pcm_pipewire_stop(snd_pcm_ioplug_t *io);
 
+static inline int pcm_poll_unblock_check(snd_pcm_ioplug_t *io)
+{
+	snd_pcm_pipewire_t *pw = io->private_data;
+	/* only do the syscall when the application has consumed the
+	 * previous wakeup */
+	if (!__atomic_exchange_n(&pw->wakeup, true, __ATOMIC_ACQ_REL))
+		spa_system_eventfd_write(pw->system, pw->fd, 1);
+	return 1;
+}
+
 static int pcm_poll_block_check(snd_pcm_ioplug_t *io)
 {
 	uint64_t val;
@@ -95,7 +107,18 @@ static int pcm_poll_block_check(snd_pcm_ioplug_t *io)
 	    (io->state == SND_PCM_STATE_PREPARED && io->stream == SND_PCM_STREAM_CAPTURE)) {
 		avail = snd_pcm_avail_update(io->pcm);
 		if (avail >= 0 && avail < (snd_pcm_sframes_t)pw->min_avail) {
+			/* clear the flag before consuming the eventfd, a wakeup
+			 * after this point writes the eventfd again */
+			__atomic_store_n(&pw->wakeup, false, __ATOMIC_RELEASE);
 			spa_system_eventfd_read(pw->system, io->poll_fd, &val);
+
+			/* a wakeup between the check and the clear was consumed
+			 * above, signal it again if there is space now */
+			avail = snd_pcm_avail_update(io->pcm);
+			if (avail < 0 || avail >= (snd_pcm_sframes_t)pw->min_avail) {
+				pcm_poll_unblock_check(io);
+				return 0;
+			}
 			return 1;
 		}
 	}
@@ -103,13 +126,6 @@ static int pcm_poll_block_check(snd_pcm_ioplug_t *io)
 	return 0;
 }
 
-static inline int pcm_poll_unblock_check(snd_pcm_ioplug_t *io)
-{
-	snd_pcm_pipewire_t *pw = io->private_data;
-	spa_system_eventfd_write(pw->system, pw->fd, 1);
-	return 1;
-}
-
 static void snd_pcm_pipewire_free(snd_pcm_pipewire_t *pw)
 {
 	if (pw) {
@@ -157,7 +173,27 @@ static snd_pcm_sframes_t snd_pcm_pipewire_pointer(snd_pcm_ioplug_t *io)
 	if (pw->error)
 		return -EBADFD;
 
-	return pw->hw_ptr;
+	return __atomic_load_n(&pw->hw_ptr, __ATOMIC_ACQUIRE);
+}
+
+static bool check_direct(snd_pcm_pipewire_t *pw)
+{
+	snd_pcm_ioplug_t *io = &pw->io;
+	const snd_pcm_channel_area_t *areas;
+	unsigned int channel, bps;
+
+	areas = snd_pcm_ioplug_mmap_areas(io);
+	if (areas == NULL || areas[0].addr == NULL)
+		return false;
+
+	bps = io->channels * pw->sample_bits;
+	for (channel = 0; channel < io->channels; channel++) {
+		if (areas[channel].addr != areas[0].addr ||
+		    areas[channel].first != channel * pw->sample_bits ||
+		    areas[channel].step != bps)
+			return false;
+	}
+	return true;
 }
 
 static int
@@ -173,6 +209,8 @@ snd_pcm_pipewire_process_playback(snd_pcm_pipewire_t *pw, struct pw_buffer *b)
 	int32_t filled;
 	void *ptr;
 	struct spa_data *d;
+	unsigned int hw_ptr;
+	bool wake = false;
 
 	bps = io->channels * pw->sample_bits;
 	bpf = bps / 8;
@@ -180,6 +218,7 @@ snd_pcm_pipewire_process_playback(snd_pcm_pipewire_t *pw, struct pw_buffer *b)
 	pwareas = alloca(io->channels * sizeof(snd_pcm_channel_area_t));
 
 	d = b->buffer->datas;
+	hw_ptr = __atomic_load_n(&pw->hw_ptr, __ATOMIC_RELAXED);
 
 	maxsize = d[0].maxsize;
 
@@ -215,28 +254,37 @@ snd_pcm_pipewire_process_playback(snd_pcm_pipewire_t *pw, struct pw_buffer *b)
 	xfer = 0;
 	while (xfer < nframes) {
 		snd_pcm_uframes_t frames = nframes - xfer;
-		snd_pcm_uframes_t offset = pw->hw_ptr;
+		snd_pcm_uframes_t offset = hw_ptr;
 		snd_pcm_uframes_t cont = io->buffer_size - offset;
 
 		if (cont < frames)
 			frames = cont;
 
-		snd_pcm_areas_copy(pwareas, xfer,
-				   areas, offset,
-				   io->channels, frames, io->format);
+		if (pw->direct)
+			memcpy(SPA_MEMBER(ptr, xfer * bpf, void),
+			       SPA_MEMBER(areas[0].addr, offset * bpf, void),
+			       frames * bpf);
+		else
+			snd_pcm_areas_copy(pwareas, xfer,
+					   areas, offset,
+					   io->channels, frames, io->format);
 
-		pw->hw_ptr += frames;
-		pw->hw_ptr %= io->buffer_size;
+		hw_ptr += frames;
+		hw_ptr %= io->buffer_size;
 		xfer += frames;
 	}
-
-	pcm_poll_unblock_check(io); /* unblock socket for polling if needed */
+	wake = true;
 
       done:
 	index += nbytes;
 	avail -= nbytes;
 	} while (avail > 0);
 
+	if (wake) {
+		__atomic_store_n(&pw->hw_ptr, hw_ptr, __ATOMIC_RELEASE);
+		pcm_poll_unblock_check(io); /* unblock socket for polling if needed */
+	}
+
 	d[0].chunk->offset = 0;
 	d[0].chunk->size = index;
 	d[0].chunk->stride = 0;
@@ -256,6 +304,7 @@ snd_pcm_pipewire_process_record(snd_pcm_pipewire_t *pw, struct pw_buffer *b)
 	uint32_t offset, index = 0, nbytes, avail, maxsize;
 	struct spa_data *d;
 	void *ptr;
+	unsigned int hw_ptr;
 
 	bps = io->channels * pw->sample_bits;
 	bpf = bps / 8;
@@ -263,6 +312,7 @@ snd_pcm_pipewire_process_record(snd_pcm_pipewire_t *pw, struct pw_buffer *b)
 	pwareas = alloca(io->channels * sizeof(snd_pcm_channel_area_t));
 
 	d = b->buffer->datas;
+	hw_ptr = __atomic_load_n(&pw->hw_ptr, __ATOMIC_RELAXED);
 
 	maxsize = d[0].chunk->size;
 	avail = maxsize;
@@ -288,27 +338,33 @@ snd_pcm_pipewire_process_record(snd_pcm_pipewire_t *pw, struct pw_buffer *b)
 	xfer = 0;
 	while (xfer < nframes) {
 		snd_pcm_uframes_t frames = nframes - xfer;
-		snd_pcm_uframes_t offset = pw->hw_ptr;
+		snd_pcm_uframes_t offset = hw_ptr;
 		snd_pcm_uframes_t cont = io->buffer_size - offset;
 
 		if (cont < frames)
 			frames = cont;
 
-		snd_pcm_areas_copy(areas, offset,
-				   pwareas, xfer,
-				   io->channels, frames, io->format);
+		if (pw->direct)
+			memcpy(SPA_MEMBER(areas[0].addr, offset * bpf, void),
+			       SPA_MEMBER(ptr, xfer * bpf, void),
+			       frames * bpf);
+		else
+			snd_pcm_areas_copy(areas, offset,
+					   pwareas, xfer,
+					   io->channels, frames, io->format);
 
-		pw->hw_ptr += frames;
-		pw->hw_ptr %= io->buffer_size;
+		hw_ptr += frames;
+		hw_ptr %= io->buffer_size;
 		xfer += frames;
 	}
 
-	pcm_poll_unblock_check(io); /* unblock socket for polling if needed */
-
 	avail -= nbytes;
 	index += nbytes;
 	} while (avail > 0);
 
+	__atomic_store_n(&pw->hw_ptr, hw_ptr, __ATOMIC_RELEASE);
+	pcm_poll_unblock_check(io); /* unblock socket for polling if needed */
+
 	return 0;
 }
 
@@ -432,6 +488,7 @@ static int snd_pcm_pipewire_prepare(snd_pcm_ioplug_t *io)
 
 done:
 	pw->hw_ptr = 0;
+	pw->direct = check_direct(pw);
 
 	pw_thread_loop_unlock(pw->main_loop);
 
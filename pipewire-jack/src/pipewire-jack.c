@@ -52,6 +52,7 @@
 #include "extensions/client-node.h"
 #include "extensions/metadata.h"
 #include "pipewire-jack-extensions.h"
+#include "../../spa/plugins/audiomixer/mix-ops.h"
 
 #define JACK_DEFAULT_VIDEO_TYPE	"32 bit float RGBA video"
 
@@ -70,7 +71,9 @@
 #define MAX_BUFFER_DATAS		1u
 #define MAX_BUFFER_MEMS			1
 #define MAX_MIX				4096
+#define MAX_MIX_SRC			64
 #define MAX_IO				32
+#define OBJECT_HASH_SIZE		512
 
 #define REAL_JACK_PORT_NAME_SIZE (JACK_CLIENT_NAME_SIZE + JACK_PORT_NAME_SIZE)
 
@@ -94,12 +97,10 @@ static struct globals globals;
 
 #define OBJECT_CHUNK	8
 
-typedef void (*mix2_func) (float *dst, float *src1, float *src2, int n_samples);
-
-static mix2_func mix2;
-
 struct object {
 	struct spa_list link;
+	struct spa_list hash_link;	/**< node or port name, link ports */
+	struct spa_list alt_link[2];	/**< port aliases, link src and dst */
 
 	struct client *client;
 
@@ -222,6 +223,13 @@ struct context {
 	struct spa_list ports;
 	struct spa_list nodes;
 	struct spa_list links;
+
+	/* indexes for lookups by name and by connected ports */
+	struct spa_list node_names[OBJECT_HASH_SIZE];
+	struct spa_list port_names[OBJECT_HASH_SIZE];
+	struct spa_list port_aliases[2][OBJECT_HASH_SIZE];
+	struct spa_list link_ports[OBJECT_HASH_SIZE];
+	struct spa_list port_links[2][OBJECT_HASH_SIZE];
 };
 
 #define GET_DIRECTION(f)	((f) & JackPortIsInput ? SPA_DIRECTION_INPUT : SPA_DIRECTION_OUTPUT)
@@ -302,6 +310,7 @@ struct client {
 	uint32_t sample_rate;
 	uint32_t buffer_frames;
 
+	struct mix_ops mix_ops;
 	struct mix mix_pool[MAX_MIX];
 	struct spa_list free_mix;
 
@@ -318,6 +327,7 @@ struct client {
 	uint32_t xrun_count;
 
 	struct spa_list target_links;
+	bool rt_ready;
 
 	unsigned int started:1;
 	unsigned int active:1;
@@ -366,13 +376,76 @@ static struct object * alloc_object(struct client *c)
         o = spa_list_first(&c->context.free_objects, struct object, link);
         spa_list_remove(&o->link);
 	o->client = c;
+	spa_list_init(&o->hash_link);
+	spa_list_init(&o->alt_link[0]);
+	spa_list_init(&o->alt_link[1]);
 
 	return o;
 }
 
+static inline uint32_t hash_name(const char *name)
+{
+	uint32_t h = 2166136261u;
+	while (*name)
+		h = (h ^ (uint8_t)*name++) * 16777619u;
+	return h & (OBJECT_HASH_SIZE - 1);
+}
+
+static inline uint32_t hash_id(uint32_t id)
+{
+	return (id * 2654435761u) >> 23 & (OBJECT_HASH_SIZE - 1);
+}
+
+static inline uint32_t hash_link(uint32_t src, uint32_t dst)
+{
+	return hash_id(src ^ (dst * 31));
+}
+
+static void rehash(struct spa_list *link, struct spa_list *bucket)
+{
+	spa_list_remove(link);
+	if (bucket)
+		spa_list_append(bucket, link);
+	else
+		spa_list_init(link);
+}
+
+static void hash_node(struct client *c, struct object *o)
+{
+	rehash(&o->hash_link, &c->context.node_names[hash_name(o->node.name)]);
+}
+
+static void hash_port(struct client *c, struct object *o)
+{
+	struct context *ctx = &c->context;
+
+	rehash(&o->hash_link, &ctx->port_names[hash_name(o->port.name)]);
+	rehash(&o->alt_link[0], o->port.alias1[0] ?
+			&ctx->port_aliases[0][hash_name(o->port.alias1)] : NULL);
+	rehash(&o->alt_link[1], o->port.alias2[0] ?
+			&ctx->port_aliases[1][hash_name(o->port.alias2)] : NULL);
+}
+
+static void hash_link_object(struct client *c, struct object *o)
+{
+	struct context *ctx = &c->context;
+
+	rehash(&o->hash_link, &ctx->link_ports[hash_link(o->port_link.src, o->port_link.dst)]);
+	rehash(&o->alt_link[0], &ctx->port_links[0][hash_id(o->port_link.src)]);
+	rehash(&o->alt_link[1], &ctx->port_links[1][hash_id(o->port_link.dst)]);
+}
+
+/* iterate the links with port id as source (d = 0) or destination (d = 1),
+ * other links that hash to the same bucket need to be skipped */
+#define port_link_for_each(l,c,id,d)	\
+	spa_list_for_each(l, &(c)->context.port_links[d][hash_id(id)], alt_link[d])
+
 static void free_object(struct client *c, struct object *o)
 {
         spa_list_remove(&o->link);
+	rehash(&o->hash_link, NULL);
+	rehash(&o->alt_link[0], NULL);
+	rehash(&o->alt_link[1], NULL);
 	spa_list_append(&c->context.free_objects, &o->link);
 }
 
@@ -432,6 +505,9 @@ static struct port * alloc_port(struct client *c, enum spa_direction direction)
 	o->id = SPA_ID_INVALID;
 	o->port.node_id = c->node_id;
 	o->port.port_id = p->id;
+	/* the object can be recycled, don't hash the aliases of the old port */
+	o->port.alias1[0] = '\0';
+	o->port.alias2[0] = '\0';
 	spa_list_append(&c->context.ports, &o->link);
 
 	p->valid = true;
@@ -465,7 +541,7 @@ static struct object *find_node(struct client *c, const char *name)
 {
 	struct object *o;
 
-	spa_list_for_each(o, &c->context.nodes, link) {
+	spa_list_for_each(o, &c->context.node_names[hash_name(name)], hash_link) {
 		if (!strcmp(o->node.name, name))
 			return o;
 	}
@@ -475,11 +551,20 @@ static struct object *find_node(struct client *c, const char *name)
 static struct object *find_port(struct client *c, const char *name)
 {
 	struct object *o;
+	uint32_t h = hash_name(name);
 
-	spa_list_for_each(o, &c->context.ports, link) {
+	spa_list_for_each(o, &c->context.port_names[h], hash_link) {
 		if (!strcmp(o->port.name, name))
 			return o;
 	}
+	spa_list_for_each(o, &c->context.port_aliases[0][h], alt_link[0]) {
+		if (!strcmp(o->port.alias1, name))
+			return o;
+	}
+	spa_list_for_each(o, &c->context.port_aliases[1][h], alt_link[1]) {
+		if (!strcmp(o->port.alias2, name))
+			return o;
+	}
 	return NULL;
 }
 
@@ -487,7 +572,7 @@ static struct object *find_link(struct client *c, uint32_t src, uint32_t dst)
 {
 	struct object *l;
 
-	spa_list_for_each(l, &c->context.links, link) {
+	spa_list_for_each(l, &c->context.link_ports[hash_link(src, dst)], hash_link) {
 		if (l->port_link.src == src &&
 		    l->port_link.dst == dst) {
 			return l;
@@ -510,42 +595,6 @@ static struct buffer *dequeue_buffer(struct mix *mix)
 	return b;
 }
 
-#if defined (__SSE__)
-#include <xmmintrin.h>
-static void mix2_sse(float *dst, float *src1, float *src2, int n_samples)
-{
-	int n, unrolled;
-	__m128 in[2];
-
-	if (SPA_IS_ALIGNED(src1, 16) &&
-	    SPA_IS_ALIGNED(src2, 16) &&
-	    SPA_IS_ALIGNED(dst, 16))
-		unrolled = n_samples / 4;
-	else
-		unrolled = 0;
-
-	for (n = 0; unrolled--; n += 4) {
-		in[0] = _mm_load_ps(&src1[n]),
-		in[1] = _mm_load_ps(&src2[n]),
-		in[0] = _mm_add_ps(in[0], in[1]);
-		_mm_store_ps(&dst[n], in[0]);
-	}
-	for (; n < n_samples; n++) {
-		in[0] = _mm_load_ss(&src1[n]),
-		in[1] = _mm_load_ss(&src2[n]),
-		in[0] = _mm_add_ss(in[0], in[1]);
-		_mm_store_ss(&dst[n], in[0]);
-	}
-}
-#endif
-
-static void mix2_c(float *dst, float *src1, float *src2, int n_samples)
-{
-	int i;
-	for (i = 0; i < n_samples; i++)
-		dst[i] = src1[i] + src2[i];
-}
-
 SPA_EXPORT
 void jack_get_version(int *major_ptr, int *minor_ptr, int *micro_ptr, int *proto_ptr)
 {
@@ -1011,15 +1060,30 @@ static inline uint32_t cycle_run(struct client *c)
 	return c->buffer_frames;
 }
 
+/* The data loop also wakes up for invokes from the main thread, like link
+ * activation and source removal. Those are handled by the loop, keep
+ * iterating it until the activation eventfd was readable. Returning 0
+ * frames for such a wakeup would make the client call jack_cycle_signal()
+ * and mark us finished and trigger our targets outside of a graph cycle.
+ * This still waits in the poll of the data loop, it is not a cheaper wait
+ * on the eventfd. */
 static inline uint32_t cycle_wait(struct client *c)
 {
 	int res;
 
-	res = pw_data_loop_wait(c->loop, -1);
-	if (SPA_UNLIKELY(res <= 0)) {
-		pw_log_warn(NAME" %p: wait error %m", c);
-		return 0;
+	while (!c->rt_ready) {
+		/* the socket was removed after an error, don't wait for it */
+		if (SPA_UNLIKELY(c->socket_source == NULL))
+			return 0;
+		res = pw_data_loop_wait(c->loop, -1);
+		if (SPA_UNLIKELY(res <= 0)) {
+			pw_log_warn(NAME" %p: wait error %m", c);
+			return 0;
+		}
 	}
+	c->rt_ready = false;
+	if (SPA_UNLIKELY(c->socket_source == NULL))
+		return 0;
 	return cycle_run(c);
 }
 
@@ -1095,9 +1159,13 @@ on_rtsocket_condition(void *data, int fd, uint32_t mask)
 	if (SPA_UNLIKELY(mask & (SPA_IO_ERR | SPA_IO_HUP))) {
 		pw_log_warn(NAME" %p: got error", c);
 		unhandle_socket(c);
+		/* wake up cycle_wait, it returns 0 without a socket */
+		c->rt_ready = true;
 		return;
 	}
 	if (SPA_UNLIKELY(c->thread_callback)) {
+		if (mask & SPA_IO_IN)
+			c->rt_ready = true;
 		if (!c->thread_entered) {
 			c->thread_entered = true;
 			c->thread_callback(c->thread_arg);
@@ -1303,6 +1371,7 @@ static int client_node_command(void *object, const struct spa_command *command)
 			c->started = true;
 			c->first = true;
 			c->thread_entered = false;
+			c->rt_ready = false;
 		}
 		break;
 	default:
@@ -1963,6 +2032,7 @@ static void registry_event_global(void *data, uint32_t id,
 
 		pw_log_debug(NAME" %p: add node %d", c, id);
 		spa_list_append(&c->context.nodes, &o->link);
+		hash_node(c, o);
 	}
 	else if (strcmp(type, PW_TYPE_INTERFACE_Port) == 0) {
 		const struct spa_dict_item *item;
@@ -2041,6 +2111,7 @@ static void registry_event_global(void *data, uint32_t id,
 		o->port.flags = flags;
 		o->port.type_id = type_id;
 		o->port.node_id = node_id;
+		hash_port(c, o);
 
 		if (o->port.flags & JackPortIsOutput) {
 			o->port.capture_latency.min = 1024;
@@ -2065,6 +2136,7 @@ static void registry_event_global(void *data, uint32_t id,
 		if ((str = spa_dict_lookup(props, PW_KEY_LINK_INPUT_PORT)) == NULL)
 			goto exit_free;
 		o->port_link.dst = pw_properties_parse_int(str);
+		hash_link_object(c, o);
 
 		pw_log_debug(NAME" %p: add link %d %d->%d", c, id,
 				o->port_link.src, o->port_link.dst);
@@ -2209,18 +2281,24 @@ jack_client_t * jack_client_open (const char *client_name,
 	spa_list_init(&client->context.nodes);
 	spa_list_init(&client->context.ports);
 	spa_list_init(&client->context.links);
+	for (i = 0; i < OBJECT_HASH_SIZE; i++) {
+		spa_list_init(&client->context.node_names[i]);
+		spa_list_init(&client->context.port_names[i]);
+		spa_list_init(&client->context.port_aliases[0][i]);
+		spa_list_init(&client->context.port_aliases[1][i]);
+		spa_list_init(&client->context.link_ports[i]);
+		spa_list_init(&client->context.port_links[0][i]);
+		spa_list_init(&client->context.port_links[1][i]);
+	}
 
 	support = pw_context_get_support(client->context.context, &n_support);
 
-	mix2 = mix2_c;
 	cpu_iface = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_CPU);
-	if (cpu_iface) {
-#if defined (__SSE__)
-		uint32_t flags = spa_cpu_get_flags(cpu_iface);
-		if (flags & SPA_CPU_FLAG_SSE)
-			mix2 = mix2_sse;
-#endif
-	}
+	client->mix_ops.fmt = SPA_AUDIO_FORMAT_F32;
+	client->mix_ops.n_channels = 1;
+	client->mix_ops.cpu_flags = cpu_iface ? spa_cpu_get_flags(cpu_iface) : 0;
+	if (mix_ops_init(&client->mix_ops) < 0)
+		goto init_failed;
 
 	props = SPA_DICT_INIT(items, 0);
 	items[props.n_items++] = SPA_DICT_ITEM_INIT("loop.cancel", "true");
@@ -2368,6 +2446,8 @@ int jack_client_close (jack_client_t *client)
 	pw_context_destroy(c->context.context);
 	pw_thread_loop_destroy(c->context.loop);
 
+	mix_ops_free(&c->mix_ops);
+
 	pw_log_debug(NAME" %p: free", client);
 	free(c);
 
@@ -2401,13 +2481,11 @@ char *jack_get_uuid_for_client_name (jack_client_t *client,
 	spa_return_val_if_fail(c != NULL, NULL);
 	spa_return_val_if_fail(client_name != NULL, NULL);
 
-	spa_list_for_each(o, &c->context.nodes, link) {
-		if (strcmp(o->node.name, client_name) == 0) {
-			char *uuid = spa_aprintf( "%" PRIu64, (cuuid << 32) | o->id);
-			pw_log_debug(NAME" %p: name %s -> %s",
-					client, client_name, uuid);
-			return uuid;
-		}
+	if ((o = find_node(c, client_name)) != NULL) {
+		char *uuid = spa_aprintf( "%" PRIu64, (cuuid << 32) | o->id);
+		pw_log_debug(NAME" %p: name %s -> %s",
+				client, client_name, uuid);
+		return uuid;
 	}
 	return NULL;
 }
@@ -2979,6 +3057,7 @@ jack_port_t * jack_port_register (jack_client_t *client,
 	o->port.flags = flags;
 	snprintf(o->port.name, sizeof(o->port.name), "%s:%s", c->name, port_name);
 	o->port.type_id = type_id;
+	hash_port(c, o);
 
 	pw_log_debug(NAME" %p: port %p", c, p);
 
@@ -3066,8 +3145,8 @@ static inline void *get_buffer_input_float(struct client *c, struct port *p, jac
 	struct mix *mix;
 	struct buffer *b;
 	struct spa_io_buffers *io;
-	int layer = 0;
-	void *ptr = NULL;
+	const void *src[MAX_MIX_SRC];
+	uint32_t n_src = 0;
 
 	spa_list_for_each(mix, &p->mix, port_link) {
 		pw_log_trace(NAME" %p: port %p mix %d.%d get buffer %d",
@@ -3080,15 +3159,25 @@ static inline void *get_buffer_input_float(struct client *c, struct port *p, jac
 
 		io->status = SPA_STATUS_NEED_DATA;
 		b = &mix->buffers[io->buffer_id];
-		if (layer++ == 0)
-			ptr = b->datas[0].data;
-		else  {
-			mix2(p->emptyptr, ptr, b->datas[0].data, frames);
-			ptr = p->emptyptr;
+
+		if (n_src == MAX_MIX_SRC) {
+			/* mix what we have and continue on top of it */
+			mix_ops_process(&c->mix_ops, p->emptyptr, src, n_src, frames);
 			p->zeroed = false;
+			src[0] = p->emptyptr;
+			n_src = 1;
 		}
+		src[n_src++] = b->datas[0].data;
 	}
-	return ptr;
+	if (n_src == 0)
+		return NULL;
+	/* a single input is used as is, more inputs are summed in one go */
+	if (n_src > 1) {
+		mix_ops_process(&c->mix_ops, p->emptyptr, src, n_src, frames);
+		p->zeroed = false;
+		return p->emptyptr;
+	}
+	return (void*)src[0];
 }
 
 static inline void *get_buffer_input_midi(struct client *c, struct port *p, jack_nframes_t frames)
@@ -3267,9 +3356,12 @@ int jack_port_connected (const jack_port_t *port)
 	c = o->client;
 
 	pw_thread_loop_lock(c->context.loop);
-	spa_list_for_each(l, &c->context.links, link) {
-		if (l->port_link.src == o->id ||
-		    l->port_link.dst == o->id)
+	port_link_for_each(l, c, o->id, 0) {
+		if (l->port_link.src == o->id)
+			res++;
+	}
+	port_link_for_each(l, c, o->id, 1) {
+		if (l->port_link.dst == o->id)
 			res++;
 	}
 	pw_thread_loop_unlock(c->context.loop);
@@ -3341,20 +3433,21 @@ const char ** jack_port_get_all_connections (const jack_client_t *client,
 
 	pw_thread_loop_lock(c->context.loop);
 
-	spa_list_for_each(l, &c->context.links, link) {
-		if (l->port_link.src == o->id)
-			p = pw_map_lookup(&c->context.globals, l->port_link.dst);
-		else if (l->port_link.dst == o->id)
-			p = pw_map_lookup(&c->context.globals, l->port_link.src);
-		else
-			continue;
-
-		if (p == NULL)
+	port_link_for_each(l, c, o->id, 0) {
+		if (count == CONNECTION_NUM_FOR_PORT)
+			break;
+		if (l->port_link.src != o->id ||
+		    (p = pw_map_lookup(&c->context.globals, l->port_link.dst)) == NULL)
 			continue;
-
 		res[count++] = p->port.name;
+	}
+	port_link_for_each(l, c, o->id, 1) {
 		if (count == CONNECTION_NUM_FOR_PORT)
 			break;
+		if (l->port_link.dst != o->id ||
+		    (p = pw_map_lookup(&c->context.globals, l->port_link.src)) == NULL)
+			continue;
+		res[count++] = p->port.name;
 	}
 	pw_thread_loop_unlock(c->context.loop);
 
@@ -3452,6 +3545,8 @@ int jack_port_set_alias (jack_port_t *port, const char *alias)
 	else
 		goto error;
 
+	hash_port(c, o);
+
 	p = GET_PORT(c, GET_DIRECTION(o->port.flags), o->port.port_id);
 
 	port_info = SPA_PORT_INFO_INIT();
@@ -3732,11 +3827,13 @@ int jack_port_disconnect (jack_client_t *client, jack_port_t *port)
 
 	pw_thread_loop_lock(c->context.loop);
 
-	spa_list_for_each(l, &c->context.links, link) {
-		if (l->port_link.src == o->id ||
-		    l->port_link.dst == o->id) {
+	port_link_for_each(l, c, o->id, 0) {
+		if (l->port_link.src == o->id)
+			pw_registry_destroy(c->registry, l->id);
+	}
+	port_link_for_each(l, c, o->id, 1) {
+		if (l->port_link.dst == o->id)
 			pw_registry_destroy(c->registry, l->id);
-		}
 	}
 	res = do_sync(c);
 
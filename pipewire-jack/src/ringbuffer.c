@@ -35,24 +35,86 @@
 
 #include <jack/ringbuffer.h>
 
+
+/* The layout of jack_ringbuffer_t is part of the JACK ABI so the read and
+ * write pointers can't be moved apart. We can at least give the header
+ * and the data their own cache lines so that they don't share them with
+ * unrelated allocations. */
+#define CACHE_LINE	64
+
+/* Each side loads the other side's pointer with acquire and publishes its
+ * own pointer with release, so the data copied before the update is
+ * visible to the other thread when it sees the new pointer. */
+#define LOAD_PTR(p)		__atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define LOAD_OWN_PTR(p)		__atomic_load_n(&(p), __ATOMIC_RELAXED)
+#define STORE_PTR(p,v)		__atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+static inline size_t read_space(const jack_ringbuffer_t *rb, size_t w, size_t r)
+{
+	return (w - r) & rb->size_mask;
+}
+
+static inline size_t write_space(const jack_ringbuffer_t *rb, size_t w, size_t r)
+{
+	return (r - w - 1) & rb->size_mask;
+}
+
+static inline void get_vector(const jack_ringbuffer_t *rb, size_t offset, size_t avail,
+		jack_ringbuffer_data_t *vec)
+{
+	size_t end = offset + avail;
+
+	vec[0].buf = &rb->buf[offset];
+	vec[1].buf = rb->buf;
+	if (end > rb->size) {
+		vec[0].len = rb->size - offset;
+		vec[1].len = end & rb->size_mask;
+	} else {
+		vec[0].len = avail;
+		vec[1].len = 0;
+	}
+}
+
+static inline void read_data(const jack_ringbuffer_t *rb, size_t offset, char *dest, size_t cnt)
+{
+	size_t n1 = SPA_MIN(cnt, rb->size - offset);
+
+	memcpy(dest, &rb->buf[offset], n1);
+	if (SPA_UNLIKELY(n1 < cnt))
+		memcpy(dest + n1, rb->buf, cnt - n1);
+}
+
+static inline void write_data(jack_ringbuffer_t *rb, size_t offset, const char *src, size_t cnt)
+{
+	size_t n1 = SPA_MIN(cnt, rb->size - offset);
+
+	memcpy(&rb->buf[offset], src, n1);
+	if (SPA_UNLIKELY(n1 < cnt))
+		memcpy(rb->buf, src + n1, cnt - n1);
+}
+
 SPA_EXPORT
 jack_ringbuffer_t *jack_ringbuffer_create(size_t sz)
 {
 	size_t power_of_two;
 	jack_ringbuffer_t *rb;
+	void *p;
 
-	rb = calloc(1, sizeof(jack_ringbuffer_t));
-	if (rb == NULL)
+	if (posix_memalign(&p, CACHE_LINE, SPA_ROUND_UP_N(sizeof(jack_ringbuffer_t), CACHE_LINE)) != 0)
 		return NULL;
+	rb = p;
+	memset(rb, 0, sizeof(jack_ringbuffer_t));
 
 	for (power_of_two = 1; 1u << power_of_two < sz; power_of_two++);
 
 	rb->size = 1 << power_of_two;
 	rb->size_mask = rb->size - 1;
-	if ((rb->buf = calloc(1, rb->size)) == NULL) {
+	if (posix_memalign(&p, CACHE_LINE, rb->size) != 0) {
 		free (rb);
 		return NULL;
 	}
+	rb->buf = p;
+	memset(rb->buf, 0, rb->size);
 	rb->mlocked = 0;
 
 	return rb;
@@ -73,127 +135,55 @@ SPA_EXPORT
 void jack_ringbuffer_get_read_vector(const jack_ringbuffer_t *rb,
                                      jack_ringbuffer_data_t *vec)
 {
-	size_t free_cnt;
-	size_t cnt2;
 	size_t w, r;
 
-	w = rb->write_ptr;
-	r = rb->read_ptr;
-
-	if (w > r)
-		free_cnt = w - r;
-	else
-		free_cnt = (w - r + rb->size) & rb->size_mask;
-
-	cnt2 = r + free_cnt;
+	w = LOAD_PTR(rb->write_ptr);
+	r = LOAD_OWN_PTR(rb->read_ptr);
 
-	if (cnt2 > rb->size) {
-		vec[0].buf = &(rb->buf[r]);
-		vec[0].len = rb->size - r;
-		vec[1].buf = rb->buf;
-		vec[1].len = cnt2 & rb->size_mask;
-	} else {
-		vec[0].buf = &(rb->buf[r]);
-		vec[0].len = free_cnt;
-		vec[1].len = 0;
-	}
+	get_vector(rb, r, read_space(rb, w, r), vec);
 }
 
 SPA_EXPORT
 void jack_ringbuffer_get_write_vector(const jack_ringbuffer_t *rb,
                                       jack_ringbuffer_data_t *vec)
 {
-	size_t free_cnt;
-	size_t cnt2;
 	size_t w, r;
 
-	w = rb->write_ptr;
-	r = rb->read_ptr;
-
-	if (w > r)
-		free_cnt = ((r - w + rb->size) & rb->size_mask) - 1;
-	else if (w < r)
-		free_cnt = (r - w) - 1;
-	else
-		free_cnt = rb->size - 1;
+	w = LOAD_OWN_PTR(rb->write_ptr);
+	r = LOAD_PTR(rb->read_ptr);
 
-	cnt2 = w + free_cnt;
-
-	if (cnt2 > rb->size) {
-		vec[0].buf = &(rb->buf[w]);
-		vec[0].len = rb->size - w;
-		vec[1].buf = rb->buf;
-		vec[1].len = cnt2 & rb->size_mask;
-	} else {
-		vec[0].buf = &(rb->buf[w]);
-		vec[0].len = free_cnt;
-		vec[1].len = 0;
-	}
+	get_vector(rb, w, write_space(rb, w, r), vec);
 }
 
 SPA_EXPORT
 size_t jack_ringbuffer_read(jack_ringbuffer_t *rb, char *dest, size_t cnt)
 {
-	size_t free_cnt;
-	size_t cnt2;
-	size_t to_read;
-	size_t n1, n2;
-
-	if ((free_cnt = jack_ringbuffer_read_space (rb)) == 0)
-		return 0;
+	size_t w, r, to_read;
 
-	to_read = cnt > free_cnt ? free_cnt : cnt;
+	w = LOAD_PTR(rb->write_ptr);
+	r = LOAD_OWN_PTR(rb->read_ptr);
 
-	cnt2 = rb->read_ptr + to_read;
+	if ((to_read = SPA_MIN(cnt, read_space(rb, w, r))) == 0)
+		return 0;
 
-	if (cnt2 > rb->size) {
-		n1 = rb->size - rb->read_ptr;
-		n2 = cnt2 & rb->size_mask;
-	} else {
-		n1 = to_read;
-		n2 = 0;
-	}
+	read_data(rb, r, dest, to_read);
+	STORE_PTR(rb->read_ptr, (r + to_read) & rb->size_mask);
 
-	memcpy (dest, &(rb->buf[rb->read_ptr]), n1);
-	rb->read_ptr = (rb->read_ptr + n1) & rb->size_mask;
-	if (n2) {
-		memcpy (dest + n1, &(rb->buf[rb->read_ptr]), n2);
-		rb->read_ptr = (rb->read_ptr + n2) & rb->size_mask;
-	}
 	return to_read;
 }
 
 SPA_EXPORT
 size_t jack_ringbuffer_peek(jack_ringbuffer_t *rb, char *dest, size_t cnt)
 {
-	size_t free_cnt;
-	size_t cnt2;
-	size_t to_read;
-	size_t n1, n2;
-	size_t tmp_read_ptr;
+	size_t w, r, to_read;
 
-	tmp_read_ptr = rb->read_ptr;
+	w = LOAD_PTR(rb->write_ptr);
+	r = LOAD_OWN_PTR(rb->read_ptr);
 
-	if ((free_cnt = jack_ringbuffer_read_space (rb)) == 0)
+	if ((to_read = SPA_MIN(cnt, read_space(rb, w, r))) == 0)
 		return 0;
 
-	to_read = cnt > free_cnt ? free_cnt : cnt;
-
-	cnt2 = tmp_read_ptr + to_read;
-
-	if (cnt2 > rb->size) {
-		n1 = rb->size - tmp_read_ptr;
-		n2 = cnt2 & rb->size_mask;
-	} else {
-		n1 = to_read;
-		n2 = 0;
-	}
-
-	memcpy (dest, &(rb->buf[tmp_read_ptr]), n1);
-	tmp_read_ptr = (tmp_read_ptr + n1) & rb->size_mask;
-
-	if (n2)
-		memcpy (dest + n1, &(rb->buf[tmp_read_ptr]), n2);
+	read_data(rb, r, dest, to_read);
 
 	return to_read;
 }
@@ -201,8 +191,8 @@ size_t jack_ringbuffer_peek(jack_ringbuffer_t *rb, char *dest, size_t cnt)
 SPA_EXPORT
 void jack_ringbuffer_read_advance(jack_ringbuffer_t *rb, size_t cnt)
 {
-	size_t tmp = (rb->read_ptr + cnt) & rb->size_mask;
-	rb->read_ptr = tmp;
+	size_t r = LOAD_OWN_PTR(rb->read_ptr);
+	STORE_PTR(rb->read_ptr, (r + cnt) & rb->size_mask);
 }
 
 SPA_EXPORT
@@ -210,13 +200,10 @@ size_t jack_ringbuffer_read_space(const jack_ringbuffer_t *rb)
 {
 	size_t w, r;
 
-	w = rb->write_ptr;
-	r = rb->read_ptr;
+	w = LOAD_PTR(rb->write_ptr);
+	r = LOAD_PTR(rb->read_ptr);
 
-	if (w > r)
-		return w - r;
-	else
-		return (w - r + rb->size) & rb->size_mask;
+	return read_space(rb, w, r);
 }
 
 SPA_EXPORT
@@ -233,8 +220,8 @@ int jack_ringbuffer_mlock(jack_ringbuffer_t *rb)
 SPA_EXPORT
 void jack_ringbuffer_reset(jack_ringbuffer_t *rb)
 {
-	rb->read_ptr = 0;
-	rb->write_ptr = 0;
+	STORE_PTR(rb->read_ptr, 0);
+	STORE_PTR(rb->write_ptr, 0);
 	memset(rb->buf, 0, rb->size);
 }
 
@@ -243,48 +230,33 @@ void jack_ringbuffer_reset_size (jack_ringbuffer_t * rb, size_t sz)
 {
 	rb->size = sz;
 	rb->size_mask = rb->size - 1;
-	rb->read_ptr = 0;
-	rb->write_ptr = 0;
+	STORE_PTR(rb->read_ptr, 0);
+	STORE_PTR(rb->write_ptr, 0);
 }
 
 SPA_EXPORT
 size_t jack_ringbuffer_write(jack_ringbuffer_t *rb, const char *src,
                              size_t cnt)
 {
-	size_t free_cnt;
-	size_t cnt2;
-	size_t to_write;
-	size_t n1, n2;
+	size_t w, r, to_write;
 
-	if ((free_cnt = jack_ringbuffer_write_space (rb)) == 0)
-		return 0;
-
-	to_write = cnt > free_cnt ? free_cnt : cnt;
+	w = LOAD_OWN_PTR(rb->write_ptr);
+	r = LOAD_PTR(rb->read_ptr);
 
-	cnt2 = rb->write_ptr + to_write;
+	if ((to_write = SPA_MIN(cnt, write_space(rb, w, r))) == 0)
+		return 0;
 
-	if (cnt2 > rb->size) {
-		n1 = rb->size - rb->write_ptr;
-		n2 = cnt2 & rb->size_mask;
-	} else {
-		n1 = to_write;
-		n2 = 0;
-	}
+	write_data(rb, w, src, to_write);
+	STORE_PTR(rb->write_ptr, (w + to_write) & rb->size_mask);
 
-	memcpy (&(rb->buf[rb->write_ptr]), src, n1);
-	rb->write_ptr = (rb->write_ptr + n1) & rb->size_mask;
-	if (n2) {
-		memcpy (&(rb->buf[rb->write_ptr]), src + n1, n2);
-		rb->write_ptr = (rb->write_ptr + n2) & rb->size_mask;
-	}
 	return to_write;
 }
 
 SPA_EXPORT
 void jack_ringbuffer_write_advance(jack_ringbuffer_t *rb, size_t cnt)
 {
-	size_t tmp = (rb->write_ptr + cnt) & rb->size_mask;
-	rb->write_ptr = tmp;
+	size_t w = LOAD_OWN_PTR(rb->write_ptr);
+	STORE_PTR(rb->write_ptr, (w + cnt) & rb->size_mask);
 }
 
 SPA_EXPORT
@@ -292,13 +264,8 @@ size_t jack_ringbuffer_write_space(const jack_ringbuffer_t *rb)
 {
 	size_t w, r;
 
-	w = rb->write_ptr;
-	r = rb->read_ptr;
+	w = LOAD_PTR(rb->write_ptr);
+	r = LOAD_PTR(rb->read_ptr);
 
-	if (w > r)
-		return ((r - w + rb->size) & rb->size_mask) - 1;
-	else if (w < r)
-		return (r - w) - 1;
-	else
-		return rb->size - 1;
+	return write_space(rb, w, r);
 }
@@ -0,0 +1,195 @@
+/* PipeWire
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <spa/utils/defs.h>
+
+#include <jack/ringbuffer.h>
+
+#define DEFAULT_SIZE	(256 * 1024)
+#define DEFAULT_TOTAL	(256u * 1024u * 1024u)
+#define MAX_CHUNK	(64 * 1024)
+#define LATENCY_LOOPS	200000
+
+static jack_ringbuffer_t *rb, *rb_ack;
+static size_t chunk, total;
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void fill(uint32_t *data, uint32_t *seq, size_t n_values)
+{
+	size_t i;
+	for (i = 0; i < n_values; i++)
+		data[i] = (*seq)++;
+}
+
+static void *writer_start(void *arg)
+{
+	uint32_t seq = 0, data[MAX_CHUNK / sizeof(uint32_t)];
+	size_t done = 0, offs = 0, res;
+
+	fill(data, &seq, chunk / sizeof(uint32_t));
+	while (done < total) {
+		res = jack_ringbuffer_write(rb, (char*)data + offs, chunk - offs);
+		if (res == 0)
+			sched_yield();
+		offs += res;
+		if (offs == chunk) {
+			done += chunk;
+			offs = 0;
+			fill(data, &seq, chunk / sizeof(uint32_t));
+		}
+	}
+	return NULL;
+}
+
+static void *reader_start(void *arg)
+{
+	uint32_t seq = 0, data[MAX_CHUNK / sizeof(uint32_t)];
+	size_t i, done = 0, offs = 0, res;
+
+	while (done < total) {
+		res = jack_ringbuffer_read(rb, (char*)data + offs, chunk - offs);
+		if (res == 0)
+			sched_yield();
+		offs += res;
+		if (offs == chunk) {
+			for (i = 0; i < chunk / sizeof(uint32_t); i++) {
+				if (data[i] != seq++) {
+					fprintf(stderr, "mismatch at %zd: %u != %u\n",
+							done + i, data[i], seq - 1);
+					exit(EXIT_FAILURE);
+				}
+			}
+			done += chunk;
+			offs = 0;
+		}
+	}
+	return NULL;
+}
+
+static void *pong_start(void *arg)
+{
+	uint64_t val;
+	int i;
+
+	for (i = 0; i < LATENCY_LOOPS; i++) {
+		while (jack_ringbuffer_read_space(rb) < sizeof(val))
+			sched_yield();
+		jack_ringbuffer_read(rb, (char*)&val, sizeof(val));
+		while (jack_ringbuffer_write(rb_ack, (char*)&val, sizeof(val)) == 0)
+			sched_yield();
+	}
+	return NULL;
+}
+
+static void run_throughput(size_t size)
+{
+	pthread_t reader_thread, writer_thread;
+	uint64_t t1, t2;
+
+	jack_ringbuffer_reset(rb);
+
+	t1 = get_time_ns();
+	pthread_create(&reader_thread, NULL, reader_start, NULL);
+	pthread_create(&writer_thread, NULL, writer_start, NULL);
+	pthread_join(writer_thread, NULL);
+	pthread_join(reader_thread, NULL);
+	t2 = get_time_ns();
+
+	fprintf(stderr, "size %zd chunk %5zd: %zd MB in %f s: %f MB/s\n",
+			size, chunk, total >> 20, (t2 - t1) / 1e9,
+			(total / 1048576.0) / ((t2 - t1) / 1e9));
+}
+
+static void run_latency(void)
+{
+	pthread_t pong_thread;
+	uint64_t val, t1, t2;
+	int i;
+
+	jack_ringbuffer_reset(rb);
+	jack_ringbuffer_reset(rb_ack);
+
+	pthread_create(&pong_thread, NULL, pong_start, NULL);
+
+	t1 = get_time_ns();
+	for (i = 0; i < LATENCY_LOOPS; i++) {
+		val = i;
+		while (jack_ringbuffer_write(rb, (char*)&val, sizeof(val)) == 0)
+			sched_yield();
+		while (jack_ringbuffer_read_space(rb_ack) < sizeof(val))
+			sched_yield();
+		jack_ringbuffer_read(rb_ack, (char*)&val, sizeof(val));
+		if (val != (uint64_t)i) {
+			fprintf(stderr, "latency mismatch %"PRIu64" != %d\n", val, i);
+			exit(EXIT_FAILURE);
+		}
+	}
+	t2 = get_time_ns();
+	pthread_join(pong_thread, NULL);
+
+	fprintf(stderr, "round trip: %f ns\n", (t2 - t1) / (double)LATENCY_LOOPS);
+}
+
+int main(int argc, char *argv[])
+{
+	static const size_t chunks[] = { 64, 1024, 16384, MAX_CHUNK };
+	size_t i, size = DEFAULT_SIZE;
+
+	if (argc > 1)
+		size = atoi(argv[1]);
+	total = argc > 2 ? (size_t)atoi(argv[2]) << 20 : DEFAULT_TOTAL;
+
+	rb = jack_ringbuffer_create(size);
+	rb_ack = jack_ringbuffer_create(64);
+	if (rb == NULL || rb_ack == NULL) {
+		fprintf(stderr, "can't create ringbuffer: %m\n");
+		return -1;
+	}
+
+	for (i = 0; i < SPA_N_ELEMENTS(chunks); i++) {
+		chunk = SPA_MIN(chunks[i], rb->size / 2);
+		total = SPA_ROUND_DOWN_N(total, chunk);
+		run_throughput(rb->size);
+	}
+	run_latency();
+
+	jack_ringbuffer_free(rb);
+	jack_ringbuffer_free(rb_ack);
+
+	return 0;
+}
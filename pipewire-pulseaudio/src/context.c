@@ -40,9 +40,26 @@ int pa_context_set_error(PA_CONST pa_context *c, int error) {
 	return error;
 }
 
+static inline uint32_t hash_id(uint32_t id)
+{
+	return (id * 0x9e3779b1u) & (GLOBAL_HASH_SIZE - 1);
+}
+
+static inline uint32_t hash_name(const char *name)
+{
+	uint32_t h = 2166136261u;
+	while (*name)
+		h = (h ^ (uint8_t)*name++) * 16777619u;
+	return h & (GLOBAL_HASH_SIZE - 1);
+}
+
 static void global_free(pa_context *c, struct global *g)
 {
 	spa_list_remove(&g->link);
+	spa_list_remove(&g->id_link);
+	spa_list_remove(&g->name_link);
+	spa_list_remove(&g->node_link[0]);
+	spa_list_remove(&g->node_link[1]);
 
 	if (g->destroy)
 		g->destroy(g);
@@ -76,6 +93,8 @@ static void context_unlink(pa_context *c)
 	spa_list_consume(g, &c->globals, link)
 		global_free(c, g);
 
+	pa_context_scache_destroy(c);
+
 	spa_list_consume(o, &c->operations, link)
 		pa_operation_cancel(o);
 }
@@ -121,7 +140,7 @@ pa_context *pa_context_new(pa_mainloop_api *mainloop, const char *name)
 struct global *pa_context_find_global(pa_context *c, uint32_t id)
 {
 	struct global *g;
-	spa_list_for_each(g, &c->globals, link) {
+	spa_list_for_each(g, &c->globals_by_id[hash_id(id)], id_link) {
 		if (g->id == id)
 			return g;
 	}
@@ -134,49 +153,100 @@ struct global *pa_context_find_global_by_name(pa_context *c, uint32_t mask, cons
 	const char *str;
 	uint32_t id = atoi(name);
 
-	spa_list_for_each(g, &c->globals, link) {
+	spa_list_for_each(g, &c->globals_by_name[hash_name(name)], name_link) {
 		if ((g->mask & mask) == 0)
 			continue;
-		if (g->props != NULL &&
-		    (str = pw_properties_get(g->props, PW_KEY_NODE_NAME)) != NULL &&
+		if ((str = pw_properties_get(g->props, PW_KEY_NODE_NAME)) != NULL &&
 		    strcmp(str, name) == 0)
 			return g;
-		if (g->id == id || (g->id == (id & PA_IDX_MASK_DSP)))
-			return g;
 	}
+	if ((g = pa_context_find_global(c, id)) != NULL && (g->mask & mask))
+		return g;
+	if ((g = pa_context_find_global(c, id & PA_IDX_MASK_DSP)) != NULL && (g->mask & mask))
+		return g;
 	return NULL;
 }
 
 struct global *pa_context_find_linked(pa_context *c, uint32_t idx)
 {
 	struct global *g, *f;
+	uint32_t i, h = hash_id(idx);
 
-	spa_list_for_each(g, &c->globals, link) {
-		uint32_t src_node_id, dst_node_id;
+	for (i = 0; i < 2; i++) {
+		spa_list_for_each(g, &c->links_by_node[i][h], node_link[i]) {
+			uint32_t src_node_id, dst_node_id;
 
-		if (strcmp(g->type, PW_TYPE_INTERFACE_Link) != 0)
-			continue;
+			src_node_id = g->link_info.src->port_info.node_id;
+			dst_node_id = g->link_info.dst->port_info.node_id;
 
-		src_node_id = g->link_info.src->port_info.node_id;
-		dst_node_id = g->link_info.dst->port_info.node_id;
+			pw_log_debug("context %p: %p %d %d %d", c, g, idx,
+					src_node_id, dst_node_id);
 
-		pw_log_debug("context %p: %p %d %d %d", c, g, idx,
-				src_node_id, dst_node_id);
-
-		if (src_node_id == idx)
-			f = pa_context_find_global(c, dst_node_id);
-		else if (dst_node_id == idx)
-			f = pa_context_find_global(c, src_node_id);
-		else
-			continue;
+			if (i == 0 && src_node_id == idx)
+				f = pa_context_find_global(c, dst_node_id);
+			else if (i == 1 && dst_node_id == idx)
+				f = pa_context_find_global(c, src_node_id);
+			else
+				continue;
 
-		if (f == NULL)
-			continue;
-		return f;
+			if (f == NULL)
+				continue;
+			return f;
+		}
 	}
 	return NULL;
 }
 
+static void index_global(pa_context *c, struct global *g)
+{
+	const char *str;
+
+	spa_list_append(&c->globals_by_id[hash_id(g->id)], &g->id_link);
+
+	if (g->props != NULL &&
+	    (str = pw_properties_get(g->props, PW_KEY_NODE_NAME)) != NULL)
+		spa_list_append(&c->globals_by_name[hash_name(str)], &g->name_link);
+
+	if (strcmp(g->type, PW_TYPE_INTERFACE_Link) == 0) {
+		spa_list_append(&c->links_by_node[0][hash_id(g->link_info.src->port_info.node_id)],
+				&g->node_link[0]);
+		spa_list_append(&c->links_by_node[1][hash_id(g->link_info.dst->port_info.node_id)],
+				&g->node_link[1]);
+	}
+}
+
+pa_proplist *pa_context_node_proplist(pa_context *c, struct global *g)
+{
+	struct pw_node_info *info = g->info;
+	struct global *cl;
+
+	if (g->node_info.proplist == NULL) {
+		g->node_info.proplist = pa_proplist_new_dict(info->props);
+
+		if ((g->mask & (PA_SUBSCRIPTION_MASK_SINK_INPUT | PA_SUBSCRIPTION_MASK_SOURCE_OUTPUT)) &&
+		    (cl = pa_context_find_global(c, g->node_info.client_id)) != NULL &&
+		    cl->client_info.info.proplist)
+			pa_proplist_update(g->node_info.proplist, PA_UPDATE_MERGE,
+					cl->client_info.info.proplist);
+	}
+	return g->node_info.proplist;
+}
+
+pa_proplist *pa_context_node_format_plist(pa_context *c, struct global *g)
+{
+	if (g->node_info.format_plist == NULL)
+		g->node_info.format_plist = pa_proplist_new();
+	return g->node_info.format_plist;
+}
+
+static void clear_node_proplist(struct global *g)
+{
+	if (g->node_info.proplist) {
+		pa_proplist_free(g->node_info.proplist);
+		g->node_info.proplist = NULL;
+	}
+}
+
 static void emit_event(pa_context *c, struct global *g, pa_subscription_event_type_t event)
 {
 	if (c->subscribe_callback && (c->subscribe_mask & g->mask)) {
@@ -333,6 +403,9 @@ static void node_event_info(void *object, const struct pw_node_info *info)
 	pw_log_debug("update %d %"PRIu64, g->id, info->change_mask);
 	g->info = pw_node_info_update(g->info, info);
 
+	if (info->change_mask & PW_NODE_CHANGE_MASK_PROPS)
+		clear_node_proplist(g);
+
 	if (info->change_mask & PW_NODE_CHANGE_MASK_PARAMS && !g->subscribed) {
 		uint32_t subscribed[32], n_subscribed = 0;
 
@@ -413,6 +486,9 @@ static const struct pw_node_events node_events = {
 static void node_destroy(void *data)
 {
 	struct global *global = data;
+	clear_node_proplist(global);
+	if (global->node_info.format_plist)
+		pa_proplist_free(global->node_info.format_plist);
 	if (global->info)
 		pw_node_info_free(global->info);
 }
@@ -469,10 +545,19 @@ static void client_event_info(void *object, const struct pw_client_info *info)
 	i->owner_module = str ? (unsigned)atoi(str) : SPA_ID_INVALID;
 
 	if (info->change_mask & PW_CLIENT_CHANGE_MASK_PROPS) {
+		struct global *f;
+
 		if (i->proplist)
 			pa_proplist_update_dict(i->proplist, info->props);
 		else
 			i->proplist = pa_proplist_new_dict(info->props);
+
+		/* streams merge the client props into theirs */
+		spa_list_for_each(f, &g->context->globals, link) {
+			if ((f->mask & (PA_SUBSCRIPTION_MASK_SINK_INPUT | PA_SUBSCRIPTION_MASK_SOURCE_OUTPUT)) &&
+			    f->node_info.client_id == g->id)
+				clear_node_proplist(f);
+		}
 		i->name = info->props ?
 			spa_dict_lookup(info->props, PW_KEY_APP_NAME) : NULL;
 		i->driver = info->props ?
@@ -692,12 +777,18 @@ static void registry_event_global(void *data, uint32_t id,
 	g->type = strdup(type);
 	g->init = true;
 	g->props = props ? pw_properties_new_dict(props) : NULL;
+	spa_list_init(&g->id_link);
+	spa_list_init(&g->name_link);
+	spa_list_init(&g->node_link[0]);
+	spa_list_init(&g->node_link[1]);
 
 	res = set_mask(c, g);
 	insert_global(c, g);
 
 	if (res != 1)
 		global_free(c, g);
+	else
+		index_global(c, g);
 }
 
 static void registry_event_global_remove(void *object, uint32_t id)
@@ -834,6 +925,7 @@ pa_context *pa_context_new_with_proplist(pa_mainloop_api *mainloop, const char *
 	struct pw_loop *loop;
 	struct pw_properties *props;
 	pa_context *c;
+	uint32_t i;
 
 	pa_assert(mainloop);
 
@@ -865,9 +957,17 @@ pa_context *pa_context_new_with_proplist(pa_mainloop_api *mainloop, const char *
 	c->state = PA_CONTEXT_UNCONNECTED;
 
 	spa_list_init(&c->globals);
+	for (i = 0; i < GLOBAL_HASH_SIZE; i++) {
+		spa_list_init(&c->globals_by_id[i]);
+		spa_list_init(&c->globals_by_name[i]);
+		spa_list_init(&c->links_by_node[0][i]);
+		spa_list_init(&c->links_by_node[1][i]);
+	}
 
 	spa_list_init(&c->streams);
 	spa_list_init(&c->operations);
+	spa_list_init(&c->samples);
+	spa_list_init(&c->cache_players);
 
 	return c;
 }
@@ -221,8 +221,13 @@ struct param {
 #define PA_IDX_FLAG_DSP		0x800000U
 #define PA_IDX_MASK_DSP		0x7fffffU
 
+#define GLOBAL_HASH_SIZE	128
+
 struct global {
 	struct spa_list link;
+	struct spa_list id_link;
+	struct spa_list name_link;
+	struct spa_list node_link[2];	/* links, by output and input node */
 	uint32_t id;
 	char *type;
 	struct pw_properties *props;
@@ -258,6 +263,8 @@ struct global {
 			uint32_t n_channel_volumes;
 			float channel_volumes[SPA_AUDIO_MAX_CHANNELS];
 			uint32_t device_id;
+			pa_proplist *proplist;		/* cached, cleared when props change */
+			pa_proplist *format_plist;
 		} node_info;
 		struct {
 			uint32_t node_id;
@@ -309,10 +316,17 @@ struct pa_context {
 	pa_subscription_mask_t subscribe_mask;
 
 	struct spa_list globals;
+	struct spa_list globals_by_id[GLOBAL_HASH_SIZE];
+	struct spa_list globals_by_name[GLOBAL_HASH_SIZE];
+	struct spa_list links_by_node[2][GLOBAL_HASH_SIZE];
 
 	struct spa_list streams;
 	struct spa_list operations;
 
+	struct spa_list samples;
+	uint32_t sample_index;
+	struct spa_list cache_players;
+
 	int no_fail:1;
 	int disconnect:1;
 };
@@ -320,6 +334,10 @@ struct pa_context {
 struct global *pa_context_find_global(pa_context *c, uint32_t id);
 struct global *pa_context_find_global_by_name(pa_context *c, uint32_t mask, const char *name);
 struct global *pa_context_find_linked(pa_context *c, uint32_t id);
+pa_proplist *pa_context_node_proplist(pa_context *c, struct global *g);
+pa_proplist *pa_context_node_format_plist(pa_context *c, struct global *g);
+
+void pa_context_scache_destroy(pa_context *c);
 
 #define MAX_BUFFERS     64u
 #define MASK_BUFFERS    (MAX_BUFFERS-1)
@@ -402,10 +420,16 @@ struct pa_stream {
 	bool mute;
 	pa_operation *drain;
 	uint64_t queued;
+
+	struct cache_sample *upload;
 };
 
 void pa_stream_set_state(pa_stream *s, pa_stream_state_t st);
 
+int pa_stream_upload_begin_write(pa_stream *s, void **data, size_t *nbytes);
+int pa_stream_upload_write(pa_stream *s, const void *data, size_t nbytes);
+void pa_stream_upload_free(pa_stream *s);
+
 typedef void (*pa_operation_cb_t)(pa_operation *o, void *userdata);
 
 struct pa_operation
@@ -132,7 +132,7 @@ static void sink_callback(struct sink_data *d)
 		  PA_SINK_HW_VOLUME_CTRL | PA_SINK_HW_MUTE_CTRL |
 		  PA_SINK_LATENCY | PA_SINK_DYNAMIC_LATENCY |
 		  PA_SINK_DECIBEL_VOLUME;
-	i.proplist = pa_proplist_new_dict(info->props);
+	i.proplist = pa_context_node_proplist(d->context, g);
 	i.configured_latency = 0;
 	i.base_volume = PA_VOLUME_NORM;
 	i.state = node_state_to_sink(info->state);
@@ -143,12 +143,10 @@ static void sink_callback(struct sink_data *d)
 	i.active_port = NULL;
 	i.n_formats = 1;
 	ii[0].encoding = PA_ENCODING_PCM;
-	ii[0].plist = pa_proplist_new();
+	ii[0].plist = pa_context_node_format_plist(d->context, g);
 	ip[0] = ii;
 	i.formats = ip;
 	d->cb(d->context, &i, 0, d->userdata);
-	pa_proplist_free(i.proplist);
-	pa_proplist_free(ii[0].plist);
 }
 
 static void sink_info(pa_operation *o, void *userdata)
@@ -598,7 +596,7 @@ static void source_callback(struct source_data *d)
 	i.latency = 0;
 	i.driver = "PipeWire";
 	i.flags = flags;
-	i.proplist = pa_proplist_new_dict(info->props);
+	i.proplist = pa_context_node_proplist(d->context, g);
 	i.configured_latency = 0;
 	i.base_volume = PA_VOLUME_NORM;
 	i.state = node_state_to_source(info->state);
@@ -609,12 +607,10 @@ static void source_callback(struct source_data *d)
 	i.active_port = NULL;
 	i.n_formats = 1;
 	ii[0].encoding = PA_ENCODING_PCM;
-	ii[0].plist = pa_proplist_new();
+	ii[0].plist = pa_context_node_format_plist(d->context, g);
 	ip[0] = ii;
 	i.formats = ip;
 	d->cb(d->context, &i, 0, d->userdata);
-	pa_proplist_free(i.proplist);
-	pa_proplist_free(ii[0].plist);
 }
 
 static void source_info(pa_operation *o, void *userdata)
@@ -1546,7 +1542,7 @@ struct sink_input_data {
 
 static void sink_input_callback(struct sink_input_data *d)
 {
-	struct global *g = d->global, *cl;
+	struct global *g = d->global;
 	struct pw_node_info *info = g->info;
 	const char *name = NULL;
 	uint32_t n;
@@ -1568,8 +1564,6 @@ static void sink_input_callback(struct sink_input_data *d)
 	if (name == NULL)
 		name = "unknown";
 
-	cl = pa_context_find_global(d->context, g->node_info.client_id);
-
 	spa_zero(i);
 	i.index = g->id;
 	i.name = name;
@@ -1600,7 +1594,7 @@ static void sink_input_callback(struct sink_input_data *d)
 			i.sample_spec.channels = 2;
 		pa_channel_map_init_auto(&i.channel_map, i.sample_spec.channels, PA_CHANNEL_MAP_OSS);
 		ii[0].encoding = PA_ENCODING_PCM;
-		ii[0].plist = pa_proplist_new();
+		ii[0].plist = pa_context_node_format_plist(d->context, g);
 		i.format = ii;
 	}
 	pa_cvolume_init(&i.volume);
@@ -1613,9 +1607,7 @@ static void sink_input_callback(struct sink_input_data *d)
 	i.sink_usec = 0;
 	i.resample_method = "PipeWire resampler";
 	i.driver = "PipeWire";
-	i.proplist = pa_proplist_new_dict(info->props);
-	if (cl && cl->client_info.info.proplist)
-		pa_proplist_update(i.proplist, PA_UPDATE_MERGE, cl->client_info.info.proplist);
+	i.proplist = pa_context_node_proplist(d->context, g);
 	i.corked = false;
 	i.has_volume = true;
 	i.volume_writable = true;
@@ -1623,8 +1615,6 @@ static void sink_input_callback(struct sink_input_data *d)
 	pw_log_debug("context %p: sink info for %d sink:%d", g->context, i.index, i.sink);
 
 	d->cb(d->context, &i, 0, d->userdata);
-
-	pa_proplist_free(i.proplist);
 }
 
 static void sink_input_info(pa_operation *o, void *userdata)
@@ -1858,7 +1848,7 @@ struct source_output_data {
 
 static void source_output_callback(struct source_output_data *d)
 {
-	struct global *g = d->global, *l, *cl;
+	struct global *g = d->global, *l;
 	struct pw_node_info *info = g->info;
 	const char *name = NULL;
 	uint32_t n;
@@ -1881,8 +1871,6 @@ static void source_output_callback(struct source_output_data *d)
 	if (name == NULL)
 		name = "unknown";
 
-	cl = pa_context_find_global(d->context, g->node_info.client_id);
-
 	spa_zero(i);
 	i.index = g->id;
 	i.name = name;
@@ -1912,7 +1900,7 @@ static void source_output_callback(struct source_output_data *d)
 			i.sample_spec.channels = 2;
 		pa_channel_map_init_auto(&i.channel_map, i.sample_spec.channels, PA_CHANNEL_MAP_OSS);
 		ii[0].encoding = PA_ENCODING_PCM;
-		ii[0].plist = pa_proplist_new();
+		ii[0].plist = pa_context_node_format_plist(d->context, g);
 		i.format = ii;
 	}
 	pa_cvolume_init(&i.volume);
@@ -1925,16 +1913,12 @@ static void source_output_callback(struct source_output_data *d)
 	i.source_usec = 0;
 	i.resample_method = "PipeWire resampler";
 	i.driver = "PipeWire";
-	i.proplist = pa_proplist_new_dict(info->props);
-	if (cl && cl->client_info.info.proplist)
-		pa_proplist_update(i.proplist, PA_UPDATE_MERGE, cl->client_info.info.proplist);
+	i.proplist = pa_context_node_proplist(d->context, g);
 	i.corked = false;
 	i.has_volume = true;
 	i.volume_writable = true;
 
 	d->cb(d->context, &i, 0, d->userdata);
-
-	pa_proplist_free(i.proplist);
 }
 
 static void source_output_info(pa_operation *o, void *userdata)
@@ -17,39 +17,677 @@
  * Boston, MA 02110-1301, USA.
  */
 
+
+#include <config.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <spa/utils/result.h>
+#include <spa/param/audio/format-utils.h>
+
 #include <pipewire/log.h>
 
 #include <pulse/scache.h>
 
 #include "internal.h"
 
+/* Samples are converted once, when the upload finishes, to the format of
+ * the cache player streams. Playing a sample then only adds a voice to the
+ * player of the sink, which is a stream that stays connected.
+ *
+ * There is no sample cache in the server, the samples are kept in the
+ * context and are not shared with other clients. */
+#define CACHE_RATE	48000
+#define CACHE_CHANNELS	2
+#define CACHE_STRIDE	(CACHE_CHANNELS * sizeof(float))
+#define CACHE_MAX_QUANTUM	8192
+#define CACHE_IDLE	2
+
+struct cache_sample {
+	struct spa_list link;
+	int refcount;
+	char *name;
+
+	/* upload */
+	pa_sample_spec ss;
+	pa_channel_map map;
+	uint8_t *raw;
+	size_t raw_size;
+	size_t raw_offset;
+
+	/* converted */
+	float *data;
+	uint32_t n_frames;
+	uint32_t index;
+};
+
+struct cache_player {
+	struct spa_list link;
+	uint32_t target;
+	struct pw_stream *stream;
+	struct spa_hook listener;
+	struct spa_io_position *position;
+	struct spa_list voices;
+	uint32_t idle;
+};
+
+struct cache_voice {
+	struct spa_list link;
+	struct cache_sample *sample;
+	uint32_t offset;
+	float volume;
+};
+
+static void sample_unref(struct cache_sample *cs)
+{
+	if (--cs->refcount > 0)
+		return;
+	free(cs->data);
+	free(cs->raw);
+	free(cs->name);
+	free(cs);
+}
+
+static bool format_supported(pa_sample_format_t format)
+{
+	switch (format) {
+	case PA_SAMPLE_U8:
+	case PA_SAMPLE_S16LE:
+	case PA_SAMPLE_S16BE:
+	case PA_SAMPLE_FLOAT32LE:
+	case PA_SAMPLE_FLOAT32BE:
+	case PA_SAMPLE_S32LE:
+	case PA_SAMPLE_S32BE:
+	case PA_SAMPLE_S24LE:
+	case PA_SAMPLE_S24BE:
+	case PA_SAMPLE_S24_32LE:
+	case PA_SAMPLE_S24_32BE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static inline float read_sample(pa_sample_format_t format, const uint8_t *p)
+{
+	union { uint32_t i; float f; } v;
+
+	switch (format) {
+	case PA_SAMPLE_U8:
+		return (p[0] - 128) / 128.0f;
+	case PA_SAMPLE_S16LE:
+		return (int16_t)(p[0] | p[1] << 8) / 32768.0f;
+	case PA_SAMPLE_S16BE:
+		return (int16_t)(p[1] | p[0] << 8) / 32768.0f;
+	case PA_SAMPLE_FLOAT32LE:
+		v.i = (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+		return v.f;
+	case PA_SAMPLE_FLOAT32BE:
+		v.i = (uint32_t)p[3] | (uint32_t)p[2] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[0] << 24;
+		return v.f;
+	case PA_SAMPLE_S32LE:
+		v.i = (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+		return (int32_t)v.i / 2147483648.0f;
+	case PA_SAMPLE_S32BE:
+		v.i = (uint32_t)p[3] | (uint32_t)p[2] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[0] << 24;
+		return (int32_t)v.i / 2147483648.0f;
+	case PA_SAMPLE_S24LE:
+		v.i = (uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24;
+		return (int32_t)v.i / 2147483648.0f;
+	case PA_SAMPLE_S24BE:
+		v.i = (uint32_t)p[2] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[0] << 24;
+		return (int32_t)v.i / 2147483648.0f;
+	case PA_SAMPLE_S24_32LE:
+		v.i = (uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24;
+		return (int32_t)v.i / 2147483648.0f;
+	case PA_SAMPLE_S24_32BE:
+		v.i = (uint32_t)p[3] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[1] << 24;
+		return (int32_t)v.i / 2147483648.0f;
+	default:
+		return 0.0f;
+	}
+}
+
+/* 0 for channels that go to the left, 1 for the right and -1 for
+ * channels that are mixed into both */
+static int channel_side(pa_channel_position_t pos)
+{
+	switch (pos) {
+	case PA_CHANNEL_POSITION_FRONT_LEFT:
+	case PA_CHANNEL_POSITION_REAR_LEFT:
+	case PA_CHANNEL_POSITION_SIDE_LEFT:
+	case PA_CHANNEL_POSITION_FRONT_LEFT_OF_CENTER:
+	case PA_CHANNEL_POSITION_TOP_FRONT_LEFT:
+	case PA_CHANNEL_POSITION_TOP_REAR_LEFT:
+		return 0;
+	case PA_CHANNEL_POSITION_FRONT_RIGHT:
+	case PA_CHANNEL_POSITION_REAR_RIGHT:
+	case PA_CHANNEL_POSITION_SIDE_RIGHT:
+	case PA_CHANNEL_POSITION_FRONT_RIGHT_OF_CENTER:
+	case PA_CHANNEL_POSITION_TOP_FRONT_RIGHT:
+	case PA_CHANNEL_POSITION_TOP_REAR_RIGHT:
+		return 1;
+	default:
+		return -1;
+	}
+}
+
+/* convert the uploaded data to stereo float at the cache rate. The
+ * channels are downmixed to the left and right side and the rate is
+ * converted with linear interpolation, this only happens once per sample. */
+static int sample_convert(struct cache_sample *cs)
+{
+	uint32_t i, j, n_frames, n_channels = cs->ss.channels;
+	size_t sample_size = pa_sample_size(&cs->ss);
+	size_t frame_size = pa_frame_size(&cs->ss);
+	float gain[CACHE_CHANNELS] = { 0.0f, 0.0f }, *tmp;
+	int side[PA_CHANNELS_MAX];
+	int res;
+
+	n_frames = cs->raw_offset / frame_size;
+	if (n_frames == 0)
+		return -EINVAL;
+
+	for (i = 0; i < n_channels; i++) {
+		side[i] = n_channels == cs->map.channels ? channel_side(cs->map.map[i]) : -1;
+		if (side[i] != 1)
+			gain[0] += 1.0f;
+		if (side[i] != 0)
+			gain[1] += 1.0f;
+	}
+	gain[0] = gain[0] > 0.0f ? 1.0f / gain[0] : 0.0f;
+	gain[1] = gain[1] > 0.0f ? 1.0f / gain[1] : 0.0f;
+
+	if ((tmp = calloc(n_frames, CACHE_STRIDE)) == NULL)
+		return -errno;
+
+	for (i = 0; i < n_frames; i++) {
+		const uint8_t *p = &cs->raw[i * frame_size];
+		float *d = &tmp[i * CACHE_CHANNELS];
+
+		for (j = 0; j < n_channels; j++, p += sample_size) {
+			float v = read_sample(cs->ss.format, p);
+			if (side[j] != 1)
+				d[0] += v * gain[0];
+			if (side[j] != 0)
+				d[1] += v * gain[1];
+		}
+	}
+
+	cs->n_frames = (uint64_t)n_frames * CACHE_RATE / cs->ss.rate;
+	if (cs->n_frames == 0)
+		cs->n_frames = 1;
+
+	if ((cs->data = malloc(cs->n_frames * CACHE_STRIDE)) == NULL) {
+		res = -errno;
+		goto done;
+	}
+
+	for (i = 0; i < cs->n_frames; i++) {
+		uint64_t pos = (uint64_t)i * cs->ss.rate;
+		uint32_t idx = pos / CACHE_RATE;
+		float frac = (pos % CACHE_RATE) / (float)CACHE_RATE;
+		const float *s0 = &tmp[idx * CACHE_CHANNELS];
+		const float *s1 = idx + 1 < n_frames ? s0 + CACHE_CHANNELS : s0;
+
+		for (j = 0; j < CACHE_CHANNELS; j++)
+			cs->data[i * CACHE_CHANNELS + j] = s0[j] + (s1[j] - s0[j]) * frac;
+	}
+	res = 0;
+done:
+	free(tmp);
+	return res;
+}
+
+static struct cache_sample *find_sample(pa_context *c, const char *name)
+{
+	struct cache_sample *cs;
+
+	spa_list_for_each(cs, &c->samples, link) {
+		if (pa_streq(cs->name, name))
+			return cs;
+	}
+	return NULL;
+}
+
+static void remove_sample(struct cache_sample *cs)
+{
+	spa_list_remove(&cs->link);
+	sample_unref(cs);
+}
+
+static void voice_free(struct cache_voice *v)
+{
+	spa_list_remove(&v->link);
+	sample_unref(v->sample);
+	free(v);
+}
+
+/* the number of frames the graph wants in this cycle, in the rate of the
+ * player */
+static uint32_t player_quantum(struct cache_player *p, uint32_t max)
+{
+	struct spa_io_position *pos = p->position;
+	uint64_t n_frames;
+
+	if (pos == NULL || pos->clock.rate.denom == 0)
+		return max;
+
+	n_frames = pos->clock.duration * CACHE_RATE / pos->clock.rate.denom;
+	return SPA_CLAMP(n_frames, 1u, max);
+}
+
+static void player_process(void *data)
+{
+	struct cache_player *p = data;
+	struct pw_buffer *b;
+	struct spa_data *d;
+	struct cache_voice *v, *t;
+	uint32_t i, n_frames, n;
+	float *dst;
+
+	if ((b = pw_stream_dequeue_buffer(p->stream)) == NULL)
+		return;
+
+	d = &b->buffer->datas[0];
+	if ((dst = d->data) == NULL) {
+		pw_stream_queue_buffer(p->stream, b);
+		return;
+	}
+
+	n_frames = player_quantum(p, d->maxsize / CACHE_STRIDE);
+	memset(dst, 0, n_frames * CACHE_STRIDE);
+
+	spa_list_for_each_safe(v, t, &p->voices, link) {
+		const float *src = &v->sample->data[v->offset * CACHE_CHANNELS];
+
+		n = SPA_MIN(n_frames, v->sample->n_frames - v->offset);
+		for (i = 0; i < n * CACHE_CHANNELS; i++)
+			dst[i] += src[i] * v->volume;
+
+		v->offset += n;
+		if (v->offset >= v->sample->n_frames)
+			voice_free(v);
+	}
+
+	d->chunk->offset = 0;
+	d->chunk->size = n_frames * CACHE_STRIDE;
+	d->chunk->stride = CACHE_STRIDE;
+	b->size = n_frames;
+	pw_stream_queue_buffer(p->stream, b);
+
+	/* keep running for a few cycles so that the last voice is played
+	 * out completely, then go idle until the next sample is played */
+	if (!spa_list_is_empty(&p->voices))
+		p->idle = 0;
+	else if (++p->idle == CACHE_IDLE)
+		pw_stream_set_active(p->stream, false);
+}
+
+static void player_io_changed(void *data, uint32_t id, void *area, uint32_t size)
+{
+	struct cache_player *p = data;
+
+	switch (id) {
+	case SPA_IO_Position:
+		p->position = area;
+		break;
+	}
+}
+
+static void player_destroy(void *data)
+{
+	struct cache_player *p = data;
+	struct cache_voice *v;
+
+	spa_hook_remove(&p->listener);
+	spa_list_remove(&p->link);
+
+	spa_list_consume(v, &p->voices, link)
+		voice_free(v);
+	free(p);
+}
+
+static const struct pw_stream_events player_events =
+{
+	PW_VERSION_STREAM_EVENTS,
+	.destroy = player_destroy,
+	.io_changed = player_io_changed,
+	.process = player_process,
+};
+
+/* find or make the player for the sink with id \a target */
+static struct cache_player *ensure_player(pa_context *c, uint32_t target)
+{
+	const struct spa_pod *params[2];
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct spa_audio_info_raw info;
+	struct cache_player *p;
+
+	spa_list_for_each(p, &c->cache_players, link) {
+		if (p->target == target)
+			return p;
+	}
+
+	if ((p = calloc(1, sizeof(struct cache_player))) == NULL)
+		return NULL;
+
+	p->target = target;
+	spa_list_init(&p->voices);
+
+	p->stream = pw_stream_new(c->core, "Sample Cache",
+			pw_properties_new(
+				PW_KEY_MEDIA_TYPE, "Audio",
+				PW_KEY_MEDIA_CATEGORY, "Playback",
+				PW_KEY_MEDIA_ROLE, "Notification",
+				PW_KEY_CLIENT_API, "pulseaudio",
+				NULL));
+	if (p->stream == NULL) {
+		free(p);
+		return NULL;
+	}
+	spa_list_append(&c->cache_players, &p->link);
+	pw_stream_add_listener(p->stream, &p->listener, &player_events, p);
+
+	info = SPA_AUDIO_INFO_RAW_INIT(
+			.format = SPA_AUDIO_FORMAT_F32,
+			.channels = CACHE_CHANNELS,
+			.rate = CACHE_RATE);
+	info.position[0] = SPA_AUDIO_CHANNEL_FL;
+	info.position[1] = SPA_AUDIO_CHANNEL_FR;
+	params[0] = spa_format_audio_raw_build(&b, SPA_PARAM_EnumFormat, &info);
+	params[1] = spa_pod_builder_add_object(&b,
+	                SPA_TYPE_OBJECT_ParamBuffers, SPA_PARAM_Buffers,
+			SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(2, 2, MAX_BUFFERS),
+			SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(1),
+			SPA_PARAM_BUFFERS_size,    SPA_POD_Int(CACHE_MAX_QUANTUM * CACHE_STRIDE),
+			SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(CACHE_STRIDE),
+			SPA_PARAM_BUFFERS_align,   SPA_POD_Int(16));
+
+	if (pw_stream_connect(p->stream,
+			PW_DIRECTION_OUTPUT,
+			target,
+			PW_STREAM_FLAG_AUTOCONNECT |
+			PW_STREAM_FLAG_MAP_BUFFERS,
+			params, 2) < 0) {
+		pw_stream_destroy(p->stream);
+		return NULL;
+	}
+	return p;
+}
+
+void pa_context_scache_destroy(pa_context *c)
+{
+	struct cache_sample *cs;
+	struct cache_player *p;
+
+	spa_list_consume(p, &c->cache_players, link)
+		pw_stream_destroy(p->stream);
+	spa_list_consume(cs, &c->samples, link)
+		remove_sample(cs);
+}
+
+static void on_upload_request(pa_operation *o, void *userdata)
+{
+	pa_stream *s = o->stream;
+
+	pa_operation_done(o);
+
+	if (s->state == PA_STREAM_READY && s->dequeued_size > 0 && s->write_callback)
+		s->write_callback(s, s->dequeued_size, s->write_userdata);
+}
+
 SPA_EXPORT
 int pa_stream_connect_upload(pa_stream *s, size_t length)
 {
-	pw_log_warn("Not Implemented");
+	struct cache_sample *cs;
+	pa_operation *o;
+	const char *name;
+
+	spa_assert(s);
+	spa_assert(s->refcount >= 1);
+
+	PA_CHECK_VALIDITY(s->context, s->state == PA_STREAM_UNCONNECTED, PA_ERR_BADSTATE);
+	PA_CHECK_VALIDITY(s->context, length > 0, PA_ERR_INVALID);
+	PA_CHECK_VALIDITY(s->context, length == (size_t) (uint32_t) length, PA_ERR_INVALID);
+	PA_CHECK_VALIDITY(s->context, pa_sample_spec_valid(&s->sample_spec), PA_ERR_INVALID);
+	PA_CHECK_VALIDITY(s->context, length % pa_frame_size(&s->sample_spec) == 0, PA_ERR_INVALID);
+	PA_CHECK_VALIDITY(s->context, format_supported(s->sample_spec.format), PA_ERR_NOTSUPPORTED);
+
+	if ((name = pa_proplist_gets(s->proplist, PA_PROP_EVENT_ID)) == NULL &&
+	    (name = pa_proplist_gets(s->proplist, PA_PROP_MEDIA_NAME)) == NULL)
+		return -pa_context_set_error(s->context, PA_ERR_INVALID);
+
+	cs = calloc(1, sizeof(struct cache_sample));
+	if (cs == NULL)
+		return -pa_context_set_error(s->context, PA_ERR_INTERNAL);
+
+	cs->refcount = 1;
+	cs->name = strdup(name);
+	cs->ss = s->sample_spec;
+	cs->map = s->channel_map;
+	cs->raw_size = length;
+	cs->raw = malloc(length);
+	if (cs->name == NULL || cs->raw == NULL) {
+		sample_unref(cs);
+		return -pa_context_set_error(s->context, PA_ERR_INTERNAL);
+	}
+
+	pw_log_debug("stream %p: upload %s %zd", s, name, length);
+
+	s->upload = cs;
+	s->direction = PA_STREAM_UPLOAD;
+	s->dequeued_size = length;
+
+	pa_stream_set_state(s, PA_STREAM_CREATING);
+	pa_stream_set_state(s, PA_STREAM_READY);
+
+	o = pa_operation_new(s->context, s, on_upload_request, 0);
+	pa_operation_sync(o);
+	pa_operation_unref(o);
+
+	return 0;
+}
+
+int pa_stream_upload_begin_write(pa_stream *s, void **data, size_t *nbytes)
+{
+	struct cache_sample *cs = s->upload;
+	size_t max = cs->raw_size - cs->raw_offset;
+
+	*data = max > 0 ? &cs->raw[cs->raw_offset] : NULL;
+	*nbytes = *nbytes != (size_t)-1 ? SPA_MIN(*nbytes, max) : max;
+	return 0;
+}
+
+int pa_stream_upload_write(pa_stream *s, const void *data, size_t nbytes)
+{
+	struct cache_sample *cs = s->upload;
+	uint8_t *dst = &cs->raw[cs->raw_offset];
+
+	PA_CHECK_VALIDITY(s->context, nbytes <= cs->raw_size - cs->raw_offset, PA_ERR_TOOLARGE);
+
+	/* data from pa_stream_begin_write() is already in place */
+	if (data != dst)
+		memcpy(dst, data, nbytes);
+
+	cs->raw_offset += nbytes;
+	s->dequeued_size -= nbytes;
 	return 0;
 }
 
+void pa_stream_upload_free(pa_stream *s)
+{
+	if (s->upload) {
+		sample_unref(s->upload);
+		s->upload = NULL;
+	}
+}
+
 SPA_EXPORT
 int pa_stream_finish_upload(pa_stream *s)
 {
-	pw_log_warn("Not Implemented");
+	pa_context *c = s->context;
+	struct cache_sample *cs, *old;
+	int res;
+
+	spa_assert(s);
+	spa_assert(s->refcount >= 1);
+
+	PA_CHECK_VALIDITY(c, s->state == PA_STREAM_READY, PA_ERR_BADSTATE);
+	PA_CHECK_VALIDITY(c, s->direction == PA_STREAM_UPLOAD, PA_ERR_BADSTATE);
+
+	cs = s->upload;
+	s->upload = NULL;
+
+	if ((res = sample_convert(cs)) < 0) {
+		pw_log_warn("stream %p: can't convert sample %s: %s", s, cs->name,
+				spa_strerror(res));
+		sample_unref(cs);
+		pa_stream_set_state(s, PA_STREAM_FAILED);
+		return -pa_context_set_error(c, PA_ERR_INVALID);
+	}
+	free(cs->raw);
+	cs->raw = NULL;
+
+	if ((old = find_sample(c, cs->name)) != NULL) {
+		cs->index = old->index;
+		remove_sample(old);
+	} else {
+		cs->index = c->sample_index++;
+	}
+	spa_list_append(&c->samples, &cs->link);
+	s->stream_index = cs->index;
+
+	pw_log_debug("stream %p: sample %s: %u frames", s, cs->name, cs->n_frames);
+
+	pa_stream_set_state(s, PA_STREAM_TERMINATED);
+
+	return 0;
+}
+
+struct play_sample {
+	struct cache_player *player;
+	pa_context_success_cb_t success_cb;
+	pa_context_play_sample_cb_t play_cb;
+	int error;
+	void *userdata;
+};
+
+static void on_play_sample(pa_operation *o, void *userdata)
+{
+	struct play_sample *d = userdata;
+	pa_context *c = o->context;
+	uint32_t idx = PA_INVALID_INDEX;
+
+	if (d->error != 0)
+		pa_context_set_error(c, d->error);
+	else if (d->player)
+		idx = pw_stream_get_node_id(d->player->stream);
+
+	if (d->success_cb)
+		d->success_cb(c, d->error ? 0 : 1, d->userdata);
+	if (d->play_cb)
+		d->play_cb(c, idx, d->userdata);
+	pa_operation_done(o);
+}
+
+static int play_sample(pa_context *c, const char *name, const char *dev, pa_volume_t volume,
+		struct play_sample *d)
+{
+	struct cache_sample *cs;
+	struct cache_voice *v;
+	struct cache_player *p;
+	struct global *g;
+	uint32_t target = PW_ID_ANY;
+
+	if ((cs = find_sample(c, name)) == NULL)
+		return PA_ERR_NOENTITY;
+
+	if (dev != NULL) {
+		if ((g = pa_context_find_global_by_name(c, PA_SUBSCRIPTION_MASK_SINK, dev)) == NULL)
+			return PA_ERR_NOENTITY;
+		target = g->id;
+	}
+
+	if ((p = ensure_player(c, target)) == NULL)
+		return PA_ERR_INTERNAL;
+
+	if ((v = calloc(1, sizeof(struct cache_voice))) == NULL)
+		return PA_ERR_INTERNAL;
+
+	cs->refcount++;
+	v->sample = cs;
+	v->offset = 0;
+	v->volume = volume == PA_VOLUME_INVALID ? 1.0f : pa_sw_volume_to_linear(volume);
+	spa_list_append(&p->voices, &v->link);
+
+	p->idle = 0;
+	pw_stream_set_active(p->stream, true);
+	d->player = p;
+
+	pw_log_debug("context %p: play sample %s on %u volume %f", c, name,
+			target, v->volume);
+
 	return 0;
 }
 
 SPA_EXPORT
 pa_operation* pa_context_remove_sample(pa_context *c, const char *name, pa_context_success_cb_t cb, void *userdata)
 {
-	pw_log_warn("Not Implemented");
-	return NULL;
+	pa_operation *o;
+	struct play_sample *d;
+	struct cache_sample *cs;
+	int error = 0;
+
+	pa_assert(c);
+	pa_assert(c->refcount >= 1);
+
+	PA_CHECK_VALIDITY_RETURN_NULL(c, c->state == PA_CONTEXT_READY, PA_ERR_BADSTATE);
+	PA_CHECK_VALIDITY_RETURN_NULL(c, name && *name, PA_ERR_INVALID);
+
+	/* voices that are playing keep a ref on the sample */
+	if ((cs = find_sample(c, name)) == NULL)
+		error = PA_ERR_NOENTITY;
+	else
+		remove_sample(cs);
+
+	o = pa_operation_new(c, NULL, on_play_sample, sizeof(struct play_sample));
+	d = o->userdata;
+	d->success_cb = cb;
+	d->error = error;
+	d->userdata = userdata;
+	pa_operation_sync(o);
+
+	return o;
 }
 
 SPA_EXPORT
 pa_operation* pa_context_play_sample(pa_context *c, const char *name, const char *dev,
         pa_volume_t volume, pa_context_success_cb_t cb, void *userdata)
 {
-	pw_log_warn("Not Implemented");
-	return NULL;
+	pa_operation *o;
+	struct play_sample *d;
+
+	pa_assert(c);
+	pa_assert(c->refcount >= 1);
+
+	PA_CHECK_VALIDITY_RETURN_NULL(c, c->state == PA_CONTEXT_READY, PA_ERR_BADSTATE);
+	PA_CHECK_VALIDITY_RETURN_NULL(c, name && *name, PA_ERR_INVALID);
+	PA_CHECK_VALIDITY_RETURN_NULL(c, !dev || *dev, PA_ERR_INVALID);
+	PA_CHECK_VALIDITY_RETURN_NULL(c, volume == PA_VOLUME_INVALID ||
+			PA_VOLUME_IS_VALID(volume), PA_ERR_INVALID);
+
+	o = pa_operation_new(c, NULL, on_play_sample, sizeof(struct play_sample));
+	d = o->userdata;
+	d->success_cb = cb;
+	d->error = play_sample(c, name, dev, volume, d);
+	d->userdata = userdata;
+	pa_operation_sync(o);
+
+	return o;
 }
 
 SPA_EXPORT
@@ -57,6 +695,24 @@ pa_operation* pa_context_play_sample_with_proplist(pa_context *c, const char *na
         const char *dev, pa_volume_t volume, PA_CONST pa_proplist *proplist,
         pa_context_play_sample_cb_t cb, void *userdata)
 {
-	pw_log_warn("Not Implemented");
-	return NULL;
+	pa_operation *o;
+	struct play_sample *d;
+
+	pa_assert(c);
+	pa_assert(c->refcount >= 1);
+
+	PA_CHECK_VALIDITY_RETURN_NULL(c, c->state == PA_CONTEXT_READY, PA_ERR_BADSTATE);
+	PA_CHECK_VALIDITY_RETURN_NULL(c, name && *name, PA_ERR_INVALID);
+	PA_CHECK_VALIDITY_RETURN_NULL(c, !dev || *dev, PA_ERR_INVALID);
+	PA_CHECK_VALIDITY_RETURN_NULL(c, volume == PA_VOLUME_INVALID ||
+			PA_VOLUME_IS_VALID(volume), PA_ERR_INVALID);
+
+	o = pa_operation_new(c, NULL, on_play_sample, sizeof(struct play_sample));
+	d = o->userdata;
+	d->play_cb = cb;
+	d->error = play_sample(c, name, dev, volume, d);
+	d->userdata = userdata;
+	pa_operation_sync(o);
+
+	return o;
 }
@@ -278,17 +278,19 @@ static const struct spa_pod *get_buffers_param(pa_stream *s, pa_buffer_attr *att
 	if (attr->tlength == (uint32_t)-1 || attr->tlength == 0)
 		maxsize = 1024;
 	else
-		maxsize = (attr->tlength / stride);
+		maxsize = SPA_MAX(attr->tlength / stride, 1u);
 
 	if (attr->minreq == (uint32_t)-1 || attr->minreq == 0)
 		size = maxsize;
 	else
-		size = SPA_MIN(attr->minreq / stride, maxsize);
+		size = SPA_CLAMP(attr->minreq / stride, 1u, maxsize);
 
-	if (attr->maxlength == (uint32_t)-1)
-		buffers = 3;
-	else
-		buffers = SPA_CLAMP(attr->maxlength / (size * stride), 3u, MAX_BUFFERS);
+	/* we need enough buffers of minreq to hold tlength, plus one that
+	 * is being played, so that a write of the size returned by
+	 * pa_stream_writable_size() never has to be split over buffers
+	 * that are not available yet. maxlength is always set after
+	 * patch_buffer_attr() so it is not used here. */
+	buffers = SPA_CLAMP(maxsize / size + 1, 3u, MAX_BUFFERS);
 
 	pw_log_info("stream %p: stride %d maxsize %d size %u buffers %d", s, stride, maxsize,
 			size, buffers);
@@ -664,7 +666,8 @@ static void stream_unlink(pa_stream *s)
 	}
 
 	spa_list_remove(&s->link);
-	pw_stream_set_active(s->stream, false);
+	if (s->stream)
+		pw_stream_set_active(s->stream, false);
 
 	s->context = NULL;
 	pa_stream_unref(s);
@@ -681,6 +684,8 @@ static void stream_free(pa_stream *s)
 		pw_stream_destroy(s->stream);
 	}
 
+	pa_stream_upload_free(s);
+
 	if (s->proplist)
 		pa_proplist_free(s->proplist);
 
@@ -738,7 +743,10 @@ uint32_t pa_stream_get_index(PA_CONST pa_stream *s)
 	spa_assert(s);
 	spa_assert(s->refcount >= 1);
 
-	idx = pw_stream_get_node_id(s->stream);
+	if (s->stream == NULL)
+		idx = s->stream_index;
+	else
+		idx = pw_stream_get_node_id(s->stream);
 	pw_log_debug("stream %p: index %u", s, idx);
 	return idx;
 }
@@ -1050,7 +1058,8 @@ int pa_stream_disconnect(pa_stream *s)
 	pa_stream_ref(s);
 
 	s->disconnecting = true;
-	pw_stream_disconnect(s->stream);
+	if (s->stream)
+		pw_stream_disconnect(s->stream);
 
 	o = pa_operation_new(c, s, on_disconnected, 0);
 	pa_operation_sync(o);
@@ -1122,7 +1131,10 @@ int pa_stream_begin_write(
 	PA_CHECK_VALIDITY(s->context, data, PA_ERR_INVALID);
 	PA_CHECK_VALIDITY(s->context, nbytes && *nbytes != 0, PA_ERR_INVALID);
 
-	if ((res = peek_buffer(s)) < 0) {
+	if (s->direction == PA_STREAM_UPLOAD) {
+		res = pa_stream_upload_begin_write(s, data, nbytes);
+	}
+	else if ((res = peek_buffer(s)) < 0) {
 		*data = NULL;
 		*nbytes = 0;
 	}
@@ -1191,21 +1203,28 @@ int pa_stream_write_ext_free(pa_stream *s,
 	PA_CHECK_VALIDITY(s->context, nbytes % pa_frame_size(&s->sample_spec) == 0, PA_ERR_INVALID);
 	PA_CHECK_VALIDITY(s->context, !free_cb || !s->buffer, PA_ERR_INVALID);
 
+	if (s->direction == PA_STREAM_UPLOAD) {
+		int res = pa_stream_upload_write(s, data, nbytes);
+		if (free_cb)
+			free_cb(free_cb_data);
+		return res;
+	}
+
 	if (s->buffer == NULL) {
-		void *dst;
 		const void *src = data;
 		size_t towrite = nbytes, dsize;
 
+		/* the buffer memory is shared with the server so we can't
+		 * make it point to the client memory, copy into as many
+		 * buffers as needed, each with one memcpy */
 		while (towrite > 0) {
-			dsize = towrite;
-
-			if (pa_stream_begin_write(s, &dst, &dsize) < 0 ||
-			    dst == NULL || dsize == 0) {
+			if (peek_buffer(s) < 0 ||
+			    (dsize = SPA_MIN(towrite, s->buffer_size - s->buffer_offset)) == 0) {
 				pw_log_debug("stream %p: out of buffers, wanted %zd bytes", s, nbytes);
 				break;
 			}
 
-			memcpy(dst, src, dsize);
+			memcpy(SPA_MEMBER(s->buffer_data, s->buffer_offset, void), src, dsize);
 
 			s->buffer_offset += dsize;
 
@@ -50,6 +50,11 @@ extern "C" {
 									  *  used in snd_pcm_open() and
 									  *  snd_ctl_open(). */
 #define SPA_KEY_API_ALSA_CARD		"api.alsa.card"			/**< alsa card number */
+#define SPA_KEY_API_ALSA_CLOCK_NAME	"api.alsa.clock-name"		/**< name of the clock domain of the
+									  *  device. Devices with the same
+									  *  clock name are not rate matched
+									  *  against each other. Defaults to
+									  *  one domain per card */
 
 /** info from alsa card_info */
 #define SPA_KEY_API_ALSA_CARD_ID	"api.alsa.card.id"		/**< id from card_info */
@@ -204,6 +204,8 @@ static int impl_node_set_param(void *object, uint32_t id, uint32_t flags,
 	if (id == SPA_PARAM_Props) {
 		struct props *p = &this->props;
 
+		this->caps.valid = false;
+
 		if (param == NULL) {
 			reset_props(p);
 			return 0;
@@ -751,6 +753,8 @@ impl_init(const struct spa_handle_factory *factory,
 	for (i = 0; info && i < info->n_items; i++) {
 		if (!strcmp(info->items[i].key, SPA_KEY_API_ALSA_PATH)) {
 			snprintf(this->props.device, 63, "%s", info->items[i].value);
+		} else if (!strcmp(info->items[i].key, SPA_KEY_API_ALSA_CLOCK_NAME)) {
+			snprintf(this->props.clock_name, 63, "%s", info->items[i].value);
 		}
 	}
 
@@ -783,7 +787,7 @@ impl_enum_interface_info(const struct spa_handle_factory *factory,
 static const struct spa_dict_item info_items[] = {
 	{ SPA_KEY_FACTORY_AUTHOR, "Wim Taymans <wim.taymans@gmail.com>" },
 	{ SPA_KEY_FACTORY_DESCRIPTION, "Play audio with the alsa API" },
-	{ SPA_KEY_FACTORY_USAGE, "["SPA_KEY_API_ALSA_PATH"=<path>]" },
+	{ SPA_KEY_FACTORY_USAGE, "["SPA_KEY_API_ALSA_PATH"=<path>] ["SPA_KEY_API_ALSA_CLOCK_NAME"=<name>]" },
 };
 
 static const struct spa_dict info = SPA_DICT_INIT_ARRAY(info_items);
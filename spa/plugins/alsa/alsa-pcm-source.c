@@ -204,6 +204,8 @@ static int impl_node_set_param(void *object, uint32_t id, uint32_t flags,
 	{
 		struct props *p = &this->props;
 
+		this->caps.valid = false;
+
 		if (param == NULL) {
 			reset_props(p);
 			return 0;
@@ -442,7 +444,12 @@ impl_node_port_enum_params(void *object, int seq,
 
 static int clear_buffers(struct state *this)
 {
+	uint32_t i;
+
 	if (this->n_buffers > 0) {
+		/* don't leave pointers into the mmap area behind */
+		for (i = 0; i < this->n_buffers; i++)
+			this->buffers[i].buf->datas[0].data = this->buffers[i].data;
 		spa_list_init(&this->free);
 		spa_list_init(&this->ready);
 		this->n_buffers = 0;
@@ -563,6 +570,7 @@ impl_node_port_use_buffers(void *object,
 			spa_log_error(this->log, NAME " %p: need mapped memory", this);
 			return -EINVAL;
 		}
+		b->data = d[0].data;
 		spa_list_append(&this->free, &b->link);
 	}
 	this->n_buffers = n_buffers;
@@ -770,6 +778,8 @@ impl_init(const struct spa_handle_factory *factory,
 	for (i = 0; info && i < info->n_items; i++) {
 		if (!strcmp(info->items[i].key, SPA_KEY_API_ALSA_PATH)) {
 			snprintf(this->props.device, 63, "%s", info->items[i].value);
+		} else if (!strcmp(info->items[i].key, SPA_KEY_API_ALSA_CLOCK_NAME)) {
+			snprintf(this->props.clock_name, 63, "%s", info->items[i].value);
 		}
 	}
 	return 0;
@@ -799,7 +809,7 @@ impl_enum_interface_info(const struct spa_handle_factory *factory,
 static const struct spa_dict_item info_items[] = {
 	{ SPA_KEY_FACTORY_AUTHOR, "Wim Taymans <wim.taymans@gmail.com>" },
 	{ SPA_KEY_FACTORY_DESCRIPTION, "Record audio with the alsa API" },
-	{ SPA_KEY_FACTORY_USAGE, "["SPA_KEY_API_ALSA_PATH"=<device>]" },
+	{ SPA_KEY_FACTORY_USAGE, "["SPA_KEY_API_ALSA_PATH"=<device>] ["SPA_KEY_API_ALSA_CLOCK_NAME"=<name>]" },
 };
 
 static const struct spa_dict info = SPA_DICT_INIT_ARRAY(info_items);
@@ -49,9 +49,15 @@ static int spa_alsa_open(struct state *state)
 	/* we would love to use the sync_id but it always returns 0, so use the
 	 * card id for now */
 	state->card = snd_pcm_info_get_card(pcminfo);
+	if (props->clock_name[0])
+		snprintf(state->clock_name, sizeof(state->clock_name),
+				"%s", props->clock_name);
+	else
+		snprintf(state->clock_name, sizeof(state->clock_name),
+				"api.alsa.%d", state->card);
 	if (state->clock) {
 		snprintf(state->clock->name, sizeof(state->clock->name),
-				"api.alsa.%d", state->card);
+				"%s", state->clock_name);
 	}
 	state->opened = true;
 	state->sample_count = 0;
@@ -238,10 +244,9 @@ static void sanitize_map(snd_pcm_chmap_t* map)
 
 }
 
-int
-spa_alsa_enum_format(struct state *state, int seq, uint32_t start, uint32_t num,
-		     const struct spa_pod *filter)
+static int probe_caps(struct state *state)
 {
+	struct caps *caps = &state->caps;
 	snd_pcm_t *hndl;
 	snd_pcm_hw_params_t *params;
 	snd_pcm_format_mask_t *fmask;
@@ -249,20 +254,95 @@ spa_alsa_enum_format(struct state *state, int seq, uint32_t start, uint32_t num,
 	snd_pcm_chmap_query_t **maps;
 	size_t i, j;
 	int err, dir;
-	unsigned int min, max;
+	bool opened;
+
+	opened = state->opened;
+	if ((err = spa_alsa_open(state)) < 0)
+		return err;
+
+	hndl = state->hndl;
+	snd_pcm_hw_params_alloca(&params);
+	if ((err = snd_pcm_hw_params_any(hndl, params)) < 0) {
+		spa_log_error(state->log, "Broken configuration: no configurations available: %s",
+				snd_strerror(err));
+		goto done;
+	}
+
+	snd_pcm_format_mask_alloca(&fmask);
+	snd_pcm_hw_params_get_format_mask(params, fmask);
+
+	snd_pcm_access_mask_alloca(&amask);
+	snd_pcm_hw_params_get_access_mask(params, amask);
+
+	caps->n_formats = 0;
+	for (i = 1; i < SPA_N_ELEMENTS(format_info) && caps->n_formats + 2 <= MAX_FORMATS; i++) {
+		const struct format_info *fi = &format_info[i];
+
+		if (!snd_pcm_format_mask_test(fmask, fi->format))
+			continue;
+
+		if (snd_pcm_access_mask_test(amask, SND_PCM_ACCESS_MMAP_INTERLEAVED))
+			caps->formats[caps->n_formats++] = fi->spa_format;
+		if (snd_pcm_access_mask_test(amask, SND_PCM_ACCESS_MMAP_NONINTERLEAVED) &&
+		    fi->spa_pformat != SPA_AUDIO_FORMAT_UNKNOWN)
+			caps->formats[caps->n_formats++] = fi->spa_pformat;
+	}
+
+	if ((err = snd_pcm_hw_params_get_rate_min(params, &caps->rate_min, &dir)) < 0 ||
+	    (err = snd_pcm_hw_params_get_rate_max(params, &caps->rate_max, &dir)) < 0 ||
+	    (err = snd_pcm_hw_params_get_channels_min(params, &caps->channels_min)) < 0 ||
+	    (err = snd_pcm_hw_params_get_channels_max(params, &caps->channels_max)) < 0) {
+		spa_log_error(state->log, NAME" %p: can't get rate and channels: %s",
+				state, snd_strerror(err));
+		goto done;
+	}
+
+	caps->n_chmaps = 0;
+	if ((maps = snd_pcm_query_chmaps(hndl)) != NULL) {
+		for (i = 0; maps[i] != NULL && i < MAX_CHMAPS; i++) {
+			snd_pcm_chmap_t *map = &maps[i]->map;
+
+			sanitize_map(map);
+			caps->chmaps[i].channels = SPA_MIN(map->channels, SPA_AUDIO_MAX_CHANNELS);
+			for (j = 0; j < caps->chmaps[i].channels; j++)
+				caps->chmaps[i].pos[j] = chmap_position_to_channel(map->pos[j]);
+		}
+		caps->n_chmaps = i;
+		if (maps[i] != NULL)
+			spa_log_warn(state->log, NAME" %p: more than %d channel maps, "
+					"ignoring the others", state, MAX_CHMAPS);
+		snd_pcm_free_chmaps(maps);
+	}
+
+	spa_log_debug(state->log, NAME" %p: probed %u formats, rate %u-%u, channels %u-%u, %u maps",
+			state, caps->n_formats, caps->rate_min, caps->rate_max,
+			caps->channels_min, caps->channels_max, caps->n_chmaps);
+
+	caps->valid = true;
+	err = 0;
+done:
+	if (!opened)
+		spa_alsa_close(state);
+	return err;
+}
+
+int
+spa_alsa_enum_format(struct state *state, int seq, uint32_t start, uint32_t num,
+		     const struct spa_pod *filter)
+{
+	struct caps *caps = &state->caps;
+	uint32_t i;
 	uint8_t buffer[4096];
 	struct spa_pod_builder b = { 0 };
 	struct spa_pod_choice *choice;
 	struct spa_pod *fmt;
 	int res;
-	bool opened;
 	struct spa_pod_frame f[2];
 	struct spa_result_node_params result;
 	uint32_t count = 0, rate;
 
-	opened = state->opened;
-	if ((err = spa_alsa_open(state)) < 0)
-		return err;
+	if (!caps->valid && (res = probe_caps(state)) < 0)
+		return res;
 
 	result.id = SPA_PARAM_EnumFormat;
 	result.next = start;
@@ -270,11 +350,10 @@ spa_alsa_enum_format(struct state *state, int seq, uint32_t start, uint32_t num,
       next:
 	result.index = result.next++;
 
-	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	if (caps->n_chmaps > 0 ? result.index >= caps->n_chmaps : result.index > 0)
+		return 0;
 
-	hndl = state->hndl;
-	snd_pcm_hw_params_alloca(&params);
-	CHECK(snd_pcm_hw_params_any(hndl, params), "Broken configuration: no configurations available");
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
 
 	spa_pod_builder_push_object(&b, &f[0], SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat);
 	spa_pod_builder_add(&b,
@@ -282,41 +361,19 @@ spa_alsa_enum_format(struct state *state, int seq, uint32_t start, uint32_t num,
 			SPA_FORMAT_mediaSubtype, SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
 			0);
 
-	snd_pcm_format_mask_alloca(&fmask);
-	snd_pcm_hw_params_get_format_mask(params, fmask);
-
-	snd_pcm_access_mask_alloca(&amask);
-	snd_pcm_hw_params_get_access_mask(params, amask);
-
 	spa_pod_builder_prop(&b, SPA_FORMAT_AUDIO_format, 0);
 
 	spa_pod_builder_push_choice(&b, &f[1], SPA_CHOICE_None, 0);
 	choice = (struct spa_pod_choice*)spa_pod_builder_frame(&b, &f[1]);
-
-	for (i = 1, j = 0; i < SPA_N_ELEMENTS(format_info); i++) {
-		const struct format_info *fi = &format_info[i];
-
-		if (snd_pcm_format_mask_test(fmask, fi->format)) {
-			if (snd_pcm_access_mask_test(amask, SND_PCM_ACCESS_MMAP_INTERLEAVED)) {
-				if (j++ == 0)
-					spa_pod_builder_id(&b, fi->spa_format);
-				spa_pod_builder_id(&b, fi->spa_format);
-			}
-			if (snd_pcm_access_mask_test(amask, SND_PCM_ACCESS_MMAP_NONINTERLEAVED) &&
-					fi->spa_pformat != SPA_AUDIO_FORMAT_UNKNOWN) {
-				if (j++ == 0)
-					spa_pod_builder_id(&b, fi->spa_pformat);
-				spa_pod_builder_id(&b, fi->spa_pformat);
-			}
-		}
+	for (i = 0; i < caps->n_formats; i++) {
+		if (i == 0)
+			spa_pod_builder_id(&b, caps->formats[i]);
+		spa_pod_builder_id(&b, caps->formats[i]);
 	}
-	if (j > 1)
+	if (caps->n_formats > 1)
 		choice->body.type = SPA_CHOICE_Enum;
 	spa_pod_builder_pop(&b, &f[1]);
 
-	CHECK(snd_pcm_hw_params_get_rate_min(params, &min, &dir), "get_rate_min");
-	CHECK(snd_pcm_hw_params_get_rate_max(params, &max, &dir), "get_rate_max");
-
 	spa_pod_builder_prop(&b, SPA_FORMAT_AUDIO_rate, 0);
 
 	spa_pod_builder_push_choice(&b, &f[1], SPA_CHOICE_None, 0);
@@ -324,54 +381,39 @@ spa_alsa_enum_format(struct state *state, int seq, uint32_t start, uint32_t num,
 
 	rate = state->position ? state->position->clock.rate.denom : DEFAULT_RATE;
 
-	spa_pod_builder_int(&b, SPA_CLAMP(rate, min, max));
-	if (min != max) {
-		spa_pod_builder_int(&b, min);
-		spa_pod_builder_int(&b, max);
+	spa_pod_builder_int(&b, SPA_CLAMP(rate, caps->rate_min, caps->rate_max));
+	if (caps->rate_min != caps->rate_max) {
+		spa_pod_builder_int(&b, caps->rate_min);
+		spa_pod_builder_int(&b, caps->rate_max);
 		choice->body.type = SPA_CHOICE_Range;
 	}
 	spa_pod_builder_pop(&b, &f[1]);
 
-	CHECK(snd_pcm_hw_params_get_channels_min(params, &min), "get_channels_min");
-	CHECK(snd_pcm_hw_params_get_channels_max(params, &max), "get_channels_max");
-
 	spa_pod_builder_prop(&b, SPA_FORMAT_AUDIO_channels, 0);
 
-	if ((maps = snd_pcm_query_chmaps(hndl)) != NULL) {
-		uint32_t channel;
-		snd_pcm_chmap_t* map;
+	if (caps->n_chmaps > 0) {
+		uint32_t channels = caps->chmaps[result.index].channels;
+		const uint32_t *pos = caps->chmaps[result.index].pos;
 
-		if (maps[result.index] == NULL) {
-			snd_pcm_free_chmaps(maps);
-			goto enum_end;
-		}
-		map = &maps[result.index]->map;
-
-		spa_log_debug(state->log, "map %d channels", map->channels);
-		sanitize_map(map);
-		spa_pod_builder_int(&b, map->channels);
+		spa_log_debug(state->log, "map %d channels", channels);
+		spa_pod_builder_int(&b, channels);
 
 		spa_pod_builder_prop(&b, SPA_FORMAT_AUDIO_position, 0);
 		spa_pod_builder_push_array(&b, &f[1]);
-		for (j = 0; j < map->channels; j++) {
-			spa_log_debug(state->log, NAME" %p: position %zd %d", state, j, map->pos[j]);
-			channel = chmap_position_to_channel(map->pos[j]);
-			spa_pod_builder_id(&b, channel);
+		for (i = 0; i < channels; i++) {
+			spa_log_debug(state->log, NAME" %p: position %d %d", state, i, pos[i]);
+			spa_pod_builder_id(&b, pos[i]);
 		}
 		spa_pod_builder_pop(&b, &f[1]);
-
-		snd_pcm_free_chmaps(maps);
 	}
 	else {
-		if (result.index > 0)
-			goto enum_end;
-
 		spa_pod_builder_push_choice(&b, &f[1], SPA_CHOICE_None, 0);
 		choice = (struct spa_pod_choice*)spa_pod_builder_frame(&b, &f[1]);
-		spa_pod_builder_int(&b, SPA_CLAMP(DEFAULT_CHANNELS, min, max));
-		if (min != max) {
-			spa_pod_builder_int(&b, min);
-			spa_pod_builder_int(&b, max);
+		spa_pod_builder_int(&b, SPA_CLAMP(DEFAULT_CHANNELS,
+					caps->channels_min, caps->channels_max));
+		if (caps->channels_min != caps->channels_max) {
+			spa_pod_builder_int(&b, caps->channels_min);
+			spa_pod_builder_int(&b, caps->channels_max);
 			choice->body.type = SPA_CHOICE_Range;
 		}
 		spa_pod_builder_pop(&b, &f[1]);
@@ -387,11 +429,7 @@ spa_alsa_enum_format(struct state *state, int seq, uint32_t start, uint32_t num,
 	if (++count != num)
 		goto next;
 
-      enum_end:
-	res = 0;
-	if (!opened)
-		spa_alsa_close(state);
-	return res;
+	return 0;
 }
 
 int spa_alsa_set_format(struct state *state, struct spa_audio_info *fmt, uint32_t flags)
@@ -493,6 +531,13 @@ static int set_swparams(struct state *state)
 
 	CHECK(snd_pcm_sw_params_set_tstamp_mode(hndl, params, SND_PCM_TSTAMP_ENABLE), "sw_params_set_tstamp_mode");
 
+	/* the hw timestamps are compared against our CLOCK_MONOTONIC timer */
+	if ((err = snd_pcm_sw_params_set_tstamp_type(hndl, params, SND_PCM_TSTAMP_TYPE_MONOTONIC)) < 0) {
+		spa_log_info(state->log, NAME" %p: no monotonic timestamps, not using them: %s",
+				state, snd_strerror(err));
+		state->htimestamp = false;
+	}
+
 #if 0
 	snd_pcm_uframes_t boundary;
 	CHECK(snd_pcm_sw_params_get_boundary(params, &boundary), "get_boundary");
@@ -528,6 +573,9 @@ static void init_loop(struct state *state)
 {
 	state->bw = 0.0;
 	state->z1 = state->z2 = state->z3 = 0.0;
+	state->corr_sum = 0.0;
+	state->corr_count = 0;
+	state->drift_periods = 0;
 }
 
 static void set_loop(struct state *state, double bw)
@@ -603,12 +651,49 @@ static int alsa_recover(struct state *state, int err)
 	return 0;
 }
 
-static int get_status(struct state *state, snd_pcm_uframes_t *delay, snd_pcm_uframes_t *target)
+/* Get avail together with the time the hw pointer was sampled and move it to
+ * the reference time @nsec of the DLL, so that wakeup jitter does not end up
+ * in the clock estimation. */
+static snd_pcm_sframes_t get_avail(struct state *state, uint64_t nsec)
+{
+	snd_pcm_uframes_t avail;
+	snd_htimestamp_t tstamp;
+	int64_t diff;
+	int res;
+
+	if (!state->htimestamp)
+		return snd_pcm_avail(state->hndl);
+
+	if (SPA_UNLIKELY((res = snd_pcm_htimestamp(state->hndl, &avail, &tstamp)) < 0)) {
+		spa_log_warn(state->log, NAME" %p: snd_pcm_htimestamp error: %s, not using timestamps",
+				state, snd_strerror(res));
+		state->htimestamp = false;
+		return snd_pcm_avail(state->hndl);
+	}
+	/* htimestamp does not report xruns */
+	if (SPA_UNLIKELY(snd_pcm_state(state->hndl) == SND_PCM_STATE_XRUN))
+		return -EPIPE;
+
+	diff = (int64_t)(nsec - SPA_TIMESPEC_TO_NSEC(&tstamp));
+
+	/* no timestamp or too far away to be useful */
+	if (tstamp.tv_sec == 0 ||
+	    llabs(diff) > (int64_t)(state->buffer_frames * SPA_NSEC_PER_SEC / state->rate))
+		return avail;
+
+	state->jitter += (llabs(diff) - state->jitter) * 0.01;
+
+	/* avail grows with time, both for playback and capture */
+	return (snd_pcm_sframes_t)avail + diff * state->rate / (int64_t)SPA_NSEC_PER_SEC;
+}
+
+static int get_status(struct state *state, uint64_t nsec,
+		snd_pcm_uframes_t *delay, snd_pcm_uframes_t *target)
 {
 	snd_pcm_sframes_t avail;
 	int res;
 
-	if (SPA_UNLIKELY((avail = snd_pcm_avail(state->hndl)) < 0)) {
+	if (SPA_UNLIKELY((avail = get_avail(state, nsec)) < 0)) {
 		if ((res = alsa_recover(state, avail)) < 0)
 			return res;
 		if ((avail = snd_pcm_avail(state->hndl)) < 0) {
@@ -651,7 +736,8 @@ static int get_status(struct state *state, snd_pcm_uframes_t *delay, snd_pcm_ufr
 static int update_time(struct state *state, uint64_t nsec, snd_pcm_sframes_t delay,
 		snd_pcm_sframes_t target, bool follower)
 {
-	double err, corr;
+	double err, corr, drift;
+	bool settled;
 
 	if (state->stream == SND_PCM_STREAM_PLAYBACK)
 		err = delay - target;
@@ -677,16 +763,39 @@ static int update_time(struct state *state, uint64_t nsec, snd_pcm_sframes_t del
 		state->last_threshold = state->threshold;
 	}
 
+	state->corr_sum += corr;
+	state->corr_count++;
+
 	if (SPA_UNLIKELY((state->next_time - state->base_time) > BW_PERIOD)) {
+		/* the average over the period, a single correction is too noisy
+		 * to tell if the clocks drift apart */
+		drift = state->corr_sum / state->corr_count - 1.0;
+		state->corr_sum = 0.0;
+		state->corr_count = 0;
+
+		settled = state->bw == BW_MIN;
 		state->base_time = state->next_time;
 		if (state->bw == BW_MAX)
 			set_loop(state, BW_MED);
 		else if (state->bw == BW_MED)
 			set_loop(state, BW_MIN);
 
-		spa_log_debug(state->log, NAME" %p: follower:%d match:%d rate:%f bw:%f del:%d target:%ld err:%f (%f %f %f)",
-				state, follower, state->matching, corr, state->bw, state->delay, target,
-				err, state->z1, state->z2, state->z3);
+		spa_log_debug(state->log, NAME" %p: follower:%d match:%d rate:%f drift:%fppm bw:%f del:%d target:%ld err:%f (%f %f %f) "
+				"tstamp:%d jitter:%fus",
+				state, follower, state->matching, corr, drift * 1e6, state->bw, state->delay, target,
+				err, state->z1, state->z2, state->z3,
+				state->htimestamp, state->jitter / 1000.0);
+
+		if (follower && !state->matching && settled) {
+			if (fabs(drift) <= MAX_LOCK_DRIFT)
+				state->drift_periods = 0;
+			else if (++state->drift_periods >= LOCK_DRIFT_PERIODS) {
+				spa_log_warn(state->log, NAME" %p: clock %s is not locked to %s (drift:%fppm), "
+						"enable rate matching", state, state->clock_name,
+						state->position->clock.name, drift * 1e6);
+				state->matching = true;
+			}
+		}
 	}
 
 	if (state->rate_match) {
@@ -732,7 +841,8 @@ int spa_alsa_write(struct state *state, snd_pcm_uframes_t silence)
 		uint64_t nsec;
 		snd_pcm_uframes_t delay, target;
 
-		if (SPA_UNLIKELY((res = get_status(state, &delay, &target)) < 0))
+		nsec = state->position->clock.nsec;
+		if (SPA_UNLIKELY((res = get_status(state, nsec, &delay, &target)) < 0))
 			return res;
 
 		if (SPA_UNLIKELY(!state->alsa_recovering && delay > target + state->threshold)) {
@@ -751,7 +861,6 @@ int spa_alsa_write(struct state *state, snd_pcm_uframes_t silence)
 			state->alsa_sync = false;
 		}
 
-		nsec = state->position->clock.nsec;
 		if (SPA_UNLIKELY((res = update_time(state, nsec, delay, target, true)) < 0))
 			return res;
 	}
@@ -903,15 +1012,32 @@ push_frames(struct state *state,
 		total_frames = SPA_MIN(avail, frames);
 		n_bytes = total_frames * state->frame_size;
 
+		d[0].data = b->data;
+
 		if (my_areas) {
 			left = state->buffer_frames - offset;
 			l0 = SPA_MIN(n_bytes, left * state->frame_size);
 			l1 = n_bytes - l0;
 
 			src = SPA_MEMBER(my_areas[0].addr, offset * state->frame_size, uint8_t);
-			spa_memcpy(d[0].data, src, l0);
-			if (l1 > 0)
-				spa_memcpy(SPA_MEMBER(d[0].data, l0, void), my_areas[0].addr, l1);
+
+			/* When the consumer accepts a new data pointer and the
+			 * window does not wrap, point the buffer into the mmap
+			 * area. The window is committed right away, so the ring
+			 * must hold the windows of all buffers that can be out
+			 * at the same time, plus the hardware write ahead of
+			 * one cycle, before the hardware comes around to this
+			 * window again. */
+			if (l1 == 0 &&
+			    SPA_FLAG_IS_SET(d[0].flags, SPA_DATA_FLAG_DYNAMIC) &&
+			    state->buffer_frames >= (state->n_buffers + 1) * total_frames +
+					state->threshold) {
+				d[0].data = src;
+			} else {
+				spa_memcpy(d[0].data, src, l0);
+				if (l1 > 0)
+					spa_memcpy(SPA_MEMBER(d[0].data, l0, void), my_areas[0].addr, l1);
+			}
 		} else {
 			memset(d[0].data, 0, n_bytes);
 		}
@@ -958,7 +1084,8 @@ int spa_alsa_read(struct state *state, snd_pcm_uframes_t silence)
 		snd_pcm_uframes_t delay, target;
 		uint32_t threshold = state->threshold;
 
-		if ((res = get_status(state, &delay, &target)) < 0)
+		nsec = state->position->clock.nsec;
+		if ((res = get_status(state, nsec, &delay, &target)) < 0)
 			return res;
 
 		if (!state->alsa_recovering && (delay < target || delay > target * 2)) {
@@ -979,7 +1106,6 @@ int spa_alsa_read(struct state *state, snd_pcm_uframes_t silence)
 			state->alsa_sync = false;
 		}
 
-		nsec = state->position->clock.nsec;
 		if ((res = update_time(state, nsec, delay, target, true)) < 0)
 			return res;
 	}
@@ -1100,7 +1226,7 @@ static void alsa_on_timeout_event(struct spa_source *source)
 		state->threshold = (state->duration * state->rate + state->rate_denom-1) / state->rate_denom;
 	}
 
-	if (SPA_UNLIKELY((res = get_status(state, &delay, &target)) < 0))
+	if (SPA_UNLIKELY((res = get_status(state, state->next_time, &delay, &target)) < 0))
 		return;
 
 	state->current_time = state->next_time;
@@ -1174,11 +1300,11 @@ int spa_alsa_start(struct state *state)
 	state->matching = state->following;
 
 	if (state->position) {
-		int card;
-		if (sscanf(state->position->clock.name, "api.alsa.%d", &card) == 1 &&
-		    card == state->card) {
+		/* no rate matching against a driver in the same clock domain,
+		 * update_time() checks that the rates stay locked */
+		if (strncmp(state->position->clock.name, state->clock_name,
+					sizeof(state->position->clock.name)) == 0)
 			state->matching = false;
-		}
 		state->duration = state->position->clock.duration;
 		state->rate_denom = state->position->clock.rate.denom;
 	}
@@ -1193,6 +1319,8 @@ int spa_alsa_start(struct state *state)
 
 	init_loop(state);
 	state->safety = 0.0;
+	state->htimestamp = true;
+	state->jitter = 0.0;
 
 	spa_log_debug(state->log, NAME" %p: start %d duration:%d rate:%d follower:%d match:%d",
 			state, state->threshold, state->duration, state->rate_denom,
@@ -55,18 +55,38 @@ struct props {
 	char device[64];
 	char device_name[128];
 	char card_name[128];
+	char clock_name[64];
 	uint32_t min_latency;
 	uint32_t max_latency;
 };
 
 #define MAX_BUFFERS 32
 
+#define MAX_FORMATS	64
+#define MAX_CHMAPS	16
+
+/* what the device can do, probed once so that EnumFormat doesn't need to
+ * open the device every time */
+struct caps {
+	bool valid;
+	uint32_t n_formats;
+	uint32_t formats[MAX_FORMATS];
+	unsigned int rate_min, rate_max;
+	unsigned int channels_min, channels_max;
+	uint32_t n_chmaps;
+	struct {
+		uint32_t channels;
+		uint32_t pos[SPA_AUDIO_MAX_CHANNELS];
+	} chmaps[MAX_CHMAPS];
+};
+
 struct buffer {
 	uint32_t id;
 #define BUFFER_FLAG_OUT	(1<<0)
 	uint32_t flags;
 	struct spa_buffer *buf;
 	struct spa_meta_header *h;
+	void *data;			/* data pointer of the allocator */
 	struct spa_list link;
 };
 
@@ -74,6 +94,10 @@ struct buffer {
 #define BW_MED		0.064
 #define BW_MIN		0.016
 #define BW_PERIOD	(3 * SPA_NSEC_PER_SEC)
+#define MAX_LOCK_DRIFT	0.00002		/* max average rate difference over a BW_PERIOD
+					 * in the same clock domain */
+#define LOCK_DRIFT_PERIODS	2	/* BW_PERIODs in a row with more drift before
+					 * the clocks are not locked */
 
 struct state {
 	struct spa_handle handle;
@@ -97,6 +121,9 @@ struct state {
 	bool opened;
 	snd_pcm_t *hndl;
 	int card;
+	char clock_name[64];
+
+	struct caps caps;
 
 	bool have_format;
 	struct spa_audio_info current_format;
@@ -141,6 +168,7 @@ struct state {
 	unsigned int alsa_recovering:1;
 	unsigned int following:1;
 	unsigned int matching:1;
+	unsigned int htimestamp:1;
 
 	int64_t sample_count;
 
@@ -151,10 +179,15 @@ struct state {
 
 	uint64_t underrun;
 	double safety;
+	double jitter;		/* average distance between wakeup and hw timestamp */
 
 	double bw;
 	double z1, z2, z3;
 	double w0, w1, w2;
+
+	double corr_sum;	/* sum of the rate corrections in this BW_PERIOD */
+	uint32_t corr_count;
+	uint32_t drift_periods;	/* BW_PERIODs in a row past MAX_LOCK_DRIFT */
 };
 
 int
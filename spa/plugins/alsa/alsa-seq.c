@@ -476,6 +476,18 @@ static int process_recycle(struct seq_state *state)
 	return 0;
 }
 
+/* convert between queue time and graph samples, with the rate of the graph
+ * clock as measured by the DLL in update_time() */
+static inline uint64_t queue_nsec_to_samples(struct seq_state *state, uint64_t nsec)
+{
+	return (nsec * state->rate.denom) / (state->rate.num * SPA_NSEC_PER_SEC * state->corr);
+}
+
+static inline uint64_t samples_to_queue_nsec(struct seq_state *state, uint64_t samples)
+{
+	return (samples * state->rate.num * SPA_NSEC_PER_SEC * state->corr) / state->rate.denom;
+}
+
 static int process_read(struct seq_state *state)
 {
 	snd_seq_event_t *ev;
@@ -529,7 +541,7 @@ static int process_read(struct seq_state *state)
 			diff = 0;
 
 		/* convert the age to samples and convert to an offset */
-		offset = (diff * state->rate.denom) / (state->rate.num * SPA_NSEC_PER_SEC);
+		offset = queue_nsec_to_samples(state, diff);
 		if (state->duration > offset)
 			offset = state->duration - offset;
 		else
@@ -651,8 +663,12 @@ static int process_write(struct seq_state *state)
 			snd_seq_ev_set_source(&ev, state->event.addr.port);
 			snd_seq_ev_set_dest(&ev, port->addr.client, port->addr.port);
 
+			/* queue_time is the start of this cycle. Schedule one
+			 * quantum later so that no offset is in the past by the
+			 * time the event reaches the queue, which would make it
+			 * play immediately and lose its position. */
 			out_time = state->queue_time +
-				(c->offset * state->rate.num * SPA_NSEC_PER_SEC) / state->rate.denom;
+				samples_to_queue_nsec(state, state->duration + c->offset);
 
 			out_rt.tv_nsec = out_time % SPA_NSEC_PER_SEC;
 			out_rt.tv_sec = out_time / SPA_NSEC_PER_SEC;
@@ -675,6 +691,7 @@ static int process_write(struct seq_state *state)
 static void init_loop(struct seq_state *state)
 {
 	state->bw = 0.0;
+	state->corr = 1.0;
 	state->z1 = state->z2 = state->z3 = 0.0;
 }
 
@@ -733,6 +750,7 @@ static int update_time(struct seq_state *state, uint64_t nsec, bool follower)
 	state->z3 += state->w2 * state->z2;
 
 	corr = 1.0 - (state->z2 + state->z3);
+	state->corr = corr;
 
 	if ((state->next_time - state->base_time) > BW_PERIOD) {
 		state->base_time = state->next_time;
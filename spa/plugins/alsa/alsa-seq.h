@@ -156,6 +156,7 @@ struct seq_state {
 	struct seq_stream streams[2];
 
 	double bw;
+	double corr;		/* graph clock rate relative to the queue */
 	double z1, z2, z3;
 	double w0, w1, w2;
 };
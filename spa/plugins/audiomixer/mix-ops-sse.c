@@ -32,6 +32,57 @@
 
 #include <xmmintrin.h>
 
+static inline void mix_4(float * dst,
+		const float * SPA_RESTRICT src0,
+		const float * SPA_RESTRICT src1,
+		const float * SPA_RESTRICT src2,
+		uint32_t n_samples)
+{
+	uint32_t n, unrolled;
+
+	if (SPA_LIKELY(SPA_IS_ALIGNED(src0, 16) &&
+	    SPA_IS_ALIGNED(src1, 16) &&
+	    SPA_IS_ALIGNED(src2, 16) &&
+	    SPA_IS_ALIGNED(dst, 16)))
+		unrolled = n_samples & ~7;
+	else
+		unrolled = 0;
+
+	for (n = 0; n < unrolled; n += 8) {
+		__m128 in1[4], in2[4];
+
+		in1[0] = _mm_load_ps(&dst[n + 0]);
+		in2[0] = _mm_load_ps(&dst[n + 4]);
+		in1[1] = _mm_load_ps(&src0[n + 0]);
+		in2[1] = _mm_load_ps(&src0[n + 4]);
+		in1[2] = _mm_load_ps(&src1[n + 0]);
+		in2[2] = _mm_load_ps(&src1[n + 4]);
+		in1[3] = _mm_load_ps(&src2[n + 0]);
+		in2[3] = _mm_load_ps(&src2[n + 4]);
+
+		in1[0] = _mm_add_ps(in1[0], in1[1]);
+		in2[0] = _mm_add_ps(in2[0], in2[1]);
+		in1[2] = _mm_add_ps(in1[2], in1[3]);
+		in2[2] = _mm_add_ps(in2[2], in2[3]);
+		in1[0] = _mm_add_ps(in1[0], in1[2]);
+		in2[0] = _mm_add_ps(in2[0], in2[2]);
+
+		_mm_store_ps(&dst[n + 0], in1[0]);
+		_mm_store_ps(&dst[n + 4], in2[0]);
+	}
+	for (; n < n_samples; n++) {
+		__m128 in[4];
+		in[0] = _mm_load_ss(&dst[n]),
+		in[1] = _mm_load_ss(&src0[n]),
+		in[2] = _mm_load_ss(&src1[n]),
+		in[3] = _mm_load_ss(&src2[n]),
+		in[0] = _mm_add_ss(in[0], in[1]);
+		in[2] = _mm_add_ss(in[2], in[3]);
+		in[0] = _mm_add_ss(in[0], in[2]);
+		_mm_store_ss(&dst[n], in[0]);
+	}
+}
+
 static inline void mix_2(float * dst, const float * SPA_RESTRICT src, uint32_t n_samples)
 {
 	uint32_t n, unrolled;
@@ -83,7 +134,8 @@ mix_f32_sse(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTR
 	else if (dst != src[0])
 		memcpy(dst, src[0], n_samples * sizeof(float));
 
-	for (i = 1; i < n_src; i++) {
+	for (i = 1; i + 2 < n_src; i += 3)
+		mix_4(dst, src[i], src[i + 1], src[i + 2], n_samples);
+	for (; i < n_src; i++)
 		mix_2(dst, src[i], n_samples);
-	}
 }
@@ -0,0 +1,238 @@
+/* Spa A2DP aptX codec
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <unistd.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <spa/utils/defs.h>
+#include <spa/param/audio/format.h>
+
+#include <openaptx.h>
+
+#include "a2dp-codecs.h"
+
+/* 4 stereo frames of 24 bits go in, two 16 bits codewords come out */
+#define APTX_BLOCK_FRAMES	4
+#define APTX_BLOCK_SIZE		(APTX_BLOCK_FRAMES * 2 * 3)
+#define APTX_CODEWORD_SIZE	4
+
+struct impl {
+	struct aptx_context *aptx;
+	int max_blocks;
+};
+
+static const a2dp_aptx_t aptx_caps = {
+	.info.vendor_id = APTX_VENDOR_ID,
+	.info.codec_id = APTX_CODEC_ID,
+	/* the encoder only does stereo */
+	.channel_mode = APTX_CHANNEL_MODE_STEREO,
+	.frequency =
+		APTX_SAMPLING_FREQ_16000 |
+		APTX_SAMPLING_FREQ_32000 |
+		APTX_SAMPLING_FREQ_44100 |
+		APTX_SAMPLING_FREQ_48000,
+};
+
+static int codec_fill_caps(const struct a2dp_codec *codec, uint8_t caps[A2DP_MAX_CAPS_SIZE])
+{
+	memcpy(caps, &aptx_caps, sizeof(aptx_caps));
+	return sizeof(aptx_caps);
+}
+
+static int codec_select_config(const struct a2dp_codec *codec, const void *caps,
+		size_t caps_size, uint8_t config[A2DP_MAX_CAPS_SIZE])
+{
+	a2dp_aptx_t conf;
+
+	if (caps_size < sizeof(conf))
+		return -EINVAL;
+
+	memcpy(&conf, caps, sizeof(conf));
+
+	if (conf.info.vendor_id != APTX_VENDOR_ID ||
+	    conf.info.codec_id != APTX_CODEC_ID)
+		return -ENOTSUP;
+
+	if (conf.frequency & APTX_SAMPLING_FREQ_48000)
+		conf.frequency = APTX_SAMPLING_FREQ_48000;
+	else if (conf.frequency & APTX_SAMPLING_FREQ_44100)
+		conf.frequency = APTX_SAMPLING_FREQ_44100;
+	else if (conf.frequency & APTX_SAMPLING_FREQ_32000)
+		conf.frequency = APTX_SAMPLING_FREQ_32000;
+	else if (conf.frequency & APTX_SAMPLING_FREQ_16000)
+		conf.frequency = APTX_SAMPLING_FREQ_16000;
+	else
+		return -ENOTSUP;
+
+	if (conf.channel_mode & APTX_CHANNEL_MODE_STEREO)
+		conf.channel_mode = APTX_CHANNEL_MODE_STEREO;
+	else
+		return -ENOTSUP;
+
+	memcpy(config, &conf, sizeof(conf));
+
+	return sizeof(conf);
+}
+
+static int codec_get_info(const struct a2dp_codec *codec, const void *config,
+		size_t config_size, struct spa_audio_info_raw *info)
+{
+	a2dp_aptx_t conf;
+
+	if (config_size < sizeof(conf))
+		return -EINVAL;
+
+	memcpy(&conf, config, sizeof(conf));
+
+	spa_zero(*info);
+	info->format = SPA_AUDIO_FORMAT_S24;
+
+	switch (conf.frequency) {
+	case APTX_SAMPLING_FREQ_16000:
+		info->rate = 16000;
+		break;
+	case APTX_SAMPLING_FREQ_32000:
+		info->rate = 32000;
+		break;
+	case APTX_SAMPLING_FREQ_44100:
+		info->rate = 44100;
+		break;
+	case APTX_SAMPLING_FREQ_48000:
+		info->rate = 48000;
+		break;
+	default:
+		return -EINVAL;
+	}
+	if (conf.channel_mode != APTX_CHANNEL_MODE_STEREO)
+		return -EINVAL;
+
+	info->channels = 2;
+	info->position[0] = SPA_AUDIO_CHANNEL_FL;
+	info->position[1] = SPA_AUDIO_CHANNEL_FR;
+
+	return 0;
+}
+
+static void *codec_init(const struct a2dp_codec *codec, const void *config,
+		size_t config_size, const struct spa_audio_info_raw *info, size_t mtu)
+{
+	struct impl *this;
+
+	if ((this = calloc(1, sizeof(struct impl))) == NULL)
+		return NULL;
+
+	if ((this->aptx = aptx_init(0)) == NULL) {
+		free(this);
+		errno = ENOMEM;
+		return NULL;
+	}
+	this->max_blocks = SPA_MAX(mtu / APTX_CODEWORD_SIZE, 1u);
+
+	return this;
+}
+
+static void codec_deinit(void *data)
+{
+	struct impl *this = data;
+	aptx_finish(this->aptx);
+	free(this);
+}
+
+static int codec_get_block_size(void *data)
+{
+	return APTX_BLOCK_SIZE;
+}
+
+static int codec_get_num_blocks(void *data)
+{
+	struct impl *this = data;
+	return this->max_blocks;
+}
+
+static int codec_start_encode(void *data, void *dst, size_t dst_size,
+		uint16_t seqnum, uint32_t timestamp)
+{
+	/* plain aptX has no RTP header, the packet is only codewords */
+	return 0;
+}
+
+static int codec_encode(void *data, const void *src, size_t src_size,
+		void *dst, size_t dst_size, size_t *dst_out, int *need_flush)
+{
+	struct impl *this = data;
+	size_t n_blocks, processed;
+
+	n_blocks = SPA_MIN(src_size / APTX_BLOCK_SIZE, dst_size / APTX_CODEWORD_SIZE);
+	if (n_blocks == 0)
+		return dst_size < APTX_CODEWORD_SIZE ? -ENOSPC : 0;
+
+	processed = aptx_encode(this->aptx, src, n_blocks * APTX_BLOCK_SIZE,
+			dst, n_blocks * APTX_CODEWORD_SIZE, dst_out);
+
+	*need_flush = dst_size - *dst_out < APTX_CODEWORD_SIZE;
+
+	return processed;
+}
+
+static int codec_start_decode(void *data, const void *src, size_t src_size,
+		uint16_t *seqnum, uint32_t *timestamp)
+{
+	return 0;
+}
+
+static int codec_decode(void *data, const void *src, size_t src_size,
+		void *dst, size_t dst_size, size_t *dst_out)
+{
+	struct impl *this = data;
+	size_t n_blocks;
+
+	n_blocks = SPA_MIN(src_size / APTX_CODEWORD_SIZE, dst_size / APTX_BLOCK_SIZE);
+	if (n_blocks == 0)
+		return -EINVAL;
+
+	return aptx_decode(this->aptx, src, n_blocks * APTX_CODEWORD_SIZE,
+			dst, n_blocks * APTX_BLOCK_SIZE, dst_out);
+}
+
+const struct a2dp_codec a2dp_codec_aptx = {
+	.codec_id = A2DP_CODEC_VENDOR,
+	.vendor = { .vendor_id = APTX_VENDOR_ID,
+		.codec_id = APTX_CODEC_ID },
+	.name = "aptx",
+	.description = "aptX",
+	.fill_caps = codec_fill_caps,
+	.select_config = codec_select_config,
+	.get_info = codec_get_info,
+	.init = codec_init,
+	.deinit = codec_deinit,
+	.get_block_size = codec_get_block_size,
+	.get_num_blocks = codec_get_num_blocks,
+	.start_encode = codec_start_encode,
+	.encode = codec_encode,
+	.start_decode = codec_start_decode,
+	.decode = codec_decode,
+};
@@ -0,0 +1,437 @@
+/* Spa A2DP SBC codec
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <unistd.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <arpa/inet.h>
+
+#include <spa/utils/defs.h>
+#include <spa/param/audio/format.h>
+
+#include <sbc/sbc.h>
+
+#include "rtp.h"
+#include "a2dp-codecs.h"
+
+/* the frame count in the RTP payload header is 4 bits */
+#define MAX_FRAME_COUNT 15
+
+struct impl {
+	sbc_t sbc;
+
+	struct rtp_payload *payload;
+
+	size_t mtu;
+	int codesize;
+	int max_frames;
+
+	int min_bitpool;
+	int max_bitpool;
+};
+
+static int codec_fill_caps(const struct a2dp_codec *codec, uint8_t caps[A2DP_MAX_CAPS_SIZE])
+{
+	memcpy(caps, &bluez_a2dp_sbc, sizeof(bluez_a2dp_sbc));
+	return sizeof(bluez_a2dp_sbc);
+}
+
+static uint8_t default_bitpool(uint8_t freq, uint8_t mode)
+{
+	/* These bitpool values were chosen based on the A2DP spec recommendation */
+	switch (freq) {
+	case SBC_SAMPLING_FREQ_16000:
+	case SBC_SAMPLING_FREQ_32000:
+		return 53;
+
+	case SBC_SAMPLING_FREQ_44100:
+		switch (mode) {
+		case SBC_CHANNEL_MODE_MONO:
+		case SBC_CHANNEL_MODE_DUAL_CHANNEL:
+			return 31;
+
+		case SBC_CHANNEL_MODE_STEREO:
+		case SBC_CHANNEL_MODE_JOINT_STEREO:
+			return 53;
+		}
+		return 53;
+	case SBC_SAMPLING_FREQ_48000:
+		switch (mode) {
+		case SBC_CHANNEL_MODE_MONO:
+		case SBC_CHANNEL_MODE_DUAL_CHANNEL:
+			return 29;
+
+		case SBC_CHANNEL_MODE_STEREO:
+		case SBC_CHANNEL_MODE_JOINT_STEREO:
+			return 51;
+		}
+		return 51;
+	}
+	return 53;
+}
+
+static int codec_select_config(const struct a2dp_codec *codec, const void *caps,
+		size_t caps_size, uint8_t config[A2DP_MAX_CAPS_SIZE])
+{
+	a2dp_sbc_t conf;
+	int bitpool;
+
+	if (caps_size < sizeof(conf))
+		return -EINVAL;
+
+	memcpy(&conf, caps, sizeof(conf));
+
+	if (conf.frequency & SBC_SAMPLING_FREQ_48000)
+		conf.frequency = SBC_SAMPLING_FREQ_48000;
+	else if (conf.frequency & SBC_SAMPLING_FREQ_44100)
+		conf.frequency = SBC_SAMPLING_FREQ_44100;
+	else if (conf.frequency & SBC_SAMPLING_FREQ_32000)
+		conf.frequency = SBC_SAMPLING_FREQ_32000;
+	else if (conf.frequency & SBC_SAMPLING_FREQ_16000)
+		conf.frequency = SBC_SAMPLING_FREQ_16000;
+	else
+		return -ENOTSUP;
+
+	if (conf.channel_mode & SBC_CHANNEL_MODE_JOINT_STEREO)
+		conf.channel_mode = SBC_CHANNEL_MODE_JOINT_STEREO;
+	else if (conf.channel_mode & SBC_CHANNEL_MODE_STEREO)
+		conf.channel_mode = SBC_CHANNEL_MODE_STEREO;
+	else if (conf.channel_mode & SBC_CHANNEL_MODE_DUAL_CHANNEL)
+		conf.channel_mode = SBC_CHANNEL_MODE_DUAL_CHANNEL;
+	else if (conf.channel_mode & SBC_CHANNEL_MODE_MONO)
+		conf.channel_mode = SBC_CHANNEL_MODE_MONO;
+	else
+		return -ENOTSUP;
+
+	if (conf.block_length & SBC_BLOCK_LENGTH_16)
+		conf.block_length = SBC_BLOCK_LENGTH_16;
+	else if (conf.block_length & SBC_BLOCK_LENGTH_12)
+		conf.block_length = SBC_BLOCK_LENGTH_12;
+	else if (conf.block_length & SBC_BLOCK_LENGTH_8)
+		conf.block_length = SBC_BLOCK_LENGTH_8;
+	else if (conf.block_length & SBC_BLOCK_LENGTH_4)
+		conf.block_length = SBC_BLOCK_LENGTH_4;
+	else
+		return -ENOTSUP;
+
+	if (conf.subbands & SBC_SUBBANDS_8)
+		conf.subbands = SBC_SUBBANDS_8;
+	else if (conf.subbands & SBC_SUBBANDS_4)
+		conf.subbands = SBC_SUBBANDS_4;
+	else
+		return -ENOTSUP;
+
+	if (conf.allocation_method & SBC_ALLOCATION_LOUDNESS)
+		conf.allocation_method = SBC_ALLOCATION_LOUDNESS;
+	else if (conf.allocation_method & SBC_ALLOCATION_SNR)
+		conf.allocation_method = SBC_ALLOCATION_SNR;
+	else
+		return -ENOTSUP;
+
+	bitpool = default_bitpool(conf.frequency, conf.channel_mode);
+
+	conf.min_bitpool = SPA_MAX(MIN_BITPOOL, conf.min_bitpool);
+	conf.max_bitpool = SPA_MIN(bitpool, conf.max_bitpool);
+
+	memcpy(config, &conf, sizeof(conf));
+
+	return sizeof(conf);
+}
+
+static int codec_get_info(const struct a2dp_codec *codec, const void *config,
+		size_t config_size, struct spa_audio_info_raw *info)
+{
+	a2dp_sbc_t conf;
+	int res;
+
+	if (config_size < sizeof(conf))
+		return -EINVAL;
+
+	memcpy(&conf, config, sizeof(conf));
+
+	spa_zero(*info);
+	info->format = SPA_AUDIO_FORMAT_S16;
+	if ((res = a2dp_sbc_get_frequency(&conf)) < 0)
+		return -EINVAL;
+	info->rate = res;
+	if ((res = a2dp_sbc_get_channels(&conf)) < 0)
+		return -EINVAL;
+	info->channels = res;
+
+	switch (info->channels) {
+	case 1:
+		info->position[0] = SPA_AUDIO_CHANNEL_MONO;
+		break;
+	case 2:
+		info->position[0] = SPA_AUDIO_CHANNEL_FL;
+		info->position[1] = SPA_AUDIO_CHANNEL_FR;
+		break;
+	default:
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static int set_bitpool(struct impl *this, int bitpool)
+{
+	size_t header_size = sizeof(struct rtp_header) + sizeof(struct rtp_payload);
+
+	bitpool = SPA_CLAMP(bitpool, this->min_bitpool, this->max_bitpool);
+
+	if (this->sbc.bitpool == bitpool)
+		return 0;
+
+	this->sbc.bitpool = bitpool;
+	this->codesize = sbc_get_codesize(&this->sbc);
+	this->max_frames = (this->mtu - header_size) / sbc_get_frame_length(&this->sbc);
+	this->max_frames = SPA_CLAMP(this->max_frames, 1, MAX_FRAME_COUNT);
+
+	return bitpool;
+}
+
+static void *codec_init(const struct a2dp_codec *codec, const void *config,
+		size_t config_size, const struct spa_audio_info_raw *info, size_t mtu)
+{
+	struct impl *this;
+	a2dp_sbc_t conf;
+	int res;
+
+	if (config_size < sizeof(conf)) {
+		errno = EINVAL;
+		return NULL;
+	}
+	memcpy(&conf, config, sizeof(conf));
+
+	if ((this = calloc(1, sizeof(struct impl))) == NULL)
+		return NULL;
+
+	if ((res = sbc_init(&this->sbc, 0)) < 0)
+		goto error;
+
+	this->sbc.endian = SBC_LE;
+	this->mtu = mtu;
+
+	switch (conf.frequency) {
+	case SBC_SAMPLING_FREQ_48000:
+		this->sbc.frequency = SBC_FREQ_48000;
+		break;
+	case SBC_SAMPLING_FREQ_44100:
+		this->sbc.frequency = SBC_FREQ_44100;
+		break;
+	case SBC_SAMPLING_FREQ_32000:
+		this->sbc.frequency = SBC_FREQ_32000;
+		break;
+	case SBC_SAMPLING_FREQ_16000:
+		this->sbc.frequency = SBC_FREQ_16000;
+		break;
+	default:
+		res = -EINVAL;
+		goto error_finish;
+	}
+
+	switch (conf.channel_mode) {
+	case SBC_CHANNEL_MODE_JOINT_STEREO:
+		this->sbc.mode = SBC_MODE_JOINT_STEREO;
+		break;
+	case SBC_CHANNEL_MODE_STEREO:
+		this->sbc.mode = SBC_MODE_STEREO;
+		break;
+	case SBC_CHANNEL_MODE_DUAL_CHANNEL:
+		this->sbc.mode = SBC_MODE_DUAL_CHANNEL;
+		break;
+	case SBC_CHANNEL_MODE_MONO:
+		this->sbc.mode = SBC_MODE_MONO;
+		break;
+	default:
+		res = -EINVAL;
+		goto error_finish;
+	}
+
+	switch (conf.subbands) {
+	case SBC_SUBBANDS_4:
+		this->sbc.subbands = SBC_SB_4;
+		break;
+	case SBC_SUBBANDS_8:
+		this->sbc.subbands = SBC_SB_8;
+		break;
+	default:
+		res = -EINVAL;
+		goto error_finish;
+	}
+
+	if (conf.allocation_method & SBC_ALLOCATION_LOUDNESS)
+		this->sbc.allocation = SBC_AM_LOUDNESS;
+	else
+		this->sbc.allocation = SBC_AM_SNR;
+
+	switch (conf.block_length) {
+	case SBC_BLOCK_LENGTH_4:
+		this->sbc.blocks = SBC_BLK_4;
+		break;
+	case SBC_BLOCK_LENGTH_8:
+		this->sbc.blocks = SBC_BLK_8;
+		break;
+	case SBC_BLOCK_LENGTH_12:
+		this->sbc.blocks = SBC_BLK_12;
+		break;
+	case SBC_BLOCK_LENGTH_16:
+		this->sbc.blocks = SBC_BLK_16;
+		break;
+	default:
+		res = -EINVAL;
+		goto error_finish;
+	}
+
+	this->min_bitpool = SPA_MAX(conf.min_bitpool, 12);
+	this->max_bitpool = conf.max_bitpool;
+
+	this->sbc.bitpool = 0;
+	set_bitpool(this, conf.max_bitpool);
+
+	return this;
+
+error_finish:
+	sbc_finish(&this->sbc);
+error:
+	free(this);
+	errno = -res;
+	return NULL;
+}
+
+static void codec_deinit(void *data)
+{
+	struct impl *this = data;
+	sbc_finish(&this->sbc);
+	free(this);
+}
+
+static int codec_get_block_size(void *data)
+{
+	struct impl *this = data;
+	return this->codesize;
+}
+
+static int codec_get_num_blocks(void *data)
+{
+	struct impl *this = data;
+	return this->max_frames;
+}
+
+static int codec_start_encode(void *data, void *dst, size_t dst_size,
+		uint16_t seqnum, uint32_t timestamp)
+{
+	struct impl *this = data;
+	struct rtp_header *header;
+	size_t header_size = sizeof(struct rtp_header) + sizeof(struct rtp_payload);
+
+	if (dst_size < header_size)
+		return -EINVAL;
+
+	header = dst;
+	this->payload = SPA_MEMBER(dst, sizeof(struct rtp_header), struct rtp_payload);
+	memset(dst, 0, header_size);
+
+	header->v = 2;
+	header->pt = 1;
+	header->sequence_number = htons(seqnum);
+	header->timestamp = htonl(timestamp);
+	header->ssrc = htonl(1);
+
+	return header_size;
+}
+
+static int codec_encode(void *data, const void *src, size_t src_size,
+		void *dst, size_t dst_size, size_t *dst_out, int *need_flush)
+{
+	struct impl *this = data;
+	ssize_t out_encoded;
+	int res;
+
+	res = sbc_encode(&this->sbc, src, src_size, dst, dst_size, &out_encoded);
+	if (res < 0)
+		return res;
+
+	*dst_out = out_encoded;
+	this->payload->frame_count += res / this->codesize;
+	*need_flush = this->payload->frame_count >= this->max_frames;
+
+	return res;
+}
+
+static int codec_start_decode(void *data, const void *src, size_t src_size,
+		uint16_t *seqnum, uint32_t *timestamp)
+{
+	const struct rtp_header *header = src;
+	size_t header_size = sizeof(struct rtp_header) + sizeof(struct rtp_payload);
+
+	if (src_size <= header_size)
+		return -EINVAL;
+
+	if (seqnum)
+		*seqnum = ntohs(header->sequence_number);
+	if (timestamp)
+		*timestamp = ntohl(header->timestamp);
+
+	return header_size;
+}
+
+static int codec_decode(void *data, const void *src, size_t src_size,
+		void *dst, size_t dst_size, size_t *dst_out)
+{
+	struct impl *this = data;
+	return sbc_decode(&this->sbc, src, src_size, dst, dst_size, dst_out);
+}
+
+static int codec_reduce_bitpool(void *data)
+{
+	struct impl *this = data;
+	return set_bitpool(this, this->sbc.bitpool - 2);
+}
+
+static int codec_increase_bitpool(void *data)
+{
+	struct impl *this = data;
+	return set_bitpool(this, this->sbc.bitpool + 1);
+}
+
+const struct a2dp_codec a2dp_codec_sbc = {
+	.codec_id = A2DP_CODEC_SBC,
+	.name = "sbc",
+	.description = "SBC",
+	.fill_caps = codec_fill_caps,
+	.select_config = codec_select_config,
+	.get_info = codec_get_info,
+	.init = codec_init,
+	.deinit = codec_deinit,
+	.get_block_size = codec_get_block_size,
+	.get_num_blocks = codec_get_num_blocks,
+	.start_encode = codec_start_encode,
+	.encode = codec_encode,
+	.start_decode = codec_start_decode,
+	.decode = codec_decode,
+	.reduce_bitpool = codec_reduce_bitpool,
+	.increase_bitpool = codec_increase_bitpool,
+};
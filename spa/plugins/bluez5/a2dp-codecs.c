@@ -8,6 +8,8 @@
  *
  */
 
+#include <string.h>
+
 #include "a2dp-codecs.h"
 
 const a2dp_sbc_t bluez_a2dp_sbc = {
@@ -121,3 +123,32 @@ const a2dp_aptx_t bluez_a2dp_aptx = {
 		APTX_SAMPLING_FREQ_48000,
 };
 #endif
+
+const struct a2dp_codec * const a2dp_codec_list[] = {
+#if ENABLE_APTX
+	&a2dp_codec_aptx,
+#endif
+	&a2dp_codec_sbc,
+	NULL
+};
+
+const struct a2dp_codec *a2dp_codec_find(int codec_id, const void *config, size_t config_size)
+{
+	const a2dp_vendor_codec_t *vendor = config;
+	int i;
+
+	for (i = 0; a2dp_codec_list[i]; i++) {
+		const struct a2dp_codec *c = a2dp_codec_list[i];
+
+		/* the codec is a signed byte on the transport */
+		if (c->codec_id != (uint8_t) codec_id)
+			continue;
+		if (c->codec_id != A2DP_CODEC_VENDOR)
+			return c;
+		if (config_size >= sizeof(*vendor) &&
+		    vendor->vendor_id == c->vendor.vendor_id &&
+		    vendor->codec_id == c->vendor.codec_id)
+			return c;
+	}
+	return NULL;
+}
@@ -26,6 +26,9 @@
 #define BLUEALSA_A2DPCODECS_H_
 
 #include <stdint.h>
+#include <stddef.h>
+
+#include <spa/param/audio/format.h>
 
 #define A2DP_CODEC_SBC			0x00
 #define A2DP_CODEC_MPEG12		0x01
@@ -295,4 +298,63 @@ extern const a2dp_aac_t bluez_a2dp_aac;
 extern const a2dp_aptx_t bluez_a2dp_aptx;
 #endif
 
+#define A2DP_MAX_CAPS_SIZE	254
+
+/* A codec implementation. The sink and source only talk to the codec
+ * through these methods, the codec owns the configuration blob, the
+ * packet header and the bitrate. */
+struct a2dp_codec {
+	uint8_t codec_id;
+	a2dp_vendor_codec_t vendor;
+
+	const char *name;
+	const char *description;
+
+	/* capabilities to register with BlueZ, returns the size */
+	int (*fill_caps) (const struct a2dp_codec *codec, uint8_t caps[A2DP_MAX_CAPS_SIZE]);
+	/* pick a configuration from the remote capabilities, returns the size */
+	int (*select_config) (const struct a2dp_codec *codec, const void *caps,
+			size_t caps_size, uint8_t config[A2DP_MAX_CAPS_SIZE]);
+	/* the raw PCM format for a configuration */
+	int (*get_info) (const struct a2dp_codec *codec, const void *config,
+			size_t config_size, struct spa_audio_info_raw *info);
+
+	void *(*init) (const struct a2dp_codec *codec, const void *config,
+			size_t config_size, const struct spa_audio_info_raw *info,
+			size_t mtu);
+	void (*deinit) (void *data);
+
+	/* PCM bytes consumed per block and blocks per packet */
+	int (*get_block_size) (void *data);
+	int (*get_num_blocks) (void *data);
+
+	/* write the packet header, returns its size */
+	int (*start_encode) (void *data, void *dst, size_t dst_size,
+			uint16_t seqnum, uint32_t timestamp);
+	/* returns the consumed PCM bytes, need_flush is set when the packet is full */
+	int (*encode) (void *data, const void *src, size_t src_size,
+			void *dst, size_t dst_size, size_t *dst_out, int *need_flush);
+
+	/* parse the packet header, returns its size */
+	int (*start_decode) (void *data, const void *src, size_t src_size,
+			uint16_t *seqnum, uint32_t *timestamp);
+	/* returns the consumed packet bytes */
+	int (*decode) (void *data, const void *src, size_t src_size,
+			void *dst, size_t dst_size, size_t *dst_out);
+
+	/* optional, returns > 0 when the packet layout changed */
+	int (*reduce_bitpool) (void *data);
+	int (*increase_bitpool) (void *data);
+};
+
+extern const struct a2dp_codec a2dp_codec_sbc;
+#if ENABLE_APTX
+extern const struct a2dp_codec a2dp_codec_aptx;
+#endif
+
+/* NULL terminated, in order of preference */
+extern const struct a2dp_codec * const a2dp_codec_list[];
+
+const struct a2dp_codec *a2dp_codec_find(int codec_id, const void *config, size_t config_size);
+
 #endif
@@ -0,0 +1,114 @@
+/* Spa A2DP rate control
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SPA_BLUEZ5_A2DP_RATE_CONTROL_H
+#define SPA_BLUEZ5_A2DP_RATE_CONTROL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <spa/utils/defs.h>
+
+/* Steers the encoder bitrate so that the delay of the data queued in the
+ * socket stays around a target. The delay is smoothed over a few packets.
+ * The bitrate goes down when the queue grows past the target or a write
+ * fails, with bigger steps the further off it is. It goes up one step at a
+ * time once the link has been quiet for a while. */
+struct a2dp_rate_control {
+	uint64_t target;	/* wanted queue delay in nsec */
+	uint64_t down_interval;	/* min nsec between two decreases */
+	uint64_t up_interval;	/* min nsec between two increases */
+	uint64_t quiet_time;	/* nsec without congestion before increasing */
+	double avg;		/* smoothed queue delay in nsec */
+	uint64_t last_change;
+	uint64_t last_congestion;
+};
+
+#define A2DP_RATE_CONTROL_ALPHA		0.25
+#define A2DP_RATE_CONTROL_MAX_STEPS	4
+
+static inline void a2dp_rate_control_init(struct a2dp_rate_control *rc, uint64_t target)
+{
+	rc->target = target;
+	rc->down_interval = 250 * SPA_NSEC_PER_MSEC;
+	rc->up_interval = 500 * SPA_NSEC_PER_MSEC;
+	rc->quiet_time = 2 * SPA_NSEC_PER_SEC;
+	rc->avg = 0.0;
+	rc->last_change = 0;
+	rc->last_congestion = 0;
+}
+
+/* On Bluetooth sockets TIOCOUTQ returns the free space in the send buffer,
+ * not what is queued. Turn it into queued bytes with the SO_SNDBUF size. */
+static inline uint32_t a2dp_rate_control_queued(int sndbuf, int outq)
+{
+	return SPA_MAX(sndbuf - outq, 0);
+}
+
+/* The time it takes to send queued bytes when a packet of size bytes holds
+ * frames samples at rate. */
+static inline uint64_t a2dp_rate_control_queue_delay(uint32_t queued,
+		uint64_t frames, uint32_t size, uint32_t rate)
+{
+	if (size == 0 || rate == 0)
+		return 0;
+	return (uint64_t)queued * frames * SPA_NSEC_PER_SEC / ((uint64_t)size * rate);
+}
+
+/* Feed the queue delay before a write attempt, failed is set when the write
+ * could not be done. Returns the number of steps to lower (< 0) or raise
+ * (> 0) the bitrate with. */
+static inline int a2dp_rate_control_update(struct a2dp_rate_control *rc,
+		uint64_t now, uint64_t delay, bool failed)
+{
+	int steps;
+
+	rc->avg += ((double)delay - rc->avg) * A2DP_RATE_CONTROL_ALPHA;
+
+	if (failed || rc->avg > rc->target) {
+		rc->last_congestion = now;
+		if (now - rc->last_change < rc->down_interval)
+			return 0;
+		steps = SPA_CLAMP((int)(rc->avg / rc->target), 1, A2DP_RATE_CONTROL_MAX_STEPS);
+		rc->last_change = now;
+		return -steps;
+	}
+	if (rc->avg < rc->target / 2 &&
+	    now - rc->last_congestion >= rc->quiet_time &&
+	    now - rc->last_change >= rc->up_interval) {
+		rc->last_change = now;
+		return 1;
+	}
+	return 0;
+}
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* SPA_BLUEZ5_A2DP_RATE_CONTROL_H */
@@ -25,6 +25,8 @@
 #include <unistd.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <poll.h>
+#include <pthread.h>
 #include <arpa/inet.h>
 #include <sys/ioctl.h>
 
@@ -36,6 +38,7 @@
 #include <spa/utils/keys.h>
 #include <spa/utils/names.h>
 #include <spa/utils/result.h>
+#include <spa/utils/ringbuffer.h>
 #include <spa/monitor/device.h>
 
 #include <spa/node/node.h>
@@ -47,11 +50,10 @@
 #include <spa/param/audio/format-utils.h>
 #include <spa/pod/filter.h>
 
-#include <sbc/sbc.h>
-
 #include "defs.h"
 #include "rtp.h"
 #include "a2dp-codecs.h"
+#include "a2dp-rate-control.h"
 
 struct props {
 	uint32_t min_latency;
@@ -59,8 +61,12 @@ struct props {
 };
 
 #define FILL_FRAMES 2
-#define MAX_FRAME_COUNT 32
 #define MAX_BUFFERS 32
+#define TARGET_QUEUE_DELAY (20 * SPA_NSEC_PER_MSEC)
+
+#define RING_SIZE	(64 * 1024)	/* PCM between the data loop and the encoder */
+#define RING_MASK	(RING_SIZE - 1)
+#define MAX_CODESIZE	1024
 
 struct buffer {
 	uint32_t id;
@@ -95,6 +101,7 @@ struct impl {
 	struct spa_node node;
 
 	struct spa_log *log;
+	struct spa_loop *main_loop;
 	struct spa_loop *data_loop;
 	struct spa_system *data_system;
 
@@ -117,28 +124,40 @@ struct impl {
 	struct spa_source source;
 	int timerfd;
 	int threshold;
-	struct spa_source flush_source;
+
+	/* the data loop only copies PCM into the ring, the encoder thread
+	 * encodes it and writes it to the socket */
+	struct spa_ringbuffer ring;
+	uint8_t ring_data[RING_SIZE];
+	pthread_t encoder;
+	int encoder_fd;
+	int encoder_running;
+	int encoder_error;		/* set by the encoder thread when it fails */
+	unsigned int error_reported:1;
+	uint8_t encode_tmp[MAX_CODESIZE];
 
 	struct spa_io_clock *clock;
 	struct spa_io_position *position;
 
-	sbc_t sbc;
-	int read_size;
+	const struct a2dp_codec *codec;
+	void *codec_data;
+
 	int write_size;
 	int write_samples;
-	int frame_length;
-	int codesize;
+	int block_size;
 	uint8_t buffer[4096];
 	int buffer_used;
 	int frame_count;
+	int need_flush;
 	uint16_t seqnum;
 	uint32_t timestamp;
 
-	int min_bitpool;
-	int max_bitpool;
-
 	uint64_t last_time;
-	uint64_t last_error;
+
+	/* encoder thread, bitrate adaptation */
+	struct a2dp_rate_control rate_control;
+	int sndbuf;
+	uint64_t queue_delay;
 
 	struct timespec now;
 	uint64_t start_time;
@@ -350,37 +369,35 @@ static inline void calc_timeout(size_t target, size_t current,
 
 static int reset_buffer(struct impl *this)
 {
-	this->buffer_used = sizeof(struct rtp_header) + sizeof(struct rtp_payload);
+	int res;
+
+	res = this->codec->start_encode(this->codec_data,
+			this->buffer, this->write_size, this->seqnum, this->timestamp);
+	this->buffer_used = SPA_MAX(res, 0);
 	this->frame_count = 0;
-	return 0;
+	this->need_flush = 0;
+	return res;
 }
 
-static int send_buffer(struct impl *this)
+static int send_buffer(struct impl *this, int fd)
 {
 	int val, written;
-	struct rtp_header *header;
-	struct rtp_payload *payload;
+	uint32_t queued = 0;
+	uint64_t frames = this->sample_count - this->timestamp;
 
-	spa_return_val_if_fail(this->transport, -EIO);
+	if (ioctl(fd, TIOCOUTQ, &val) == 0)
+		queued = a2dp_rate_control_queued(this->sndbuf, val);
 
-	header = (struct rtp_header *)this->buffer;
-	payload = (struct rtp_payload *)(this->buffer + sizeof(struct rtp_header));
-	memset(this->buffer, 0, sizeof(struct rtp_header)+sizeof(struct rtp_payload));
+	/* express what is still queued in time at the current bitrate */
+	if (this->buffer_used > 0)
+		this->queue_delay = a2dp_rate_control_queue_delay(queued, frames,
+				this->buffer_used, this->port.current_format.info.raw.rate);
 
-	payload->frame_count = this->frame_count;
-	header->v = 2;
-	header->pt = 1;
-	header->sequence_number = htons(this->seqnum);
-	header->timestamp = htonl(this->timestamp);
-	header->ssrc = htonl(1);
-
-	ioctl(this->transport->fd, TIOCOUTQ, &val);
-
-	spa_log_trace(this->log, NAME " %p: send %d %u %u %u %"PRIu64" %d",
+	spa_log_trace(this->log, NAME " %p: send %d %u %u %u %u %"PRIu64,
 			this, this->frame_count, this->seqnum, this->timestamp, this->buffer_used,
-			this->sample_time, val);
+			queued, this->queue_delay);
 
-	written = write(this->transport->fd, this->buffer, this->buffer_used);
+	written = write(fd, this->buffer, this->buffer_used);
 	spa_log_trace(this->log, NAME " %p: send %d", this, written);
 	if (written < 0)
 		return -errno;
@@ -395,52 +412,45 @@ static int send_buffer(struct impl *this)
 static int encode_buffer(struct impl *this, const void *data, int size)
 {
 	int processed;
-	ssize_t out_encoded;
+	size_t out_encoded;
 	struct port *port = &this->port;
 
-	spa_log_trace(this->log, NAME " %p: encode %d used %d, %d %d %d/%d",
+	spa_log_trace(this->log, NAME " %p: encode %d used %d, %d %d %d",
 			this, size, this->buffer_used, port->frame_size, this->write_size,
-			this->frame_count, MAX_FRAME_COUNT);
+			this->frame_count);
 
-	if (this->frame_count > MAX_FRAME_COUNT)
+	if (this->need_flush)
 		return -ENOSPC;
 
-	processed = sbc_encode(&this->sbc, data, size,
-			       this->buffer + this->buffer_used,
-			       this->write_size - this->buffer_used,
-			       &out_encoded);
+	processed = this->codec->encode(this->codec_data, data, size,
+			this->buffer + this->buffer_used,
+			this->write_size - this->buffer_used,
+			&out_encoded, &this->need_flush);
 	if (processed < 0)
 		return processed;
 
 	this->sample_count += processed / port->frame_size;
-	this->sample_time += processed / port->frame_size;
-	this->frame_count += processed / this->codesize;
+	this->frame_count += processed / this->block_size;
 	this->buffer_used += out_encoded;
 
-	spa_log_trace(this->log, NAME " %p: processed %d %zd used %d",
+	spa_log_trace(this->log, NAME " %p: processed %d %zu used %d",
 			this, processed, out_encoded, this->buffer_used);
 
 	return processed;
 }
 
-static bool need_flush(struct impl *this)
-{
-	return (this->buffer_used + this->frame_length > this->write_size) ||
-		this->frame_count > MAX_FRAME_COUNT;
-}
-
-static int flush_buffer(struct impl *this, bool force)
+static int flush_buffer(struct impl *this, int fd, bool force)
 {
 	spa_log_trace(this->log, NAME" %p: %d %d %d", this,
-			this->buffer_used, this->frame_length, this->write_size);
+			this->buffer_used, this->frame_count, this->write_size);
 
-	if (force || need_flush(this))
-		return send_buffer(this);
+	if (force || this->need_flush)
+		return send_buffer(this, fd);
 
 	return 0;
 }
 
-static int fill_socket(struct impl *this, uint64_t now_time)
+static int fill_socket(struct impl *this, int fd)
 {
 	static const uint8_t zero_buffer[1024 * 4] = { 0, };
 	int frames = 0;
@@ -454,7 +464,7 @@ static int fill_socket(struct impl *this, uint64_t now_time)
 		if (processed == 0)
 			break;
 
-		written = flush_buffer(this, false);
+		written = flush_buffer(this, fd, false);
 		if (written == -EAGAIN)
 			break;
 		else if (written < 0)
@@ -468,68 +478,220 @@ static int fill_socket(struct impl *this, uint64_t now_time)
 	return 0;
 }
 
-static int add_data(struct impl *this, const void *data, int size)
+static void update_block_size(struct impl *this)
 {
-	int processed, total = 0;
+	struct port *port = &this->port;
 
-	while (size > 0) {
-		processed = encode_buffer(this, data, size);
+	this->block_size = this->codec->get_block_size(this->codec_data);
+	/* read by the data loop to pace the timer */
+	__atomic_store_n(&this->write_samples,
+			this->codec->get_num_blocks(this->codec_data) *
+			(this->block_size / port->frame_size), __ATOMIC_RELAXED);
+}
 
-		if (processed <= 0)
-			return total > 0 ? total : processed;
+static int reduce_bitpool(struct impl *this)
+{
+	int res;
 
-		data = SPA_MEMBER(data, processed, void);
-		size -= processed;
-		total += processed;
+	if (this->codec->reduce_bitpool == NULL)
+		return 0;
+	if ((res = this->codec->reduce_bitpool(this->codec_data)) > 0) {
+		spa_log_debug(this->log, NAME" %p: reduce bitpool %d", this, res);
+		update_block_size(this);
 	}
-	return total;
+	return res;
 }
 
-static int set_bitpool(struct impl *this, int bitpool)
+static int increase_bitpool(struct impl *this)
 {
-	struct port *port = &this->port;
+	int res;
 
-	spa_return_val_if_fail(this->transport, -EIO);
+	if (this->codec->increase_bitpool == NULL)
+		return 0;
+	if ((res = this->codec->increase_bitpool(this->codec_data)) > 0) {
+		spa_log_debug(this->log, NAME" %p: increase bitpool %d", this, res);
+		update_block_size(this);
+	}
+	return res;
+}
 
-	if (bitpool < this->min_bitpool)
-		bitpool = this->min_bitpool;
-	if (bitpool > this->max_bitpool)
-		bitpool = this->max_bitpool;
+static void adapt_bitrate(struct impl *this, uint64_t now_time, bool failed)
+{
+	int steps;
+
+	steps = a2dp_rate_control_update(&this->rate_control, now_time,
+			this->queue_delay, failed);
+	for (; steps < 0; steps++)
+		reduce_bitpool(this);
+	for (; steps > 0; steps--)
+		increase_bitpool(this);
+}
 
-	if (this->sbc.bitpool == bitpool)
-		return 0;
+/* encoder thread: encode everything in the ring and send it. Returns
+ * -EAGAIN when the socket is full and we need to wait for POLLOUT. */
+static int encode_ring(struct impl *this, int fd, uint64_t now_time)
+{
+	int32_t avail;
+	uint32_t index, offs, l0;
+	int processed, written, res = 0;
+	const void *src;
+
+	while (true) {
+		if (this->need_flush) {
+			written = flush_buffer(this, fd, false);
+			if (written == -EAGAIN) {
+				adapt_bitrate(this, now_time, true);
+				res = -EAGAIN;
+				break;
+			}
+			if (written < 0) {
+				res = written;
+				break;
+			}
+			adapt_bitrate(this, now_time, false);
+			continue;
+		}
 
-	this->sbc.bitpool = bitpool;
+		avail = spa_ringbuffer_get_read_index(&this->ring, &index);
+		if (avail < this->block_size)
+			break;
 
-	spa_log_debug(this->log, NAME" %p: set bitpool %d", this, this->sbc.bitpool);
+		offs = index & RING_MASK;
+		l0 = SPA_MIN((uint32_t)avail, RING_SIZE - offs);
+		if (l0 < (uint32_t)this->block_size) {
+			/* the next block wraps around the ring */
+			spa_ringbuffer_read_data(&this->ring, this->ring_data, RING_SIZE,
+					offs, this->encode_tmp, this->block_size);
+			src = this->encode_tmp;
+			l0 = this->block_size;
+		} else {
+			src = SPA_MEMBER(this->ring_data, offs, void);
+		}
 
-	this->codesize = sbc_get_codesize(&this->sbc);
-	this->frame_length = sbc_get_frame_length(&this->sbc);
+		processed = encode_buffer(this, src, l0);
+		if (processed < 0) {
+			res = processed;
+			break;
+		}
+		if (processed == 0)
+			break;
 
-	this->read_size = this->transport->read_mtu
-		- sizeof(struct rtp_header) - sizeof(struct rtp_payload) - 24;
-	this->write_size = this->transport->write_mtu
-		- sizeof(struct rtp_header) - sizeof(struct rtp_payload) - 24;
-	this->write_samples = (this->write_size / this->frame_length) *
-		(this->codesize / port->frame_size);
+		spa_ringbuffer_read_update(&this->ring, index + processed);
+	}
+	return res;
+}
 
+static void *encoder_thread(void *data)
+{
+	struct impl *this = data;
+	struct pollfd pfd[2];
+	struct timespec now;
+	uint64_t count;
+	int res, fd = this->transport->fd;
+
+	spa_log_debug(this->log, NAME" %p: encoder thread started", this);
+
+	if ((res = fill_socket(this, fd)) < 0)
+		spa_log_error(this->log, "error fill socket %s", spa_strerror(res));
+
+	pfd[0].fd = this->encoder_fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = fd;
+	pfd[1].events = 0;
+
+	while (__atomic_load_n(&this->encoder_running, __ATOMIC_ACQUIRE)) {
+		if (poll(pfd, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			res = -errno;
+			spa_log_error(this->log, NAME" %p: poll error: %m", this);
+			goto error;
+		}
+		if (pfd[1].revents & (POLLERR | POLLHUP)) {
+			res = -EPIPE;
+			spa_log_warn(this->log, NAME" %p: socket error %d", this, pfd[1].revents);
+			goto error;
+		}
+		if (pfd[0].revents & POLLIN)
+			spa_system_eventfd_read(this->data_system, this->encoder_fd, &count);
+
+		spa_system_clock_gettime(this->data_system, CLOCK_MONOTONIC, &now);
+
+		res = encode_ring(this, fd, SPA_TIMESPEC_TO_NSEC(&now));
+		if (res < 0 && res != -EAGAIN)
+			spa_log_trace(this->log, NAME" %p: error encoding %s", this,
+					spa_strerror(res));
+
+		pfd[1].events = res == -EAGAIN ? POLLOUT : 0;
+	}
+	spa_log_debug(this->log, NAME" %p: encoder thread stopped", this);
+	return NULL;
+
+error:
+	/* nothing will send the ring anymore, the data loop reports the
+	 * error on the next timeout */
+	__atomic_store_n(&this->encoder_error, res, __ATOMIC_RELAXED);
+	__atomic_store_n(&this->encoder_running, false, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+static int do_report_error(struct spa_loop *loop,
+			bool async,
+			uint32_t seq,
+			const void *data,
+			size_t size,
+			void *user_data)
+{
+	struct impl *this = user_data;
+	struct spa_event event = SPA_NODE_EVENT_INIT(SPA_NODE_EVENT_Error);
+
+	spa_node_emit_event(&this->hooks, &event);
 	return 0;
 }
 
-static int reduce_bitpool(struct impl *this)
+/* data loop: tell the main loop that the encoder thread stopped */
+static void check_encoder(struct impl *this)
 {
-	return set_bitpool(this, this->sbc.bitpool - 2);
+	int res;
+
+	if (SPA_LIKELY(__atomic_load_n(&this->encoder_running, __ATOMIC_ACQUIRE)) ||
+	    this->error_reported)
+		return;
+
+	res = __atomic_load_n(&this->encoder_error, __ATOMIC_RELAXED);
+	spa_log_error(this->log, NAME" %p: encoder stopped: %s", this, spa_strerror(res));
+	this->error_reported = true;
+
+	if (this->main_loop)
+		spa_loop_invoke(this->main_loop, do_report_error, 0, NULL, 0, false, this);
 }
 
-static int increase_bitpool(struct impl *this)
+/* data loop: copy PCM into the ring for the encoder */
+static int add_data(struct impl *this, const void *data, int size)
 {
-	return set_bitpool(this, this->sbc.bitpool + 1);
+	struct port *port = &this->port;
+	int32_t filled;
+	uint32_t index;
+
+	filled = spa_ringbuffer_get_write_index(&this->ring, &index);
+	size = SPA_MIN(size, RING_SIZE - filled);
+	size -= size % port->frame_size;
+	if (size <= 0)
+		return -ENOSPC;
+
+	spa_ringbuffer_write_data(&this->ring, this->ring_data, RING_SIZE,
+			index & RING_MASK, data, size);
+	spa_ringbuffer_write_update(&this->ring, index + size);
+
+	this->sample_time += size / port->frame_size;
+
+	return size;
 }
 
 static int flush_data(struct impl *this, uint64_t now_time)
 {
 	int written;
-	uint32_t total_frames;
+	uint32_t total_frames, write_samples;
 	uint64_t elapsed;
 	int64_t queued;
 	struct itimerspec ts;
@@ -560,18 +722,14 @@ static int flush_data(struct impl *this, uint64_t now_time)
 		l1 = n_bytes - l0;
 
 		written = add_data(this, src + offs, l0);
-		if (written > 0 && l1 > 0)
-			written += add_data(this, src, l1);
+		if (written > 0 && l1 > 0 && (uint32_t)written == l0) {
+			int w = add_data(this, src, l1);
+			if (w > 0)
+				written += w;
+		}
 		if (written <= 0) {
+			/* the encoder is behind, keep the buffer */
 			port->need_data = true;
-			if (written < 0 && written != -ENOSPC) {
-				spa_list_remove(&b->link);
-				b->outstanding = true;
-				spa_log_trace(this->log, NAME " %p: error %s, reuse buffer %u",
-						this, spa_strerror(written), b->id);
-				spa_node_call_reuse_buffer(&this->callbacks, 0, b->id);
-				port->ready_offset = 0;
-			}
 			break;
 		}
 
@@ -592,31 +750,8 @@ static int flush_data(struct impl *this, uint64_t now_time)
 		spa_log_trace(this->log, NAME " %p: written %u frames", this, total_frames);
 	}
 
-	written = flush_buffer(this, false);
-	if (written == -EAGAIN) {
-		spa_log_trace(this->log, NAME" %p: delay flush %"PRIu64, this, this->sample_time);
-		if ((this->flush_source.mask & SPA_IO_OUT) == 0) {
-			this->flush_source.mask = SPA_IO_OUT;
-			spa_loop_update_source(this->data_loop, &this->flush_source);
-			this->source.mask = 0;
-			spa_loop_update_source(this->data_loop, &this->source);
-			return 0;
-		}
-	}
-	else if (written < 0) {
-		spa_log_trace(this->log, NAME" %p: error flushing %s", this,
-				spa_strerror(written));
-		return written;
-	}
-	else if (written > 0) {
-		if (now_time - this->last_error > SPA_NSEC_PER_SEC * 3) {
-			increase_bitpool(this);
-			this->last_error = now_time;
-		}
-	}
-
-	this->flush_source.mask = 0;
-	spa_loop_update_source(this->data_loop, &this->flush_source);
+	if (total_frames > 0)
+		spa_system_eventfd_write(this->data_system, this->encoder_fd, 1);
 
 	if (now_time > this->start_time)
 		elapsed = now_time - this->start_time;
@@ -626,25 +761,21 @@ static int flush_data(struct impl *this, uint64_t now_time)
 	elapsed = elapsed * port->current_format.info.raw.rate / SPA_NSEC_PER_SEC;
 
 	queued = this->sample_time - elapsed;
+	write_samples = __atomic_load_n(&this->write_samples, __ATOMIC_RELAXED);
 
 	spa_log_trace(this->log, NAME" %p: %"PRIu64" %"PRIi64" %"PRIu64" %"PRIu64" %d", this,
-			now_time, queued, this->sample_time, elapsed, this->write_samples);
+			now_time, queued, this->sample_time, elapsed, write_samples);
 
 	if (!this->following) {
-		if (queued < FILL_FRAMES * this->write_samples) {
-			queued = (FILL_FRAMES + 1) * this->write_samples;
+		if (queued < FILL_FRAMES * write_samples) {
+			queued = (FILL_FRAMES + 1) * write_samples;
 			if (this->sample_time < elapsed) {
 				this->sample_time = queued;
 				this->start_time = now_time;
 			}
-			if (!spa_list_is_empty(&port->ready) &&
-			    now_time - this->last_error > SPA_NSEC_PER_SEC / 2) {
-				reduce_bitpool(this);
-				this->last_error = now_time;
-			}
 		}
 		calc_timeout(queued,
-			     FILL_FRAMES * this->write_samples,
+			     FILL_FRAMES * write_samples,
 			     port->current_format.info.raw.rate,
 			     &this->now, &ts.it_value);
 		ts.it_interval.tv_sec = 0;
@@ -659,33 +790,10 @@ static int flush_data(struct impl *this, uint64_t now_time)
 	return 0;
 }
 
-static void a2dp_on_flush(struct spa_source *source)
-{
-	struct impl *this = source->data;
-	uint64_t now_time;
-
-	spa_log_trace(this->log, NAME" %p: flushing", this);
-
-	if ((source->rmask & SPA_IO_OUT) == 0) {
-		spa_log_warn(this->log, NAME" %p: error %d", this, source->rmask);
-		if (this->flush_source.loop)
-			spa_loop_remove_source(this->data_loop, &this->flush_source);
-		this->source.mask = 0;
-		spa_loop_update_source(this->data_loop, &this->source);
-		return;
-	}
-
-	spa_system_clock_gettime(this->data_system, CLOCK_MONOTONIC, &this->now);
-	now_time = this->now.tv_sec * SPA_NSEC_PER_SEC + this->now.tv_nsec;
-
-	flush_data(this, now_time);
-}
-
 static void a2dp_on_timeout(struct spa_source *source)
 {
 	struct impl *this = source->data;
 	struct port *port = &this->port;
-	int err;
 	uint64_t exp, now_time;
 	struct spa_io_buffers *io = port->io;
 
@@ -699,11 +807,10 @@ static void a2dp_on_timeout(struct spa_source *source)
 			now_time, now_time - this->last_time);
 	this->last_time = now_time;
 
-	if (this->start_time == 0) {
-		if ((err = fill_socket(this, now_time)) < 0)
-			spa_log_error(this->log, "error fill socket %s", spa_strerror(err));
+	if (this->start_time == 0)
 		this->start_time = now_time;
-	}
+
+	check_encoder(this);
 
 	if (spa_list_is_empty(&port->ready) || port->need_data) {
 		spa_log_trace(this->log, NAME " %p: %d", this, io->status);
@@ -716,83 +823,58 @@ static void a2dp_on_timeout(struct spa_source *source)
 }
 
 
-static int init_sbc(struct impl *this)
+static int init_codec(struct impl *this)
 {
-        struct spa_bt_transport *transport = this->transport;
-	a2dp_sbc_t *conf;
+	struct spa_bt_transport *transport = this->transport;
+	struct port *port = &this->port;
 
 	spa_return_val_if_fail(transport, -EIO);
 
-	conf = transport->configuration;
-
-	sbc_init(&this->sbc, 0);
-	this->sbc.endian = SBC_LE;
+	if ((this->codec = transport->a2dp_codec) == NULL)
+		return -ENOTSUP;
 
-	if (conf->frequency & SBC_SAMPLING_FREQ_48000)
-		this->sbc.frequency = SBC_FREQ_48000;
-	else if (conf->frequency & SBC_SAMPLING_FREQ_44100)
-		this->sbc.frequency = SBC_FREQ_44100;
-	else if (conf->frequency & SBC_SAMPLING_FREQ_32000)
-		this->sbc.frequency = SBC_FREQ_32000;
-	else if (conf->frequency & SBC_SAMPLING_FREQ_16000)
-		this->sbc.frequency = SBC_FREQ_16000;
-	else
-		return -EINVAL;
+	this->write_size = SPA_MIN(transport->write_mtu, sizeof(this->buffer));
 
-	if (conf->channel_mode & SBC_CHANNEL_MODE_JOINT_STEREO)
-		this->sbc.mode = SBC_MODE_JOINT_STEREO;
-	else if (conf->channel_mode & SBC_CHANNEL_MODE_STEREO)
-		this->sbc.mode = SBC_MODE_STEREO;
-	else if (conf->channel_mode & SBC_CHANNEL_MODE_DUAL_CHANNEL)
-		this->sbc.mode = SBC_MODE_DUAL_CHANNEL;
-	else if (conf->channel_mode & SBC_CHANNEL_MODE_MONO)
-		this->sbc.mode = SBC_MODE_MONO;
-	else
-		return -EINVAL;
+	this->codec_data = this->codec->init(this->codec,
+			transport->configuration, transport->configuration_len,
+			&port->current_format.info.raw, this->write_size);
+	if (this->codec_data == NULL)
+		return -errno;
 
-	switch (conf->subbands) {
-	case SBC_SUBBANDS_4:
-		this->sbc.subbands = SBC_SB_4;
-		break;
-	case SBC_SUBBANDS_8:
-		this->sbc.subbands = SBC_SB_8;
-		break;
-	default:
+	update_block_size(this);
+	if (this->block_size <= 0 || this->block_size > MAX_CODESIZE) {
+		spa_log_error(this->log, NAME " %p: invalid block size %d",
+				this, this->block_size);
+		this->codec->deinit(this->codec_data);
+		this->codec_data = NULL;
 		return -EINVAL;
 	}
 
-	if (conf->allocation_method & SBC_ALLOCATION_LOUDNESS)
-		this->sbc.allocation = SBC_AM_LOUDNESS;
-	else
-		this->sbc.allocation = SBC_AM_SNR;
-
-	switch (conf->block_length) {
-	case SBC_BLOCK_LENGTH_4:
-		this->sbc.blocks = SBC_BLK_4;
-		break;
-	case SBC_BLOCK_LENGTH_8:
-		this->sbc.blocks = SBC_BLK_8;
-		break;
-	case SBC_BLOCK_LENGTH_12:
-		this->sbc.blocks = SBC_BLK_12;
-		break;
-	case SBC_BLOCK_LENGTH_16:
-		this->sbc.blocks = SBC_BLK_16;
-		break;
-	default:
-		return -EINVAL;
-	}
+	this->seqnum = 0;
 
-	this->min_bitpool = SPA_MAX(conf->min_bitpool, 12);
-	this->max_bitpool = conf->max_bitpool;
+	spa_log_debug(this->log, NAME " %p: codec %s block_size %d write_size %d",
+			this, this->codec->name, this->block_size, this->write_size);
 
-	set_bitpool(this, conf->max_bitpool);
+	return 0;
+}
 
-	this->seqnum = 0;
+static int do_remove_source(struct spa_loop *loop,
+			    bool async,
+			    uint32_t seq,
+			    const void *data,
+			    size_t size,
+			    void *user_data)
+{
+	struct impl *this = user_data;
+	struct itimerspec ts;
 
-        spa_log_debug(this->log, NAME " %p: codesize %d frame_length %d size %d:%d %d",
-			this, this->codesize, this->frame_length, this->read_size, this->write_size,
-			this->sbc.bitpool);
+	if (this->source.loop)
+		spa_loop_remove_source(this->data_loop, &this->source);
+	ts.it_value.tv_sec = 0;
+	ts.it_value.tv_nsec = 0;
+	ts.it_interval.tv_sec = 0;
+	ts.it_interval.tv_nsec = 0;
+	spa_system_timerfd_settime(this->data_system, this->timerfd, 0, &ts, NULL);
 
 	return 0;
 }
@@ -814,7 +896,12 @@ static int do_start(struct impl *this)
 	if ((res = spa_bt_transport_acquire(this->transport, false)) < 0)
 		return res;
 
-	init_sbc(this);
+	if ((res = init_codec(this)) < 0) {
+		spa_log_error(this->log, NAME " %p: can't init codec: %s",
+				this, spa_strerror(res));
+		spa_bt_transport_release(this->transport);
+		return res;
+	}
 
 	val = FILL_FRAMES * this->transport->write_mtu;
 	if (setsockopt(this->transport->fd, SOL_SOCKET, SO_SNDBUF, &val, sizeof(val)) < 0)
@@ -826,6 +913,7 @@ static int do_start(struct impl *this)
 	}
 	else {
 		spa_log_debug(this->log, NAME " %p: SO_SNDBUF: %d", this, val);
+		this->sndbuf = val;
 	}
 
 	val = FILL_FRAMES * this->transport->read_mtu;
@@ -845,40 +933,41 @@ static int do_start(struct impl *this)
 	this->source.rmask = 0;
 	spa_loop_add_source(this->data_loop, &this->source);
 
-	this->flush_source.data = this;
-	this->flush_source.fd = this->transport->fd;
-	this->flush_source.func = a2dp_on_flush;
-	this->flush_source.mask = 0;
-	this->flush_source.rmask = 0;
-	spa_loop_add_source(this->data_loop, &this->flush_source);
+	spa_ringbuffer_init(&this->ring);
+	a2dp_rate_control_init(&this->rate_control, TARGET_QUEUE_DELAY);
+	this->queue_delay = 0;
+
+	this->encoder_fd = spa_system_eventfd_create(this->data_system,
+			SPA_FD_CLOEXEC | SPA_FD_NONBLOCK);
+	if (this->encoder_fd < 0) {
+		res = this->encoder_fd;
+		goto error_release;
+	}
+	this->encoder_running = true;
+	this->encoder_error = 0;
+	this->error_reported = false;
+	if ((res = pthread_create(&this->encoder, NULL, encoder_thread, this)) != 0) {
+		spa_log_error(this->log, NAME " %p: can't create encoder thread: %s",
+				this, strerror(res));
+		res = -res;
+		goto error_close;
+	}
 
 	set_timers(this);
 	this->started = true;
 
 	return 0;
-}
-
-static int do_remove_source(struct spa_loop *loop,
-			    bool async,
-			    uint32_t seq,
-			    const void *data,
-			    size_t size,
-			    void *user_data)
-{
-	struct impl *this = user_data;
-	struct itimerspec ts;
-
-	if (this->source.loop)
-		spa_loop_remove_source(this->data_loop, &this->source);
-	ts.it_value.tv_sec = 0;
-	ts.it_value.tv_nsec = 0;
-	ts.it_interval.tv_sec = 0;
-	ts.it_interval.tv_nsec = 0;
-	spa_system_timerfd_settime(this->data_system, this->timerfd, 0, &ts, NULL);
-	if (this->flush_source.loop)
-		spa_loop_remove_source(this->data_loop, &this->flush_source);
 
-	return 0;
+error_close:
+	this->encoder_running = false;
+	spa_system_close(this->data_system, this->encoder_fd);
+	this->encoder_fd = -1;
+error_release:
+	spa_loop_invoke(this->data_loop, do_remove_source, 0, NULL, 0, true, this);
+	this->codec->deinit(this->codec_data);
+	this->codec_data = NULL;
+	spa_bt_transport_release(this->transport);
+	return res;
 }
 
 static int do_stop(struct impl *this)
@@ -892,6 +981,15 @@ static int do_stop(struct impl *this)
 
 	spa_loop_invoke(this->data_loop, do_remove_source, 0, NULL, 0, true, this);
 
+	__atomic_store_n(&this->encoder_running, false, __ATOMIC_RELEASE);
+	spa_system_eventfd_write(this->data_system, this->encoder_fd, 1);
+	pthread_join(this->encoder, NULL);
+	spa_system_close(this->data_system, this->encoder_fd);
+	this->encoder_fd = -1;
+
+	this->codec->deinit(this->codec_data);
+	this->codec_data = NULL;
+
 	this->started = false;
 
 	if (this->transport)
@@ -1047,53 +1145,24 @@ impl_node_port_enum_params(void *object, int seq,
 
 	switch (id) {
 	case SPA_PARAM_EnumFormat:
+	{
+		const struct a2dp_codec *codec;
+		struct spa_audio_info_raw info;
+
 		if (result.index > 0)
 			return 0;
 		if (this->transport == NULL)
 			return -EIO;
+		if ((codec = this->transport->a2dp_codec) == NULL)
+			return -EIO;
 
-		switch (this->transport->codec) {
-		case A2DP_CODEC_SBC:
-		{
-			a2dp_sbc_t *config = this->transport->configuration;
-			struct spa_audio_info_raw info = { 0, };
-			int res;
-
-			info.format = SPA_AUDIO_FORMAT_S16;
-			if ((res = a2dp_sbc_get_frequency(config)) < 0)
-				return -EIO;
-			info.rate = res;
-			if ((res = a2dp_sbc_get_channels(config)) < 0)
-				return -EIO;
-			info.channels = res;
-
-			switch (info.channels) {
-			case 1:
-				info.position[0] = SPA_AUDIO_CHANNEL_MONO;
-				break;
-			case 2:
-				info.position[0] = SPA_AUDIO_CHANNEL_FL;
-				info.position[1] = SPA_AUDIO_CHANNEL_FR;
-				break;
-			default:
-				return -EIO;
-			}
-
-			param = spa_format_audio_raw_build(&b, id, &info);
-			break;
-		}
-		case A2DP_CODEC_MPEG24:
-		{
-			param = spa_pod_builder_add_object(&b,
-				SPA_TYPE_OBJECT_Format, id,
-				SPA_FORMAT_mediaType,     SPA_POD_Id(SPA_MEDIA_TYPE_audio),
-				SPA_FORMAT_mediaSubtype,  SPA_POD_Id(SPA_MEDIA_SUBTYPE_aac));
-			break;
-		}
-		default:
+		if (codec->get_info(codec, this->transport->configuration,
+				this->transport->configuration_len, &info) < 0)
 			return -EIO;
-		}
+
+		param = spa_format_audio_raw_build(&b, id, &info);
 		break;
+	}
 
 	case SPA_PARAM_Format:
 		if (!port->have_format)
@@ -1160,6 +1229,31 @@ static int clear_buffers(struct impl *this, struct port *port)
 	return 0;
 }
 
+/* the format must be the one of the codec configuration, see EnumFormat */
+static int check_format(struct impl *this, const struct spa_audio_info_raw *info)
+{
+	const struct a2dp_codec *codec;
+	struct spa_audio_info_raw codec_info;
+
+	if (this->transport == NULL)
+		return -EIO;
+	if ((codec = this->transport->a2dp_codec) == NULL)
+		return -EIO;
+	if (codec->get_info(codec, this->transport->configuration,
+			this->transport->configuration_len, &codec_info) < 0)
+		return -EIO;
+
+	if (info->format != codec_info.format ||
+	    info->rate != codec_info.rate ||
+	    info->channels != codec_info.channels) {
+		spa_log_warn(this->log, NAME" %p: format %u/%u/%u does not match codec %s %u/%u/%u",
+				this, info->format, info->rate, info->channels, codec->name,
+				codec_info.format, codec_info.rate, codec_info.channels);
+		return -EINVAL;
+	}
+	return 0;
+}
+
 static int port_set_format(struct impl *this, struct port *port,
 			   uint32_t flags,
 			   const struct spa_pod *format)
@@ -1183,7 +1277,20 @@ static int port_set_format(struct impl *this, struct port *port,
 		if (spa_format_audio_raw_parse(format, &info.info.raw) < 0)
 			return -EINVAL;
 
-		port->frame_size = info.info.raw.channels * 2;
+		if ((err = check_format(this, &info.info.raw)) < 0)
+			return err;
+
+		switch (info.info.raw.format) {
+		case SPA_AUDIO_FORMAT_S16:
+			port->frame_size = 2;
+			break;
+		case SPA_AUDIO_FORMAT_S24:
+			port->frame_size = 3;
+			break;
+		default:
+			return -EINVAL;
+		}
+		port->frame_size *= info.info.raw.channels;
 		port->current_format = info;
 		port->have_format = true;
 		this->threshold = this->props.min_latency;
@@ -1428,6 +1535,7 @@ impl_init(const struct spa_handle_factory *factory,
 	this = (struct impl *) handle;
 
 	this->log = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_Log);
+	this->main_loop = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_Loop);
 	this->data_loop = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_DataLoop);
 	this->data_system = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_DataSystem);
 
@@ -1486,6 +1594,7 @@ impl_init(const struct spa_handle_factory *factory,
 
 	this->timerfd = spa_system_timerfd_create(this->data_system,
 			CLOCK_MONOTONIC, SPA_FD_CLOEXEC | SPA_FD_NONBLOCK);
+	this->encoder_fd = -1;
 
 	return 0;
 }
@@ -28,6 +28,8 @@
 #include <stdio.h>
 #include <time.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 
@@ -39,6 +41,7 @@
 #include <spa/utils/keys.h>
 #include <spa/utils/names.h>
 #include <spa/utils/result.h>
+#include <spa/utils/ringbuffer.h>
 #include <spa/monitor/device.h>
 
 #include <spa/node/node.h>
@@ -50,11 +53,10 @@
 #include <spa/param/audio/format-utils.h>
 #include <spa/pod/filter.h>
 
-#include <sbc/sbc.h>
-
 #include "defs.h"
 #include "rtp.h"
 #include "a2dp-codecs.h"
+#include "jitter-buffer.h"
 
 struct props {
 	uint32_t min_latency;
@@ -64,6 +66,13 @@ struct props {
 #define FILL_FRAMES 2
 #define MAX_BUFFERS 32
 
+#define JB_SIZE		(1u << 17)
+#define JB_MIN_TARGET	20	/* ms */
+#define JB_MAX_TARGET	200	/* ms */
+
+#define RING_SIZE	(1u << 16)
+#define RING_MASK	(RING_SIZE - 1)
+
 struct buffer {
 	uint32_t id;
 	unsigned int outstanding:1;
@@ -80,6 +89,7 @@ struct port {
 	uint64_t info_all;
 	struct spa_port_info info;
 	struct spa_io_buffers *io;
+	struct spa_io_rate_match *rate_match;
 	struct spa_param_info params[8];
 
 	struct buffer buffers[MAX_BUFFERS];
@@ -96,6 +106,7 @@ struct impl {
 	struct spa_node node;
 
 	struct spa_log *log;
+	struct spa_loop *main_loop;
 	struct spa_loop *data_loop;
 	struct spa_system *data_system;
 
@@ -115,15 +126,32 @@ struct impl {
 	unsigned int started:1;
 	unsigned int following:1;
 
+	/* the decoder thread reads and decodes the socket into the ring and
+	 * wakes up the data loop, which only copies the PCM out */
 	struct spa_source source;
+	struct spa_ringbuffer ring;
+	uint8_t ring_data[RING_SIZE];
+	pthread_t decoder;
+	int decoder_fd;
+	int decoder_running;
+	int decoder_error;		/* set by the decoder thread when it fails */
+	unsigned int error_reported:1;
 
 	struct spa_io_clock *clock;
         struct spa_io_position *position;
 
-	sbc_t sbc;
+	const struct a2dp_codec *codec;
+	void *codec_data;
 	uint8_t buffer_read[4096];
 	struct timespec now;
 	uint32_t sample_count;
+
+	/* when following, decoded audio goes here and process() takes
+	 * as much as the resampler asks for */
+	struct jitter_buffer jb;
+	uint8_t jb_data[JB_SIZE];
+	uint8_t buffer_decode[16384];	/* decoder thread */
+	uint8_t buffer_copy[4096];	/* data loop */
 };
 
 #define NAME "a2dp-source"
@@ -216,6 +244,16 @@ static int impl_node_enum_params(void *object, int seq,
 	return 0;
 }
 
+static void reset_jitter_buffer(struct impl *this)
+{
+	struct port *port = &this->port;
+	uint32_t rate = port->current_format.info.raw.rate;
+
+	jitter_buffer_init(&this->jb, this->jb_data, sizeof(this->jb_data),
+			port->frame_size, rate,
+			rate * JB_MIN_TARGET / 1000, rate * JB_MAX_TARGET / 1000);
+}
+
 static int do_reassing_follower(struct spa_loop *loop,
 			bool async,
 			uint32_t seq,
@@ -223,6 +261,11 @@ static int do_reassing_follower(struct spa_loop *loop,
 			size_t size,
 			void *user_data)
 {
+	struct impl *this = user_data;
+
+	reset_jitter_buffer(this);
+	if (this->port.rate_match)
+		SPA_FLAG_CLEAR(this->port.rate_match->flags, SPA_IO_RATE_MATCH_FLAG_ACTIVE);
 	return 0;
 }
 
@@ -301,28 +344,193 @@ static void reset_buffers(struct port *port)
 	}
 }
 
-static void decode_sbc_data(struct impl *this, uint8_t *src, size_t src_size)
+/* decoder thread: decode one packet into the ring, returns the number of
+ * bytes added */
+static int decode_packet(struct impl *this, uint8_t *src, size_t src_size)
 {
-	const size_t header_size = sizeof(struct rtp_header) + sizeof(struct rtp_payload);
-	struct port *port = &this->port;
-	struct spa_io_buffers *io = port->io;
-	int32_t io_done_status = io->status;
-	struct buffer *buffer;
-	struct spa_data *data;
-	uint8_t *dest;
-	size_t decoded, dest_size, written;
-
-	if (src_size <= header_size) {
+	uint8_t *dest = this->buffer_decode;
+	size_t dest_size = sizeof(this->buffer_decode), written;
+	int32_t filled;
+	uint32_t index, total;
+	int header_size, decoded;
+
+	header_size = this->codec->start_decode(this->codec_data,
+			src, src_size, NULL, NULL);
+	if (header_size < 0) {
 		spa_log_error(this->log, "not valid header found. dropping data...");
-		return;
+		return 0;
 	}
 
 	/* Skip the header */
 	src += header_size;
 	src_size -= header_size;
 
-	/* Decode data if we have a buffer free */
-	if (!spa_list_is_empty(&port->free)) {
+	while (src_size > 0 && dest_size > 0) {
+		decoded = this->codec->decode(this->codec_data,
+			src, src_size, dest, dest_size, &written);
+		if (decoded <= 0) {
+			spa_log_error(this->log, "Decoding error. (%d)", decoded);
+			break;
+		}
+		src_size -= decoded;
+		src += decoded;
+		dest_size -= written;
+		dest += written;
+	}
+	total = sizeof(this->buffer_decode) - dest_size;
+
+	filled = spa_ringbuffer_get_write_index(&this->ring, &index);
+	if (filled < 0 || (uint32_t)filled + total > RING_SIZE) {
+		spa_log_trace(this->log, NAME" %p: ring full, dropping %u bytes", this, total);
+		return 0;
+	}
+	spa_ringbuffer_write_data(&this->ring, this->ring_data, RING_SIZE,
+			index & RING_MASK, this->buffer_decode, total);
+	spa_ringbuffer_write_update(&this->ring, index + total);
+
+	return total;
+}
+
+static void *decoder_thread(void *data)
+{
+	struct impl *this = data;
+	struct pollfd pfd[2];
+	uint64_t count;
+	ssize_t size_read;
+	int res, fd = this->transport->fd;
+
+	spa_log_debug(this->log, NAME" %p: decoder thread started", this);
+
+	pfd[0].fd = this->decoder_fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = fd;
+	pfd[1].events = POLLIN;
+
+	while (__atomic_load_n(&this->decoder_running, __ATOMIC_ACQUIRE)) {
+		if (poll(pfd, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			res = -errno;
+			spa_log_error(this->log, NAME" %p: poll error: %m", this);
+			goto error;
+		}
+		if (pfd[0].revents & POLLIN)
+			spa_system_eventfd_read(this->data_system, this->decoder_fd, &count);
+
+		if (pfd[1].revents & (POLLERR | POLLHUP)) {
+			res = -EPIPE;
+			spa_log_warn(this->log, NAME" %p: socket error %d", this, pfd[1].revents);
+			goto error;
+		}
+		if ((pfd[1].revents & POLLIN) == 0)
+			continue;
+
+		size_read = read(fd, this->buffer_read, sizeof(this->buffer_read));
+		spa_log_trace(this->log, "read socket data %zd", size_read);
+		if (size_read == 0) {
+			res = -EPIPE;
+			goto error;
+		}
+		if (size_read < 0) {
+			if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+				continue;
+			res = -errno;
+			spa_log_error(this->log, "read error: %s", strerror(errno));
+			goto error;
+		}
+
+		if (decode_packet(this, this->buffer_read, size_read) > 0)
+			spa_system_eventfd_write(this->data_system, this->source.fd, 1);
+	}
+	spa_log_debug(this->log, NAME" %p: decoder thread stopped", this);
+	return NULL;
+
+error:
+	/* wake up the data loop so that it reports the error */
+	__atomic_store_n(&this->decoder_error, res, __ATOMIC_RELAXED);
+	__atomic_store_n(&this->decoder_running, false, __ATOMIC_RELEASE);
+	spa_system_eventfd_write(this->data_system, this->source.fd, 1);
+	return NULL;
+}
+
+static int do_report_error(struct spa_loop *loop,
+			bool async,
+			uint32_t seq,
+			const void *data,
+			size_t size,
+			void *user_data)
+{
+	struct impl *this = user_data;
+	struct spa_event event = SPA_NODE_EVENT_INIT(SPA_NODE_EVENT_Error);
+
+	spa_node_emit_event(&this->hooks, &event);
+	return 0;
+}
+
+/* data loop: tell the main loop that the decoder thread stopped */
+static void check_decoder(struct impl *this)
+{
+	int res;
+
+	if (SPA_LIKELY(__atomic_load_n(&this->decoder_running, __ATOMIC_ACQUIRE)) ||
+	    this->error_reported)
+		return;
+
+	res = __atomic_load_n(&this->decoder_error, __ATOMIC_RELAXED);
+	spa_log_error(this->log, NAME" %p: decoder stopped: %s", this, spa_strerror(res));
+	this->error_reported = true;
+
+	if (this->main_loop)
+		spa_loop_invoke(this->main_loop, do_report_error, 0, NULL, 0, false, this);
+}
+
+/* data loop: move the decoded data into the jitter buffer */
+static void ring_to_jitter_buffer(struct impl *this)
+{
+	struct port *port = &this->port;
+	int32_t avail;
+	uint32_t index, size, frames;
+
+	while (true) {
+		avail = spa_ringbuffer_get_read_index(&this->ring, &index);
+		size = SPA_MIN((uint32_t)SPA_MAX(avail, 0), sizeof(this->buffer_copy));
+		size -= size % port->frame_size;
+		if (size == 0)
+			break;
+
+		spa_ringbuffer_read_data(&this->ring, this->ring_data, RING_SIZE,
+				index & RING_MASK, this->buffer_copy, size);
+		spa_ringbuffer_read_update(&this->ring, index + size);
+
+		frames = size / port->frame_size;
+		jitter_buffer_write(&this->jb, this->buffer_copy, frames);
+		this->sample_count += frames;
+	}
+}
+
+/* data loop: put the decoded data in the free buffers */
+static void ring_to_buffers(struct impl *this)
+{
+	struct port *port = &this->port;
+	struct buffer *buffer;
+	struct spa_data *data;
+	int32_t avail;
+	uint32_t index, size;
+
+	while (true) {
+		avail = spa_ringbuffer_get_read_index(&this->ring, &index);
+		avail -= avail % port->frame_size;
+		if (avail <= 0)
+			break;
+
+		if (spa_list_is_empty(&port->free)) {
+			/* nobody takes the data, drop it to keep the latency low */
+			spa_log_trace(this->log, NAME" %p: no buffers, dropping %d bytes",
+					this, avail);
+			spa_ringbuffer_read_update(&this->ring, index + avail);
+			break;
+		}
+
 		/* Get the free buffer and remove it from the free list */
 		buffer = spa_list_first(&port->free, struct buffer, link);
 		spa_list_remove(&buffer->link);
@@ -334,47 +542,50 @@ static void decode_sbc_data(struct impl *this, uint8_t *src, size_t src_size)
 			buffer->h->dts_offset = 0;
 		}
 
-		/* get the dest data values */
 		data = buffer->buf->datas;
-		dest = data[0].data;
-		dest_size = data[0].maxsize;
-
-		/* decode the source data */
-		spa_log_debug(this->log, "decoding data for buffer_id=%d %zd %zd",
-				buffer->id, src_size, dest_size);
-		while (src_size > 0 && dest_size > 0) {
-			decoded = sbc_decode(&this->sbc,
-				src, src_size,
-				dest, dest_size, &written);
-			if (decoded <= 0) {
-				spa_log_error(this->log, "Decoding error. (%zd)", decoded);
-				return;
-			}
-
-			/* update source and dest pointers */
-			src_size -= decoded;
-			src += decoded;
-			dest_size -= written;
-			dest += written;
-		}
+		size = SPA_MIN((uint32_t)avail, data[0].maxsize);
+		size -= size % port->frame_size;
 
-		/* make sure all data has been decoded */
-		spa_assert(src_size <= 0);
+		spa_ringbuffer_read_data(&this->ring, this->ring_data, RING_SIZE,
+				index & RING_MASK, data[0].data, size);
+		spa_ringbuffer_read_update(&this->ring, index + size);
 
-		/* set the decoded data */
 		data[0].chunk->offset = 0;
-		data[0].chunk->size = data[0].maxsize - dest_size;
+		data[0].chunk->size = size;
 		data[0].chunk->stride = port->frame_size;
 
-		/* update the sample count */
-		this->sample_count += data[0].chunk->size / port->frame_size;
+		this->sample_count += size / port->frame_size;
 
-		/* add the buffer to the queue */
-		spa_log_debug(this->log, "data decoded %d successfully for buffer_id=%d",
+		spa_log_trace(this->log, "data decoded %d successfully for buffer_id=%d",
 				data[0].chunk->size, buffer->id);
 		buffer->outstanding = true;
 		spa_list_append(&port->ready, &buffer->link);
 	}
+}
+
+static void a2dp_on_decoded(struct spa_source *source)
+{
+	struct impl *this = source->data;
+	struct port *port = &this->port;
+	struct spa_io_buffers *io = port->io;
+	int32_t io_done_status = io->status;
+	struct buffer *buffer;
+	uint64_t count;
+
+	if (spa_system_eventfd_read(this->data_system, source->fd, &count) < 0)
+		spa_log_warn(this->log, NAME" %p: error reading eventfd: %m", this);
+
+	check_decoder(this);
+
+	/* update the current pts */
+	spa_system_clock_gettime(this->data_system, CLOCK_MONOTONIC, &this->now);
+
+	if (this->following) {
+		ring_to_jitter_buffer(this);
+		return;
+	}
+
+	ring_to_buffers(this);
 
 	/* Process a buffer if there is one ready and IO does not have one */
 	if (!spa_list_is_empty(&port->ready) && io->status != SPA_STATUS_HAVE_DATA) {
@@ -397,70 +608,107 @@ static void decode_sbc_data(struct impl *this, uint8_t *src, size_t src_size)
 	spa_node_call_ready(&this->callbacks, io_done_status);
 }
 
-static void a2dp_on_ready_read(struct spa_source *source)
+static int do_remove_source(struct spa_loop *loop,
+			    bool async,
+			    uint32_t seq,
+			    const void *data,
+			    size_t size,
+			    void *user_data)
 {
-	struct impl *this = source->data;
-	const ssize_t buffer_size = sizeof(this->buffer_read);
-	ssize_t size_read;
+	struct impl *this = user_data;
 
-	/* make sure the source is an input */
-	if ((source->rmask & SPA_IO_IN) == 0) {
-		spa_log_error(this->log, "source is not an input, rmask=%d", source->rmask);
-		goto stop;
-	}
-	if (this->transport == NULL) {
-		spa_log_debug(this->log, "no transport, stop reading");
-		goto stop;
-	}
+	if (this->source.loop)
+		spa_loop_remove_source(this->data_loop, &this->source);
 
-	/* update the current pts */
-	spa_system_clock_gettime(this->data_system, CLOCK_MONOTONIC, &this->now);
+	return 0;
+}
 
-again:
-	/* read data from socket */
-	size_read = read(this->transport->fd, this->buffer_read, buffer_size);
-	spa_log_debug(this->log, "read socket data %zd/%zd", size_read, buffer_size);
+static void stop_decoder(struct impl *this)
+{
+	if (this->decoder_fd < 0)
+		return;
 
-	if (size_read == 0) {
-		goto stop;
-	}
-	else if (size_read < 0) {
-		/* retry if interrupted */
-		if (errno == EINTR)
-			goto again;
-
-		/* return socked has no data */
-		if (errno == EAGAIN || errno == EWOULDBLOCK)
-		    return;
-
-		/* go to 'stop' if socket has an error */
-		spa_log_error(this->log, "read error: %s", strerror(errno));
-		goto stop;
-	}
+	__atomic_store_n(&this->decoder_running, false, __ATOMIC_RELEASE);
+	spa_system_eventfd_write(this->data_system, this->decoder_fd, 1);
+	pthread_join(this->decoder, NULL);
 
-	/* make sure size_read is not bigger than the buffer_size */
-	spa_assert(size_read <= buffer_size);
+	spa_loop_invoke(this->data_loop, do_remove_source, 0, NULL, 0, true, this);
 
-	/* decode the data */
-	decode_sbc_data(this, this->buffer_read, size_read);
+	spa_system_close(this->data_system, this->decoder_fd);
+	this->decoder_fd = -1;
+	spa_system_close(this->data_system, this->source.fd);
+	this->source.fd = -1;
+}
 
-	/* done reading */
-	return;
+static int start_decoder(struct impl *this)
+{
+	int res;
 
-stop:
-	if (this->source.loop)
-		spa_loop_remove_source(this->data_loop, &this->source);
+	spa_ringbuffer_init(&this->ring);
+	this->sample_count = 0;
+
+	if ((res = spa_system_eventfd_create(this->data_system,
+					SPA_FD_CLOEXEC | SPA_FD_NONBLOCK)) < 0)
+		return res;
+	this->source.fd = res;
+
+	if ((res = spa_system_eventfd_create(this->data_system,
+					SPA_FD_CLOEXEC | SPA_FD_NONBLOCK)) < 0)
+		goto error_close;
+	this->decoder_fd = res;
+
+	this->source.data = this;
+	this->source.func = a2dp_on_decoded;
+	this->source.mask = SPA_IO_IN;
+	this->source.rmask = 0;
+	spa_loop_add_source(this->data_loop, &this->source);
+
+	this->decoder_running = true;
+	this->decoder_error = 0;
+	this->error_reported = false;
+	if ((res = pthread_create(&this->decoder, NULL, decoder_thread, this)) != 0) {
+		spa_log_error(this->log, NAME " %p: can't create decoder thread: %s",
+				this, strerror(res));
+		res = -res;
+		goto error_remove;
+	}
+	return 0;
+
+error_remove:
+	this->decoder_running = false;
+	spa_loop_invoke(this->data_loop, do_remove_source, 0, NULL, 0, true, this);
+	spa_system_close(this->data_system, this->decoder_fd);
+	this->decoder_fd = -1;
+error_close:
+	spa_system_close(this->data_system, this->source.fd);
+	this->source.fd = -1;
+	return res;
 }
 
 static int transport_start(struct impl *this)
 {
 	int res, val;
 
+	stop_decoder(this);
+
 	if ((res = spa_bt_transport_acquire(this->transport, false)) < 0)
 		return res;
 
-	sbc_init_a2dp(&this->sbc, 0, this->transport->configuration,
-		this->transport->configuration_len);
+	if (this->codec_data)
+		this->codec->deinit(this->codec_data);
+
+	if ((this->codec = this->transport->a2dp_codec) == NULL) {
+		res = -ENOTSUP;
+		goto error_release;
+	}
+
+	this->codec_data = this->codec->init(this->codec,
+			this->transport->configuration, this->transport->configuration_len,
+			&this->port.current_format.info.raw, this->transport->read_mtu);
+	if (this->codec_data == NULL) {
+		res = -errno;
+		goto error_release;
+	}
 
 	val = fcntl(this->transport->fd, F_GETFL);
 	fcntl(this->transport->fd, F_SETFL, val | O_NONBLOCK);
@@ -478,17 +726,21 @@ static int transport_start(struct impl *this)
 		spa_log_warn(this->log, "SO_PRIORITY failed: %m");
 
 	reset_buffers(&this->port);
+	reset_jitter_buffer(this);
 
-	this->source.data = this;
-	this->source.fd = this->transport->fd;
-	this->source.func = a2dp_on_ready_read;
-	this->source.mask = SPA_IO_IN;
-	this->source.rmask = 0;
-	spa_loop_add_source(this->data_loop, &this->source);
-
-	this->sample_count = 0;
+	if ((res = start_decoder(this)) < 0)
+		goto error_deinit;
 
 	return 0;
+
+error_deinit:
+	this->codec->deinit(this->codec_data);
+	this->codec_data = NULL;
+
+error_release:
+	spa_log_error(this->log, NAME" %p: can't init codec: %s", this, spa_strerror(res));
+	spa_bt_transport_release(this->transport);
+	return res;
 }
 
 static int do_start(struct impl *this)
@@ -502,6 +754,8 @@ static int do_start(struct impl *this)
 
 	spa_return_val_if_fail(this->transport != NULL, -EIO);
 
+	this->following = is_following(this);
+
 	if (this->transport->state >= SPA_BT_TRANSPORT_STATE_PENDING)
 		res = transport_start(this);
 
@@ -510,21 +764,6 @@ static int do_start(struct impl *this)
 	return res;
 }
 
-static int do_remove_source(struct spa_loop *loop,
-			    bool async,
-			    uint32_t seq,
-			    const void *data,
-			    size_t size,
-			    void *user_data)
-{
-	struct impl *this = user_data;
-
-	if (this->source.loop)
-		spa_loop_remove_source(this->data_loop, &this->source);
-
-	return 0;
-}
-
 static int do_stop(struct impl *this)
 {
 	int res;
@@ -534,7 +773,7 @@ static int do_stop(struct impl *this)
 
 	spa_log_debug(this->log, NAME" %p: stop", this);
 
-	spa_loop_invoke(this->data_loop, do_remove_source, 0, NULL, 0, true, this);
+	stop_decoder(this);
 
 	this->started = false;
 
@@ -543,7 +782,9 @@ static int do_stop(struct impl *this)
 	else
 		res = 0;
 
-	sbc_finish(&this->sbc);
+	if (this->codec_data)
+		this->codec->deinit(this->codec_data);
+	this->codec_data = NULL;
 
 	return res;
 }
@@ -694,51 +935,24 @@ impl_node_port_enum_params(void *object, int seq,
 
 	switch (id) {
 	case SPA_PARAM_EnumFormat:
+	{
+		const struct a2dp_codec *codec;
+		struct spa_audio_info_raw info;
+
 		if (result.index > 0)
 			return 0;
 		if (this->transport == NULL)
 			return -EIO;
-
-		switch (this->transport->codec) {
-		case A2DP_CODEC_SBC:
-		{
-			a2dp_sbc_t *config = this->transport->configuration;
-			struct spa_audio_info_raw info = { 0, };
-			int res;
-
-			info.format = SPA_AUDIO_FORMAT_S16;
-			if ((res = a2dp_sbc_get_frequency(config)) < 0)
-				return -EIO;
-			info.rate = res;
-			if ((res = a2dp_sbc_get_channels(config)) < 0)
-				return -EIO;
-			info.channels = res;
-
-			switch (info.channels) {
-			case 1:
-				info.position[0] = SPA_AUDIO_CHANNEL_MONO;
-				break;
-			case 2:
-				info.position[0] = SPA_AUDIO_CHANNEL_FL;
-				info.position[1] = SPA_AUDIO_CHANNEL_FR;
-				break;
-			default:
-				return -EIO;
-			}
-
-			param = spa_format_audio_raw_build(&b, id, &info);
-			break;
-		}
-		case A2DP_CODEC_MPEG24:
-		{
-			/* not implemented yet */
-			spa_log_error(this->log, "a2dp mpeg24 codec not implemented yet");
+		if ((codec = this->transport->a2dp_codec) == NULL)
 			return -EIO;
-		}
-		default:
+
+		if (codec->get_info(codec, this->transport->configuration,
+				this->transport->configuration_len, &info) < 0)
 			return -EIO;
-		}
+
+		param = spa_format_audio_raw_build(&b, id, &info);
 		break;
+	}
 
 	case SPA_PARAM_Format:
 		if (!port->have_format)
@@ -778,6 +992,25 @@ impl_node_port_enum_params(void *object, int seq,
 		}
 		break;
 
+	case SPA_PARAM_IO:
+		switch (result.index) {
+		case 0:
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_ParamIO, id,
+				SPA_PARAM_IO_id,   SPA_POD_Id(SPA_IO_Buffers),
+				SPA_PARAM_IO_size, SPA_POD_Int(sizeof(struct spa_io_buffers)));
+			break;
+		case 1:
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_ParamIO, id,
+				SPA_PARAM_IO_id,   SPA_POD_Id(SPA_IO_RateMatch),
+				SPA_PARAM_IO_size, SPA_POD_Int(sizeof(struct spa_io_rate_match)));
+			break;
+		default:
+			return 0;
+		}
+		break;
+
 	default:
 		return -ENOENT;
 	}
@@ -804,6 +1037,31 @@ static int clear_buffers(struct impl *this, struct port *port)
 	return 0;
 }
 
+/* the format must be the one of the codec configuration, see EnumFormat */
+static int check_format(struct impl *this, const struct spa_audio_info_raw *info)
+{
+	const struct a2dp_codec *codec;
+	struct spa_audio_info_raw codec_info;
+
+	if (this->transport == NULL)
+		return -EIO;
+	if ((codec = this->transport->a2dp_codec) == NULL)
+		return -EIO;
+	if (codec->get_info(codec, this->transport->configuration,
+			this->transport->configuration_len, &codec_info) < 0)
+		return -EIO;
+
+	if (info->format != codec_info.format ||
+	    info->rate != codec_info.rate ||
+	    info->channels != codec_info.channels) {
+		spa_log_warn(this->log, NAME" %p: format %u/%u/%u does not match codec %s %u/%u/%u",
+				this, info->format, info->rate, info->channels, codec->name,
+				codec_info.format, codec_info.rate, codec_info.channels);
+		return -EINVAL;
+	}
+	return 0;
+}
+
 static int port_set_format(struct impl *this, struct port *port,
 			   uint32_t flags,
 			   const struct spa_pod *format)
@@ -827,7 +1085,20 @@ static int port_set_format(struct impl *this, struct port *port,
 		if (spa_format_audio_raw_parse(format, &info.info.raw) < 0)
 			return -EINVAL;
 
-		port->frame_size = info.info.raw.channels * 2;
+		if ((err = check_format(this, &info.info.raw)) < 0)
+			return err;
+
+		switch (info.info.raw.format) {
+		case SPA_AUDIO_FORMAT_S16:
+			port->frame_size = 2;
+			break;
+		case SPA_AUDIO_FORMAT_S24:
+			port->frame_size = 3;
+			break;
+		default:
+			return -EINVAL;
+		}
+		port->frame_size *= info.info.raw.channels;
 		port->current_format = info;
 		port->have_format = true;
 	}
@@ -937,6 +1208,9 @@ impl_node_port_set_io(void *object,
 	case SPA_IO_Buffers:
 		port->io = data;
 		break;
+	case SPA_IO_RateMatch:
+		port->rate_match = data;
+		break;
 	default:
 		return -ENOENT;
 	}
@@ -975,6 +1249,62 @@ static int impl_node_port_reuse_buffer(void *object, uint32_t port_id, uint32_t
 	return 0;
 }
 
+static int process_follower(struct impl *this)
+{
+	struct port *port = &this->port;
+	struct spa_io_buffers *io = port->io;
+	struct buffer *buffer;
+	struct spa_data *d;
+	uint32_t frames, quantum;
+
+	if (io->status == SPA_STATUS_HAVE_DATA)
+		return SPA_STATUS_HAVE_DATA;
+
+	if (spa_list_is_empty(&port->free)) {
+		spa_log_warn(this->log, NAME " %p: out of buffers", this);
+		return io->status;
+	}
+
+	quantum = this->position->clock.duration;
+	if (port->rate_match && port->rate_match->size > 0)
+		frames = port->rate_match->size;
+	else
+		frames = quantum;
+
+	buffer = spa_list_first(&port->free, struct buffer, link);
+	spa_list_remove(&buffer->link);
+
+	d = buffer->buf->datas;
+	frames = SPA_MIN(frames, d[0].maxsize / port->frame_size);
+
+	if (buffer->h) {
+		buffer->h->seq = this->sample_count;
+		buffer->h->pts = this->position->clock.nsec;
+		buffer->h->dts_offset = 0;
+	}
+
+	if (jitter_buffer_read(&this->jb, d[0].data, frames, quantum) < frames)
+		spa_log_trace(this->log, NAME " %p: underrun fill:%u target:%u", this,
+				jitter_buffer_get_fill(&this->jb), this->jb.target);
+
+	d[0].chunk->offset = 0;
+	d[0].chunk->size = frames * port->frame_size;
+	d[0].chunk->stride = port->frame_size;
+
+	if (port->rate_match) {
+		port->rate_match->rate = jitter_buffer_get_rate(&this->jb);
+		SPA_FLAG_SET(port->rate_match->flags, SPA_IO_RATE_MATCH_FLAG_ACTIVE);
+	}
+
+	io->buffer_id = buffer->id;
+	io->status = SPA_STATUS_HAVE_DATA;
+
+	spa_list_append(&port->free, &buffer->link);
+	buffer->outstanding = false;
+
+	return SPA_STATUS_HAVE_DATA;
+}
+
 static int impl_node_process(void *object)
 {
 	struct impl *this = object;
@@ -988,6 +1318,9 @@ static int impl_node_process(void *object)
 	io = port->io;
 	spa_return_val_if_fail(io != NULL, -EIO);
 
+	if (this->following)
+		return process_follower(this);
+
 	/* Return if we already have a buffer */
 	if (io->status == SPA_STATUS_HAVE_DATA)
 		return SPA_STATUS_HAVE_DATA;
@@ -1103,6 +1436,7 @@ impl_init(const struct spa_handle_factory *factory,
 	this = (struct impl *) handle;
 
 	this->log = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_Log);
+	this->main_loop = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_Loop);
 	this->data_loop = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_DataLoop);
 	this->data_system = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_DataSystem);
 
@@ -1123,6 +1457,9 @@ impl_init(const struct spa_handle_factory *factory,
 
 	reset_props(&this->props);
 
+	this->source.fd = -1;
+	this->decoder_fd = -1;
+
 	/* set the node info */
 	this->info_all = SPA_NODE_CHANGE_MASK_FLAGS |
 			SPA_NODE_CHANGE_MASK_PROPS |
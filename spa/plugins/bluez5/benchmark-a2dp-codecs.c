@@ -0,0 +1,138 @@
+/* Spa A2DP codec benchmark
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <assert.h>
+
+#include <spa/utils/defs.h>
+
+#include "a2dp-codecs.h"
+
+#define SECONDS		60
+#define MTU		895
+#define MAX_BLOCK	1024
+
+static uint8_t pcm[48000 * 2 * 3];
+
+/* one second of a 440Hz tone in the codec format */
+static int gen_pcm(const struct spa_audio_info_raw *info, int frame_size)
+{
+	uint32_t i, c;
+	uint8_t *d = pcm;
+
+	for (i = 0; i < info->rate; i++) {
+		int32_t v = sin(2.0 * M_PI * 440.0 * i / info->rate) * 0x7fffff * 0.5;
+
+		for (c = 0; c < info->channels; c++) {
+			if (info->format == SPA_AUDIO_FORMAT_S16) {
+				*d++ = v >> 8;
+				*d++ = v >> 16;
+			} else {
+				*d++ = v;
+				*d++ = v >> 8;
+				*d++ = v >> 16;
+			}
+		}
+	}
+	return info->rate * frame_size;
+}
+
+static void test_codec(const struct a2dp_codec *codec)
+{
+	uint8_t caps[A2DP_MAX_CAPS_SIZE], config[A2DP_MAX_CAPS_SIZE];
+	uint8_t packet[MTU];
+	struct spa_audio_info_raw info;
+	struct timespec ts;
+	uint64_t t1, t2, n_bytes = 0, n_packets = 0;
+	int res, caps_size, config_size, frame_size, block_size, pcm_size, offs, i;
+	void *data;
+
+	caps_size = codec->fill_caps(codec, caps);
+	assert(caps_size > 0);
+	config_size = codec->select_config(codec, caps, caps_size, config);
+	assert(config_size > 0);
+	res = codec->get_info(codec, config, config_size, &info);
+	assert(res == 0);
+
+	frame_size = info.channels * (info.format == SPA_AUDIO_FORMAT_S16 ? 2 : 3);
+	pcm_size = gen_pcm(&info, frame_size);
+
+	data = codec->init(codec, config, config_size, &info, MTU);
+	assert(data != NULL);
+
+	block_size = codec->get_block_size(data);
+	assert(block_size > 0 && block_size <= MAX_BLOCK);
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t1 = SPA_TIMESPEC_TO_NSEC(&ts);
+
+	for (i = 0; i < SECONDS; i++) {
+		offs = 0;
+		while (offs + block_size <= pcm_size) {
+			int used, need_flush = 0;
+
+			used = codec->start_encode(data, packet, sizeof(packet), n_packets, 0);
+			assert(used >= 0);
+
+			while (!need_flush && offs + block_size <= pcm_size) {
+				size_t out;
+
+				res = codec->encode(data, pcm + offs, pcm_size - offs,
+						packet + used, sizeof(packet) - used,
+						&out, &need_flush);
+				assert(res > 0);
+				offs += res;
+				used += out;
+			}
+			n_bytes += used;
+			n_packets++;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t2 = SPA_TIMESPEC_TO_NSEC(&ts);
+
+	codec->deinit(data);
+
+	fprintf(stderr, "%s: %uHz %uch elapsed %"PRIu64" for %ds = %f x realtime, "
+			"%"PRIu64" packets %"PRIu64" kbit/s\n",
+			codec->name, info.rate, info.channels, t2 - t1, SECONDS,
+			(double)SECONDS * SPA_NSEC_PER_SEC / (t2 - t1),
+			n_packets, n_bytes * 8 / SECONDS / 1000);
+}
+
+int main(int argc, char *argv[])
+{
+	int i;
+
+	for (i = 0; a2dp_codec_list[i]; i++)
+		test_codec(a2dp_codec_list[i]);
+
+	return 0;
+}
@@ -46,6 +46,7 @@
 #include <spa/utils/type.h>
 #include <spa/utils/keys.h>
 #include <spa/utils/names.h>
+#include <spa/utils/result.h>
 
 #include "a2dp-codecs.h"
 #include "defs.h"
@@ -86,125 +87,6 @@ static inline void add_dict(struct spa_pod_builder *builder, const char *key, co
 	spa_pod_builder_string(builder, val);
 }
 
-static uint8_t a2dp_default_bitpool(struct spa_bt_monitor *monitor, uint8_t freq, uint8_t mode) {
-	/* These bitpool values were chosen based on the A2DP spec recommendation */
-	switch (freq) {
-	case SBC_SAMPLING_FREQ_16000:
-        case SBC_SAMPLING_FREQ_32000:
-		return 53;
-
-	case SBC_SAMPLING_FREQ_44100:
-		switch (mode) {
-		case SBC_CHANNEL_MODE_MONO:
-		case SBC_CHANNEL_MODE_DUAL_CHANNEL:
-			return 31;
-
-		case SBC_CHANNEL_MODE_STEREO:
-		case SBC_CHANNEL_MODE_JOINT_STEREO:
-			return 53;
-		}
-
-		spa_log_warn(monitor->log, "Invalid channel mode %u", mode);
-		return 53;
-	case SBC_SAMPLING_FREQ_48000:
-		switch (mode) {
-		case SBC_CHANNEL_MODE_MONO:
-		case SBC_CHANNEL_MODE_DUAL_CHANNEL:
-			return 29;
-
-		case SBC_CHANNEL_MODE_STEREO:
-		case SBC_CHANNEL_MODE_JOINT_STEREO:
-			return 51;
-		}
-
-		spa_log_warn(monitor->log, "Invalid channel mode %u", mode);
-		return 51;
-	}
-	spa_log_warn(monitor->log, "Invalid sampling freq %u", freq);
-	return 53;
-}
-
-static int select_configuration_sbc(struct spa_bt_monitor *monitor, void *capabilities, size_t size, void *config)
-{
-	a2dp_sbc_t *cap, conf;
-	int bitpool;
-
-	if (size < sizeof(conf)) {
-		spa_log_error(monitor->log, "Capabilities array has invalid size");
-		return -ENOSPC;
-	}
-	cap = capabilities;
-	conf = *cap;
-
-	if (conf.frequency & SBC_SAMPLING_FREQ_48000)
-		conf.frequency = SBC_SAMPLING_FREQ_48000;
-	else if (conf.frequency & SBC_SAMPLING_FREQ_44100)
-		conf.frequency = SBC_SAMPLING_FREQ_44100;
-	else if (conf.frequency & SBC_SAMPLING_FREQ_32000)
-		conf.frequency = SBC_SAMPLING_FREQ_32000;
-	else if (conf.frequency & SBC_SAMPLING_FREQ_16000)
-		conf.frequency = SBC_SAMPLING_FREQ_16000;
-	else {
-		spa_log_error(monitor->log, "No supported sampling frequencies: 0x%x", conf.frequency);
-		return -ENOTSUP;
-	}
-
-	if (conf.channel_mode & SBC_CHANNEL_MODE_JOINT_STEREO)
-		conf.channel_mode = SBC_CHANNEL_MODE_JOINT_STEREO;
-	else if (conf.channel_mode & SBC_CHANNEL_MODE_STEREO)
-		conf.channel_mode = SBC_CHANNEL_MODE_STEREO;
-	else if (conf.channel_mode & SBC_CHANNEL_MODE_DUAL_CHANNEL)
-		conf.channel_mode = SBC_CHANNEL_MODE_DUAL_CHANNEL;
-	else if (conf.channel_mode & SBC_CHANNEL_MODE_MONO)
-		conf.channel_mode = SBC_CHANNEL_MODE_MONO;
-	else {
-		spa_log_error(monitor->log, "No supported channel modes: 0x%x", conf.channel_mode);
-		return -ENOTSUP;
-	}
-
-	if (conf.block_length & SBC_BLOCK_LENGTH_16)
-		conf.block_length = SBC_BLOCK_LENGTH_16;
-	else if (conf.block_length & SBC_BLOCK_LENGTH_12)
-		conf.block_length = SBC_BLOCK_LENGTH_12;
-	else if (conf.block_length & SBC_BLOCK_LENGTH_8)
-		conf.block_length = SBC_BLOCK_LENGTH_8;
-	else if (conf.block_length & SBC_BLOCK_LENGTH_4)
-		conf.block_length = SBC_BLOCK_LENGTH_4;
-	else {
-		spa_log_error(monitor->log, "No supported block lengths: 0x%x", conf.block_length);
-		return -ENOTSUP;
-	}
-
-	if (conf.subbands & SBC_SUBBANDS_8)
-		conf.subbands = SBC_SUBBANDS_8;
-	else if (conf.subbands & SBC_SUBBANDS_4)
-		conf.subbands = SBC_SUBBANDS_4;
-	else {
-		spa_log_error(monitor->log, "No supported subbands: 0x%x", conf.subbands);
-		return -ENOTSUP;
-	}
-
-	if (conf.allocation_method & SBC_ALLOCATION_LOUDNESS)
-		conf.allocation_method = SBC_ALLOCATION_LOUDNESS;
-	else if (conf.allocation_method & SBC_ALLOCATION_SNR)
-		conf.allocation_method = SBC_ALLOCATION_SNR;
-	else {
-		spa_log_error(monitor->log, "No supported allocation: 0x%x", conf.allocation_method);
-		return -ENOTSUP;
-	}
-
-	bitpool = a2dp_default_bitpool(monitor, conf.frequency, conf.channel_mode);
-
-	conf.min_bitpool = SPA_MAX(MIN_BITPOOL, conf.min_bitpool);
-	conf.max_bitpool = SPA_MIN(bitpool, conf.max_bitpool);
-	memcpy(config, &conf, size);
-
-	spa_log_debug(monitor->log, "SelectConfiguration(): %d %d %d %d ",
-			conf.frequency, conf.channel_mode, conf.min_bitpool, conf.max_bitpool);
-
-	return 0;
-}
-
 static int select_configuration_aac(struct spa_bt_monitor *monitor, void *capabilities, size_t size, void *config)
 {
 	a2dp_aac_t *cap, conf;
@@ -276,12 +158,33 @@ static int select_configuration_aac(struct spa_bt_monitor *monitor, void *capabi
 	return 0;
 }
 
+static const struct a2dp_codec *a2dp_endpoint_to_codec(const char *path)
+{
+	const char *name;
+	size_t len;
+	int i;
+
+	if (strstr(path, "/A2DP/") != path)
+		return NULL;
+
+	name = path + strlen("/A2DP/");
+	for (i = 0; a2dp_codec_list[i]; i++) {
+		const struct a2dp_codec *codec = a2dp_codec_list[i];
+
+		len = strlen(codec->name);
+		if (strncmp(name, codec->name, len) == 0 && name[len] == '/')
+			return codec;
+	}
+	return NULL;
+}
+
 static DBusHandlerResult endpoint_select_configuration(DBusConnection *conn, DBusMessage *m, void *userdata)
 {
 	struct spa_bt_monitor *monitor = userdata;
 	const char *path;
-	uint8_t *cap, config[16];
+	uint8_t *cap, config[A2DP_MAX_CAPS_SIZE];
 	uint8_t *pconf = (uint8_t *) config;
+	const struct a2dp_codec *codec;
 	DBusMessage *r;
 	DBusError err;
 	int size, res;
@@ -297,8 +200,13 @@ static DBusHandlerResult endpoint_select_configuration(DBusConnection *conn, DBu
 		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 	}
 
-	if (strstr(path, "/A2DP/SBC/") == path) {
-		res = select_configuration_sbc(monitor, cap, size, config);
+	if ((codec = a2dp_endpoint_to_codec(path)) != NULL) {
+		res = codec->select_config(codec, cap, size, config);
+		if (res >= 0)
+			size = res;
+		else
+			spa_log_error(monitor->log, "SelectConfiguration() %s: %s",
+					codec->name, spa_strerror(res));
 	} else if (strstr(path, "/A2DP/MPEG24/") == path) {
 		res = select_configuration_aac(monitor, cap, size, config);
 	} else
@@ -929,6 +837,14 @@ static int transport_update_props(struct spa_bt_transport *transport,
 	      next:
 		dbus_message_iter_next(props_iter);
 	}
+
+	if (transport->a2dp_codec == NULL && transport->configuration != NULL) {
+		transport->a2dp_codec = a2dp_codec_find(transport->codec,
+				transport->configuration, transport->configuration_len);
+		if (transport->a2dp_codec == NULL)
+			spa_log_warn(monitor->log, "transport %p: unsupported codec %02x",
+					transport, transport->codec);
+	}
 	return 0;
 }
 
@@ -1217,13 +1133,10 @@ static void register_endpoint_reply(DBusPendingCall *pending, void *user_data)
 
 static int register_a2dp_endpoint(struct spa_bt_monitor *monitor,
 				  const char *path,
+				  const struct a2dp_codec *codec,
 				  const char *uuid,
-				  enum spa_bt_profile profile,
-				  uint16_t codec,
-				  const void *configuration,
-				  size_t configuration_size)
+				  enum spa_bt_profile profile)
 {
-	const char *profile_path;
 	char *object_path, *str;
 	const DBusObjectPathVTable vtable_endpoint = {
 		.message_function = endpoint_handler,
@@ -1231,42 +1144,24 @@ static int register_a2dp_endpoint(struct spa_bt_monitor *monitor,
 	DBusMessage *m;
 	DBusMessageIter it[5];
 	DBusPendingCall *call;
+	uint8_t caps[A2DP_MAX_CAPS_SIZE], *pcaps = caps;
+	int caps_size;
 
 	switch (profile) {
 	case SPA_BT_PROFILE_A2DP_SOURCE:
-		switch (codec) {
-		case A2DP_CODEC_SBC:
-			profile_path = "/A2DP/SBC/Source";
-			break;
-		case A2DP_CODEC_MPEG24:
-			/* We don't support MPEG24 for now */
-			return -ENOTSUP;
-			/* profile_path = "/A2DP/MPEG24/Source";
-			break; */
-		default:
-			return -ENOTSUP;
-		}
+		str = "Source";
 		break;
 	case SPA_BT_PROFILE_A2DP_SINK:
-		switch (codec) {
-		case A2DP_CODEC_SBC:
-			profile_path = "/A2DP/SBC/Sink";
-			break;
-
-		case A2DP_CODEC_MPEG24:
-			/* We don't support MPEG24 for now */
-			return -ENOTSUP;
-			/* profile_path = "/A2DP/MPEG24/Sink";
-			break; */
-		default:
-			return -ENOTSUP;
-		}
+		str = "Sink";
 		break;
 	default:
 		return -ENOTSUP;
 	}
 
-	object_path = spa_aprintf("%s/%d", profile_path, monitor->count++);
+	if ((caps_size = codec->fill_caps(codec, caps)) < 0)
+		return caps_size;
+
+	object_path = spa_aprintf("/A2DP/%s/%s/%d", codec->name, str, monitor->count++);
 	if (object_path == NULL)
 		return -errno;
 
@@ -1301,7 +1196,7 @@ static int register_a2dp_endpoint(struct spa_bt_monitor *monitor,
 	str = "Codec";
 	dbus_message_iter_append_basic(&it[2], DBUS_TYPE_STRING, &str);
 	dbus_message_iter_open_container(&it[2], DBUS_TYPE_VARIANT, "y", &it[3]);
-	dbus_message_iter_append_basic(&it[3], DBUS_TYPE_BYTE, &codec);
+	dbus_message_iter_append_basic(&it[3], DBUS_TYPE_BYTE, &codec->codec_id);
 	dbus_message_iter_close_container(&it[2], &it[3]);
 	dbus_message_iter_close_container(&it[1], &it[2]);
 
@@ -1311,7 +1206,7 @@ static int register_a2dp_endpoint(struct spa_bt_monitor *monitor,
 	dbus_message_iter_open_container(&it[2], DBUS_TYPE_VARIANT, "ay", &it[3]);
 	dbus_message_iter_open_container(&it[3], DBUS_TYPE_ARRAY, "y", &it[4]);
 	dbus_message_iter_append_fixed_array (&it[4], DBUS_TYPE_BYTE,
-			&configuration, configuration_size);
+			&pcaps, caps_size);
 	dbus_message_iter_close_container(&it[3], &it[4]);
 	dbus_message_iter_close_container(&it[2], &it[3]);
 	dbus_message_iter_close_container(&it[1], &it[2]);
@@ -1327,31 +1222,19 @@ static int register_a2dp_endpoint(struct spa_bt_monitor *monitor,
 static int adapter_register_endpoints(struct spa_bt_adapter *a)
 {
 	struct spa_bt_monitor *monitor = a->monitor;
+	int i;
 
 	/* We don't support MPEG24 for now */
-	/*
-	register_a2dp_endpoint(monitor, a->path,
-			       SPA_BT_UUID_A2DP_SOURCE,
-			       SPA_BT_PROFILE_A2DP_SOURCE,
-			       A2DP_CODEC_MPEG24,
-			       &bluez_a2dp_aac, sizeof(bluez_a2dp_aac));
-	register_a2dp_endpoint(monitor, a->path,
-			       SPA_BT_UUID_A2DP_SINK,
-			       SPA_BT_PROFILE_A2DP_SINK,
-			       A2DP_CODEC_MPEG24,
-			       &bluez_a2dp_aac, sizeof(bluez_a2dp_aac));
-	*/
-
-	register_a2dp_endpoint(monitor, a->path,
-			       SPA_BT_UUID_A2DP_SOURCE,
-			       SPA_BT_PROFILE_A2DP_SOURCE,
-			       A2DP_CODEC_SBC,
-			       &bluez_a2dp_sbc, sizeof(bluez_a2dp_sbc));
-	register_a2dp_endpoint(monitor, a->path,
-			       SPA_BT_UUID_A2DP_SINK,
-			       SPA_BT_PROFILE_A2DP_SINK,
-			       A2DP_CODEC_SBC,
-			       &bluez_a2dp_sbc, sizeof(bluez_a2dp_sbc));
+	for (i = 0; a2dp_codec_list[i]; i++) {
+		const struct a2dp_codec *codec = a2dp_codec_list[i];
+
+		register_a2dp_endpoint(monitor, a->path, codec,
+				       SPA_BT_UUID_A2DP_SOURCE,
+				       SPA_BT_PROFILE_A2DP_SOURCE);
+		register_a2dp_endpoint(monitor, a->path, codec,
+				       SPA_BT_UUID_A2DP_SINK,
+				       SPA_BT_PROFILE_A2DP_SINK);
+	}
 	return 0;
 }
 
@@ -1491,6 +1374,18 @@ static int sco_do_connect(struct spa_bt_transport *t)
 		return -errno;
 	}
 
+	if (t->codec == HFP_AUDIO_CODEC_MSBC) {
+		/* mSBC goes over the air as is, without CVSD conversion */
+		struct bt_voice voice;
+
+		memset(&voice, 0, sizeof(voice));
+		voice.setting = BT_VOICE_TRANSPARENT;
+		if (setsockopt(sock, SOL_BLUETOOTH, BT_VOICE, &voice, sizeof(voice)) < 0) {
+			spa_log_error(monitor->log, "setsockopt(BT_VOICE): %s", strerror(errno));
+			goto fail_close;
+		}
+	}
+
 	len = sizeof(addr);
 	memset(&addr, 0, len);
 	addr.sco_family = AF_BLUETOOTH;
@@ -1729,6 +1624,7 @@ static DBusHandlerResult profile_new_connection(DBusConnection *conn, DBusMessag
 	t->device = d;
 	spa_list_append(&t->device->transport_list, &t->device_link);
 	t->profile = profile;
+	t->codec = HFP_AUDIO_CODEC_CVSD;
 
 	td = t->user_data;
 	td->rfcomm.func = rfcomm_event;
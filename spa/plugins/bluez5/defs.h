@@ -107,6 +107,10 @@ extern "C" {
 
 #define HSP_HS_DEFAULT_CHANNEL  3
 
+/* HFP codec ids, CVSD is also what HSP always uses */
+#define HFP_AUDIO_CODEC_CVSD	0x01
+#define HFP_AUDIO_CODEC_MSBC	0x02
+
 enum spa_bt_profile {
         SPA_BT_PROFILE_NULL =		0,
         SPA_BT_PROFILE_A2DP_SINK =	(1 << 0),
@@ -234,6 +238,7 @@ struct spa_bt_transport {
 	int codec;
 	void *configuration;
 	int configuration_len;
+	const struct a2dp_codec *a2dp_codec;
 
 	bool acquired;
 	int fd;
@@ -0,0 +1,211 @@
+/* Spa Bluez5 jitter buffer
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include <spa/utils/defs.h>
+
+#include "jitter-buffer.h"
+
+#define BW_MAX		0.128
+#define BW_MED		0.064
+#define BW_MIN		0.016
+#define BW_PERIOD	3	/* seconds */
+
+#define MAX_RATE_DIFF	0.05
+
+#define WINDOW		10	/* seconds without underrun before shrinking */
+
+static void set_loop(struct jitter_buffer *jb, double bw)
+{
+	double w = 2 * M_PI * bw * jb->quantum / jb->rate;
+	jb->w0 = 1.0 - exp(-20.0 * w);
+	jb->w1 = w * 1.5 / jb->quantum;
+	jb->w2 = w / 1.5;
+	jb->bw = bw;
+}
+
+void jitter_buffer_reset(struct jitter_buffer *jb)
+{
+	spa_ringbuffer_init(&jb->ring);
+	jb->target = jb->min_target;
+	jb->prefilled = false;
+	jb->starved = 0;
+	jb->quantum = 0;
+	jb->bw = 0.0;
+	jb->z1 = jb->z2 = jb->z3 = 0.0;
+	jb->corr = 1.0;
+	jb->bw_frames = 0;
+	jb->window_frames = 0;
+	jb->window_min = UINT32_MAX;
+}
+
+void jitter_buffer_init(struct jitter_buffer *jb, void *data, uint32_t size,
+		uint32_t frame_size, uint32_t rate,
+		uint32_t min_target, uint32_t max_target)
+{
+	jb->data = data;
+	jb->size = size;
+	jb->avail = size - size % frame_size;
+	jb->frame_size = frame_size;
+	jb->rate = rate;
+	jb->min_target = min_target;
+	jb->max_target = SPA_MIN(max_target, jb->avail / frame_size / 2);
+	jb->underruns = 0;
+	jb->overruns = 0;
+	jitter_buffer_reset(jb);
+}
+
+uint32_t jitter_buffer_get_fill(struct jitter_buffer *jb)
+{
+	uint32_t index;
+	return spa_ringbuffer_get_read_index(&jb->ring, &index) / jb->frame_size;
+}
+
+uint32_t jitter_buffer_write(struct jitter_buffer *jb, const void *data, uint32_t frames)
+{
+	uint32_t index, bytes = frames * jb->frame_size;
+	int32_t filled;
+
+	/* only store whole frames so that the fill and the read position
+	 * stay frame aligned when the size is not a multiple of the frame */
+	if (bytes > jb->avail) {
+		data = SPA_MEMBER(data, bytes - jb->avail, void);
+		bytes = jb->avail;
+	}
+
+	filled = spa_ringbuffer_get_write_index(&jb->ring, &index);
+	if (filled + bytes > jb->avail) {
+		/* the reader runs on the same thread, make room by
+		 * dropping the oldest frames */
+		uint32_t drop = filled + bytes - jb->avail;
+		spa_ringbuffer_read_update(&jb->ring, index - filled + drop);
+		jb->overruns++;
+	}
+
+	spa_ringbuffer_write_data(&jb->ring, jb->data, jb->size,
+			index & (jb->size - 1), data, bytes);
+	spa_ringbuffer_write_update(&jb->ring, index + bytes);
+
+	return bytes / jb->frame_size;
+}
+
+static void update_rate(struct jitter_buffer *jb, uint32_t fill, uint32_t quantum)
+{
+	double err;
+
+	if (SPA_UNLIKELY(jb->quantum != quantum)) {
+		jb->quantum = quantum;
+		set_loop(jb, jb->bw == 0.0 ? BW_MAX : jb->bw);
+	}
+
+	err = (double)jb->target - fill;
+
+	jb->z1 += jb->w0 * (jb->w1 * err - jb->z1);
+	jb->z2 += jb->w0 * (jb->z1 - jb->z2);
+	jb->z3 += jb->w2 * jb->z2;
+
+	jb->corr = SPA_CLAMP(1.0 - (jb->z2 + jb->z3), 1.0 - MAX_RATE_DIFF, 1.0 + MAX_RATE_DIFF);
+
+	jb->bw_frames += quantum;
+	if (jb->bw_frames > (uint64_t)BW_PERIOD * jb->rate) {
+		jb->bw_frames = 0;
+		if (jb->bw == BW_MAX)
+			set_loop(jb, BW_MED);
+		else if (jb->bw == BW_MED)
+			set_loop(jb, BW_MIN);
+	}
+}
+
+static void update_target(struct jitter_buffer *jb, uint32_t fill, uint32_t quantum)
+{
+	uint32_t safety = jb->min_target;
+
+	jb->window_min = SPA_MIN(jb->window_min, fill);
+	jb->window_frames += quantum;
+	if (jb->window_frames < (uint64_t)WINDOW * jb->rate)
+		return;
+
+	if (jb->window_min > safety) {
+		uint32_t slack = (jb->window_min - safety) / 4;
+		jb->target = SPA_MAX(jb->target - SPA_MIN(slack, jb->target), jb->min_target);
+	}
+	jb->window_frames = 0;
+	jb->window_min = UINT32_MAX;
+}
+
+uint32_t jitter_buffer_read(struct jitter_buffer *jb, void *data, uint32_t frames,
+		uint32_t quantum)
+{
+	uint32_t index, fill, n_frames = 0, bytes = frames * jb->frame_size;
+	int32_t avail;
+
+	avail = spa_ringbuffer_get_read_index(&jb->ring, &index);
+	fill = avail / jb->frame_size;
+
+	if (jb->starved > 0) {
+		if (fill == 0) {
+			jb->starved += frames;
+		} else {
+			/* data again after an underrun, make the target cover
+			 * the time we went without and a cycle more */
+			jb->target = SPA_MAX(jb->target + jb->target / 2,
+					jb->target + jb->starved + quantum);
+			jb->target = SPA_MIN(jb->target, jb->max_target);
+			jb->starved = 0;
+		}
+	}
+	if (!jb->prefilled && fill >= jb->target)
+		jb->prefilled = true;
+
+	if (jb->prefilled) {
+		n_frames = SPA_MIN(fill, frames);
+		spa_ringbuffer_read_data(&jb->ring, jb->data, jb->size,
+				index & (jb->size - 1), data, n_frames * jb->frame_size);
+		spa_ringbuffer_read_update(&jb->ring, index + n_frames * jb->frame_size);
+		fill -= n_frames;
+
+		if (n_frames < frames) {
+			/* ran dry, build up a larger target before
+			 * playing again */
+			jb->underruns++;
+			jb->starved = frames - n_frames;
+			jb->prefilled = false;
+		}
+		update_rate(jb, fill, quantum);
+	}
+	if (n_frames < frames)
+		memset(SPA_MEMBER(data, n_frames * jb->frame_size, void), 0,
+				bytes - n_frames * jb->frame_size);
+
+	if (jb->prefilled)
+		update_target(jb, fill, quantum);
+	else {
+		jb->window_frames = 0;
+		jb->window_min = UINT32_MAX;
+	}
+
+	return n_frames;
+}
@@ -0,0 +1,97 @@
+/* Spa Bluez5 jitter buffer
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SPA_BLUEZ5_JITTER_BUFFER_H
+#define SPA_BLUEZ5_JITTER_BUFFER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <spa/utils/ringbuffer.h>
+
+/* Decoded audio from the socket goes in as packets arrive, the graph takes
+ * it out once per cycle. The fill level after each cycle runs a DLL that
+ * gives the rate for the downstream resampler, so the fill stays around the
+ * target. The target itself grows after an underrun and shrinks again when
+ * the fill never got close to empty for a while. */
+struct jitter_buffer {
+	struct spa_ringbuffer ring;
+	uint8_t *data;
+	uint32_t size;		/* in bytes, a power of 2 */
+	uint32_t avail;		/* bytes that can be stored, whole frames */
+	uint32_t frame_size;
+	uint32_t rate;
+
+	uint32_t min_target;	/* in frames */
+	uint32_t max_target;
+	uint32_t target;
+	bool prefilled;
+	uint32_t starved;	/* frames missing since the last underrun */
+
+	uint32_t quantum;
+	double bw;
+	double z1, z2, z3;
+	double w0, w1, w2;
+	double corr;
+	uint64_t bw_frames;
+
+	uint64_t window_frames;
+	uint32_t window_min;
+
+	uint32_t underruns;
+	uint32_t overruns;
+};
+
+void jitter_buffer_init(struct jitter_buffer *jb, void *data, uint32_t size,
+		uint32_t frame_size, uint32_t rate,
+		uint32_t min_target, uint32_t max_target);
+
+void jitter_buffer_reset(struct jitter_buffer *jb);
+
+uint32_t jitter_buffer_get_fill(struct jitter_buffer *jb);
+
+/* Returns the number of frames stored. When the buffer is full the oldest
+ * frames are dropped. */
+uint32_t jitter_buffer_write(struct jitter_buffer *jb, const void *data, uint32_t frames);
+
+/* Fills all frames, with silence where there is no data, and updates the
+ * rate for a cycle of quantum frames. Returns the frames of real data. */
+uint32_t jitter_buffer_read(struct jitter_buffer *jb, void *data, uint32_t frames,
+		uint32_t quantum);
+
+/* The rate for spa_io_rate_match */
+static inline double jitter_buffer_get_rate(struct jitter_buffer *jb)
+{
+	return 1.0 / jb->corr;
+}
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* SPA_BLUEZ5_JITTER_BUFFER_H */
@@ -0,0 +1,143 @@
+/* Spa Bluez5 mSBC codec
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <spa/utils/defs.h>
+
+#include "msbc.h"
+
+#define H2_SYNC		0x01
+#define MSBC_SYNC	0xad
+
+/* the sequence number is sent twice, in bits 4,5 and 6,7 */
+static const uint8_t h2_seq[] = { 0x08, 0x38, 0xc8, 0xf8 };
+
+static int h2_seq_to_num(uint8_t b)
+{
+	int i;
+	for (i = 0; i < (int)SPA_N_ELEMENTS(h2_seq); i++)
+		if (h2_seq[i] == b)
+			return i;
+	return -1;
+}
+
+int msbc_init(struct msbc *m)
+{
+	int res;
+
+	if ((res = sbc_init_msbc(&m->sbc, 0)) < 0)
+		return res;
+
+	m->sbc.endian = SBC_LE;
+	m->seq = 0;
+	m->packet_size = 0;
+	m->last_seq = -1;
+	m->lost = 0;
+	m->errors = 0;
+	return 0;
+}
+
+void msbc_deinit(struct msbc *m)
+{
+	sbc_finish(&m->sbc);
+}
+
+int msbc_encode(struct msbc *m, const void *src, void *dst)
+{
+	uint8_t *p = dst;
+	ssize_t written;
+	int res;
+
+	p[0] = H2_SYNC;
+	p[1] = h2_seq[m->seq];
+	m->seq = (m->seq + 1) % SPA_N_ELEMENTS(h2_seq);
+
+	res = sbc_encode(&m->sbc, src, MSBC_DECODED_SIZE,
+			p + 2, MSBC_ENCODED_SIZE, &written);
+	if (res < 0)
+		return res;
+	if (res != MSBC_DECODED_SIZE || written != MSBC_ENCODED_SIZE)
+		return -EINVAL;
+
+	p[MSBC_PACKET_SIZE - 1] = 0;
+	return MSBC_PACKET_SIZE;
+}
+
+static size_t decode_packet(struct msbc *m, uint8_t *dst, size_t dst_size)
+{
+	int seq = h2_seq_to_num(m->packet[1]);
+	size_t avail = dst_size / MSBC_DECODED_SIZE, total = 0, written;
+
+	/* fill what we missed with silence, when there is room for it */
+	if (m->last_seq >= 0) {
+		int missing = (seq - m->last_seq - 1 + 4) % 4;
+		m->lost += missing;
+		while (missing-- > 0 && avail > 1) {
+			memset(dst + total, 0, MSBC_DECODED_SIZE);
+			total += MSBC_DECODED_SIZE;
+			avail--;
+		}
+	}
+	m->last_seq = seq;
+
+	if (sbc_decode(&m->sbc, m->packet + 2, MSBC_ENCODED_SIZE,
+				dst + total, MSBC_DECODED_SIZE, &written) < 0 ||
+	    written != MSBC_DECODED_SIZE) {
+		memset(dst + total, 0, MSBC_DECODED_SIZE);
+		m->errors++;
+	}
+	return total + MSBC_DECODED_SIZE;
+}
+
+size_t msbc_decode(struct msbc *m, const void *src, size_t src_size,
+		void *dst, size_t dst_size, size_t *written)
+{
+	const uint8_t *s = src;
+	uint8_t *d = dst;
+	size_t consumed = 0, total = 0;
+
+	while (consumed < src_size && dst_size - total >= MSBC_DECODED_SIZE) {
+		uint8_t b = s[consumed++];
+
+		/* look for the H2 header and the mSBC sync word, start over
+		 * from this byte when it does not match */
+		if ((m->packet_size == 0 && b != H2_SYNC) ||
+		    (m->packet_size == 1 && h2_seq_to_num(b) < 0) ||
+		    (m->packet_size == 2 && b != MSBC_SYNC)) {
+			m->packet_size = 0;
+			if (b != H2_SYNC)
+				continue;
+		}
+		m->packet[m->packet_size++] = b;
+
+		if (m->packet_size == MSBC_PACKET_SIZE) {
+			total += decode_packet(m, d + total, dst_size - total);
+			m->packet_size = 0;
+		}
+	}
+	*written = total;
+	return consumed;
+}
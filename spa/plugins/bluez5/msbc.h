@@ -0,0 +1,78 @@
+/* Spa Bluez5 mSBC codec
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SPA_BLUEZ5_MSBC_H
+#define SPA_BLUEZ5_MSBC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sbc/sbc.h>
+
+/* mSBC is the wideband speech codec of HFP: 16kHz mono SBC with fixed
+ * parameters. Every frame goes out as an H2 packet: a 2 byte header with
+ * a 2 bit sequence number, the 57 byte frame and one byte of padding. */
+#define MSBC_RATE		16000
+#define MSBC_DECODED_SIZE	240	/* 120 S16 samples, 7.5ms */
+#define MSBC_ENCODED_SIZE	57
+#define MSBC_PACKET_SIZE	60
+
+struct msbc {
+	sbc_t sbc;
+	uint8_t seq;		/* sequence number of the next packet sent */
+
+	/* the H2 packet being received */
+	uint8_t packet[MSBC_PACKET_SIZE];
+	uint32_t packet_size;
+	int last_seq;
+
+	uint32_t lost;		/* packets missing in the sequence */
+	uint32_t errors;	/* packets that did not decode */
+};
+
+int msbc_init(struct msbc *m);
+
+void msbc_deinit(struct msbc *m);
+
+/* Encodes MSBC_DECODED_SIZE bytes from src into one H2 packet of
+ * MSBC_PACKET_SIZE bytes in dst. */
+int msbc_encode(struct msbc *m, const void *src, void *dst);
+
+/* Takes received bytes, the packets don't need to be aligned on the
+ * reads, and decodes the complete ones into dst. Missing or broken
+ * packets are replaced with silence. Stops when there is no room for
+ * another frame in dst. Returns the bytes taken from src and the decoded
+ * size in written. */
+size_t msbc_decode(struct msbc *m, const void *src, size_t src_size,
+		void *dst, size_t dst_size, size_t *written);
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* SPA_BLUEZ5_MSBC_H */
@@ -0,0 +1,124 @@
+/* Spa Bluez5 SCO framing
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SPA_BLUEZ5_SCO_FRAMING_H
+#define SPA_BLUEZ5_SCO_FRAMING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <errno.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include <spa/utils/defs.h>
+#include <spa/utils/ringbuffer.h>
+
+/* A SCO socket wants packets of exactly the MTU. Data is queued here in
+ * whatever size it comes and goes out in MTU sized writes. What does not
+ * fit in a whole packet, or does not fit in the socket, stays queued for
+ * the next flush. */
+#define SCO_FRAMING_SIZE	4096u
+
+struct sco_framing {
+	struct spa_ringbuffer ring;
+	uint32_t mtu;
+	uint8_t data[SCO_FRAMING_SIZE];
+};
+
+static inline void sco_framing_init(struct sco_framing *f, uint32_t mtu)
+{
+	spa_ringbuffer_init(&f->ring);
+	f->mtu = SPA_MIN(mtu, SCO_FRAMING_SIZE);
+}
+
+static inline uint32_t sco_framing_get_queued(struct sco_framing *f)
+{
+	uint32_t index;
+	return spa_ringbuffer_get_read_index(&f->ring, &index);
+}
+
+static inline uint32_t sco_framing_get_space(struct sco_framing *f)
+{
+	return SCO_FRAMING_SIZE - sco_framing_get_queued(f);
+}
+
+/* Returns the bytes queued, less than size when the ring is full */
+static inline uint32_t sco_framing_push(struct sco_framing *f, const void *data, uint32_t size)
+{
+	uint32_t index;
+	int32_t filled;
+
+	filled = spa_ringbuffer_get_write_index(&f->ring, &index);
+	size = SPA_MIN(size, SCO_FRAMING_SIZE - (uint32_t)filled);
+
+	spa_ringbuffer_write_data(&f->ring, f->data, SCO_FRAMING_SIZE,
+			index & (SCO_FRAMING_SIZE - 1), data, size);
+	spa_ringbuffer_write_update(&f->ring, index + size);
+	return size;
+}
+
+/* Writes all whole packets until the socket is full. Returns the number of
+ * packets fully written or a negative errno. */
+static inline int sco_framing_flush(struct sco_framing *f, int fd)
+{
+	uint32_t index, offset, first;
+	struct iovec iov[2];
+	ssize_t res;
+	int packets = 0;
+
+	while (spa_ringbuffer_get_read_index(&f->ring, &index) >= (int32_t)f->mtu) {
+		offset = index & (SCO_FRAMING_SIZE - 1);
+		first = SPA_MIN(f->mtu, SCO_FRAMING_SIZE - offset);
+
+		iov[0].iov_base = &f->data[offset];
+		iov[0].iov_len = first;
+		iov[1].iov_base = f->data;
+		iov[1].iov_len = f->mtu - first;
+
+		res = writev(fd, iov, iov[1].iov_len ? 2 : 1);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			return -errno;
+		}
+		/* a short write is a full socket, the packet stays queued and
+		 * goes out whole with the next flush */
+		if (res != (ssize_t)f->mtu)
+			break;
+
+		spa_ringbuffer_read_update(&f->ring, index + f->mtu);
+		packets++;
+	}
+	return packets;
+}
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* SPA_BLUEZ5_SCO_FRAMING_H */
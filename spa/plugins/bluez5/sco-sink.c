@@ -35,6 +35,7 @@
 #include <spa/utils/list.h>
 #include <spa/utils/keys.h>
 #include <spa/utils/names.h>
+#include <spa/utils/result.h>
 #include <spa/monitor/device.h>
 
 #include <spa/node/node.h>
@@ -47,6 +48,8 @@
 #include <spa/pod/filter.h>
 
 #include "defs.h"
+#include "sco-framing.h"
+#include "msbc.h"
 
 struct props {
 	uint32_t min_latency;
@@ -80,6 +83,7 @@ struct port {
 	struct spa_list free;
 	struct spa_list ready;
 
+	uint32_t ready_offset;
 	unsigned int need_data:1;
 };
 
@@ -131,6 +135,13 @@ struct impl {
 	/* Counts */
 	uint64_t sample_count;
 	uint32_t write_mtu;
+
+	/* Encoding, data goes out in write_mtu sized packets */
+	struct sco_framing framing;
+	unsigned int use_msbc:1;
+	struct msbc msbc;
+	uint8_t msbc_pcm[MSBC_DECODED_SIZE];
+	uint32_t msbc_pcm_size;
 };
 
 #define NAME "sco-sink"
@@ -345,29 +356,63 @@ static int impl_node_set_param(void *object, uint32_t id, uint32_t flags,
 	return 0;
 }
 
-static bool write_data(struct impl *this, const uint8_t *data, uint32_t size, uint32_t *total_written)
+/* Queues data for sending, encoded first when using mSBC. Returns the bytes
+ * taken, less than size when the framing ring is full. */
+static uint32_t push_data(struct impl *this, const uint8_t *data, uint32_t size)
 {
-	uint32_t local_total_written = 0;
-	const uint32_t mtu_size = this->write_mtu;
-
-	while (local_total_written <= (size - mtu_size)) {
-		const int bytes_written = write(this->sock_fd, data, mtu_size);
-		if (bytes_written < 0) {
-			spa_log_warn(this->log, "error writting data: %s", strerror(errno));
-			return false;
-		}
+	uint8_t packet[MSBC_PACKET_SIZE];
+	uint32_t n, taken = 0;
+
+	if (!this->use_msbc)
+		return sco_framing_push(&this->framing, data, size);
 
-		data += bytes_written;
-		local_total_written += bytes_written;
+	while (taken < size) {
+		n = SPA_MIN(size - taken, MSBC_DECODED_SIZE - this->msbc_pcm_size);
+
+		/* only complete a frame when its packet can be queued */
+		if (this->msbc_pcm_size + n == MSBC_DECODED_SIZE &&
+		    sco_framing_get_space(&this->framing) < MSBC_PACKET_SIZE)
+			break;
+
+		memcpy(&this->msbc_pcm[this->msbc_pcm_size], data + taken, n);
+		this->msbc_pcm_size += n;
+		taken += n;
+
+		if (this->msbc_pcm_size == MSBC_DECODED_SIZE) {
+			if (msbc_encode(&this->msbc, this->msbc_pcm, packet) < 0)
+				spa_log_warn(this->log, NAME " %p: mSBC encoding error", this);
+			else
+				sco_framing_push(&this->framing, packet, sizeof(packet));
+			this->msbc_pcm_size = 0;
+		}
 	}
+	return taken;
+}
 
-	/* TODO: For now we assume the size is always a mutliple of mtu_size */
-	if (local_total_written != size)
-		spa_log_warn(this->log, "dropping some audio as buffer size is not multiple of mtu");
+static int flush_data(struct impl *this)
+{
+	int res;
 
-	if (total_written)
-		*total_written = local_total_written;
-	return true;
+	res = sco_framing_flush(&this->framing, this->sock_fd);
+	if (res < 0) {
+		spa_log_warn(this->log, NAME " %p: error writing data: %s",
+				this, spa_strerror(res));
+		return res;
+	}
+
+	/* wait for the socket to drain when we could not send it all */
+	if (this->flush_source.loop == NULL)
+		return res;
+	if (sco_framing_get_queued(&this->framing) >= this->write_mtu) {
+		if (!SPA_FLAG_IS_SET(this->flush_source.mask, SPA_IO_OUT)) {
+			this->flush_source.mask = SPA_IO_OUT;
+			spa_loop_update_source(this->data_loop, &this->flush_source);
+		}
+	} else if (this->flush_source.mask != 0) {
+		this->flush_source.mask = 0;
+		spa_loop_update_source(this->data_loop, &this->flush_source);
+	}
+	return res;
 }
 
 static int render_buffers(struct impl *this, uint64_t now_time)
@@ -380,35 +425,48 @@ static int render_buffers(struct impl *this, uint64_t now_time)
 		struct buffer *b;
 		struct spa_data *d;
 		uint32_t offset, size;
-		uint32_t total_written = 0;
+		uint32_t total_written;
+		int res;
 
 		/* Get the buffer and datas */
 		b = spa_list_first(&port->ready, struct buffer, link);
 		d = b->buf->datas;
 
-		/* Get the data, offset and size */
+		/* Get the data, offset and size of what is left to send */
 		src = d[0].data;
-		offset = d[0].chunk->offset;
-		size = d[0].chunk->size;
+		offset = d[0].chunk->offset + port->ready_offset;
+		size = d[0].chunk->size - port->ready_offset;
 
-		/* Write data */
-		if (!write_data(this, src + offset, size, &total_written)) {
-			port->need_data = true;
-			spa_list_remove(&b->link);
-			b->outstanding = true;
-			spa_node_call_reuse_buffer(&this->callbacks, 0, b->id);
-			break;
-		}
+		/* Queue data */
+		total_written = push_data(this, src + offset, size);
+		port->ready_offset += total_written;
 
 		/* Update the sample count */
 		this->sample_count += total_written / port->frame_size;
 
+		if (total_written < size) {
+			/* The ring is full, send what we have and keep the rest
+			 * of the buffer until the socket drains */
+			res = flush_data(this);
+			if (res > 0)
+				continue;
+			if (res == 0)
+				break;
+
+			/* Drop the buffer when the socket has an error */
+			port->need_data = true;
+		}
+		port->ready_offset = 0;
+
 		/* Remove the buffer and mark it as reusable */
 		spa_list_remove(&b->link);
 		b->outstanding = true;
 		spa_node_call_reuse_buffer(&this->callbacks, 0, b->id);
 	}
 
+	/* Send the complete packets */
+	flush_data(this);
+
 	/* Set next timeout */
 	set_next_timeout(this, now_time);
 
@@ -419,22 +477,18 @@ static void fill_socket(struct impl *this)
 {
 	struct port *port = &this->port;
 	static const uint8_t zero_buffer[1024 * 4] = { 0, };
-	uint32_t fill_size = this->write_mtu;
-	uint32_t fills = 0;
-	uint32_t total_written = 0;
-
+	uint32_t fill_size = FILL_FRAMES * this->write_mtu;
+	uint32_t total_written;
 
-	/* Fill the socket */
-	while (fills < FILL_FRAMES) {
-		uint32_t written = 0;
+	/* mSBC packets don't line up with the MTU, fill until the ring
+	 * has enough for the packets */
+	if (this->use_msbc)
+		fill_size = (fill_size + MSBC_PACKET_SIZE - 1) /
+			MSBC_PACKET_SIZE * MSBC_DECODED_SIZE;
 
-		/* Write the data */
-		if (!write_data(this, zero_buffer, fill_size, &written))
-			break;
-
-		total_written += written;
-		fills++;
-	}
+	/* Queue silence and fill the socket */
+	total_written = push_data(this, zero_buffer, SPA_MIN(fill_size, sizeof(zero_buffer)));
+	flush_data(this);
 
 	/* Update the sample count */
 	this->sample_count += total_written / port->frame_size;
@@ -520,6 +574,19 @@ static int do_start(struct impl *this)
 
 	/* Set the write MTU */
 	this->write_mtu = this->transport->write_mtu;
+	sco_framing_init(&this->framing, this->write_mtu);
+	this->port.ready_offset = 0;
+
+	this->use_msbc = this->transport->codec == HFP_AUDIO_CODEC_MSBC;
+	if (this->use_msbc) {
+		if ((val = msbc_init(&this->msbc)) < 0) {
+			spa_log_error(this->log, "sco-sink %p: can't init mSBC: %s",
+					this, spa_strerror(val));
+			goto fail_release;
+		}
+		this->msbc_pcm_size = 0;
+	}
+
 	val = FILL_FRAMES * this->transport->write_mtu;
 	if (setsockopt(this->sock_fd, SOL_SOCKET, SO_SNDBUF, &val, sizeof(val)) < 0)
 		spa_log_warn(this->log, "sco-sink %p: SO_SNDBUF %m", this);
@@ -557,6 +624,13 @@ static int do_start(struct impl *this)
 	this->started = true;
 
 	return 0;
+
+fail_release:
+	spa_bt_transport_release(this->transport);
+	shutdown(this->sock_fd, SHUT_RDWR);
+	close(this->sock_fd);
+	this->sock_fd = -1;
+	return val;
 }
 
 static int do_remove_source(struct spa_loop *loop,
@@ -590,6 +664,9 @@ static int do_stop(struct impl *this)
 
 	this->started = false;
 
+	if (this->use_msbc)
+		msbc_deinit(&this->msbc);
+
 	if (this->transport) {
 		/* Release the transport */
 		res = spa_bt_transport_release(this->transport);
@@ -757,12 +834,12 @@ impl_node_port_enum_params(void *object, int seq,
 		info.channels = 1;
 		info.position[0] = SPA_AUDIO_CHANNEL_MONO;
 
-		/* TODO: For now we only handle HSP profiles which has always CVSD format,
-		 * but we eventually need to support HFP that can have both CVSD and MSBC formats */
-
 		 /* CVSD format has a rate of 8kHz
 		  * MSBC format has a rate of 16kHz */
-		info.rate = 8000;
+		if (this->transport && this->transport->codec == HFP_AUDIO_CODEC_MSBC)
+			info.rate = MSBC_RATE;
+		else
+			info.rate = 8000;
 
 		/* build the param */
 		param = spa_format_audio_raw_build(&b, id, &info);
@@ -37,6 +37,7 @@
 #include <spa/utils/list.h>
 #include <spa/utils/keys.h>
 #include <spa/utils/names.h>
+#include <spa/utils/result.h>
 #include <spa/monitor/device.h>
 
 #include <spa/node/node.h>
@@ -49,6 +50,8 @@
 #include <spa/pod/filter.h>
 
 #include "defs.h"
+#include "jitter-buffer.h"
+#include "msbc.h"
 
 struct props {
 	uint32_t min_latency;
@@ -58,6 +61,10 @@ struct props {
 #define FILL_FRAMES 2
 #define MAX_BUFFERS 32
 
+#define JB_SIZE		(1u << 14)
+#define JB_MIN_TARGET	20	/* ms */
+#define JB_MAX_TARGET	200	/* ms */
+
 struct buffer {
 	uint32_t id;
 	unsigned int outstanding:1;
@@ -74,6 +81,7 @@ struct port {
 	uint64_t info_all;
 	struct spa_port_info info;
 	struct spa_io_buffers *io;
+	struct spa_io_rate_match *rate_match;
 	struct spa_param_info params[8];
 
 	struct buffer buffers[MAX_BUFFERS];
@@ -118,6 +126,17 @@ struct impl {
 	struct timespec now;
 	uint32_t sample_count;
 	uint32_t read_mtu;
+
+	/* when following, the socket data goes here and process() takes
+	 * as much as the resampler asks for */
+	struct jitter_buffer jb;
+	uint8_t jb_data[JB_SIZE];
+	uint8_t buffer_read[4096];
+
+	/* mSBC packets are read into buffer_read and decoded */
+	unsigned int use_msbc:1;
+	struct msbc msbc;
+	uint8_t buffer_decode[MSBC_DECODED_SIZE * 80];
 };
 
 #define NAME "sco-source"
@@ -210,6 +229,16 @@ static int impl_node_enum_params(void *object, int seq,
 	return 0;
 }
 
+static void reset_jitter_buffer(struct impl *this)
+{
+	struct port *port = &this->port;
+	uint32_t rate = port->current_format.info.raw.rate;
+
+	jitter_buffer_init(&this->jb, this->jb_data, sizeof(this->jb_data),
+			port->frame_size, rate,
+			rate * JB_MIN_TARGET / 1000, rate * JB_MAX_TARGET / 1000);
+}
+
 static int do_reassign_follower(struct spa_loop *loop,
 			bool async,
 			uint32_t seq,
@@ -217,6 +246,11 @@ static int do_reassign_follower(struct spa_loop *loop,
 			size_t size,
 			void *user_data)
 {
+	struct impl *this = user_data;
+
+	reset_jitter_buffer(this);
+	if (this->port.rate_match)
+		SPA_FLAG_CLEAR(this->port.rate_match->flags, SPA_IO_RATE_MATCH_FLAG_ACTIVE);
 	return 0;
 }
 
@@ -327,6 +361,37 @@ done:
 	return true;
 }
 
+/* Reads the socket into data, decoding mSBC, at most size bytes of audio */
+static bool read_audio(struct impl *this, uint8_t *data, uint32_t size, uint32_t *total_read)
+{
+	uint32_t n_read, max_read;
+	size_t consumed, written;
+
+	if (!this->use_msbc)
+		return read_data(this, data, size, total_read);
+
+	/* a packet decodes to MSBC_DECODED_SIZE bytes, leave room for the one
+	 * that was partly read before and for the silence of lost ones */
+	max_read = size / MSBC_DECODED_SIZE;
+	max_read = max_read > 4 ? (max_read - 4) * MSBC_PACKET_SIZE : 0;
+	max_read = SPA_MIN(max_read, (uint32_t)sizeof(this->buffer_read));
+	if (max_read < this->read_mtu) {
+		*total_read = 0;
+		return true;
+	}
+
+	if (!read_data(this, this->buffer_read, max_read, &n_read))
+		return false;
+
+	consumed = msbc_decode(&this->msbc, this->buffer_read, n_read, data, size, &written);
+	if (consumed < n_read)
+		spa_log_warn(this->log, NAME " %p: dropping %zd bytes of mSBC data",
+				this, n_read - consumed);
+
+	*total_read = written;
+	return true;
+}
+
 static void recycle_buffer(struct impl *this, struct port *port, uint32_t buffer_id)
 {
 	struct buffer *b = &port->buffers[buffer_id];
@@ -350,6 +415,21 @@ static void sco_on_ready_read(struct spa_source *source)
 
 	spa_return_if_fail(io != NULL);
 
+	if (this->following) {
+		uint8_t *data = this->use_msbc ? this->buffer_decode : this->buffer_read;
+		uint32_t size = this->use_msbc ? sizeof(this->buffer_decode) : sizeof(this->buffer_read);
+
+		if (!read_audio(this, data, size, &total_read)) {
+			if (this->source.loop)
+				spa_loop_remove_source(this->data_loop, &this->source);
+			return;
+		}
+		total_read /= port->frame_size;
+		jitter_buffer_write(&this->jb, data, total_read);
+		this->sample_count += total_read;
+		return;
+	}
+
 	/* Read a buffer if there is one free */
 	if (!spa_list_is_empty(&port->free)) {
 		/* Get the free buffer and remove it from the free list */
@@ -360,7 +440,7 @@ static void sco_on_ready_read(struct spa_source *source)
 		spa_assert(buffer_data->data);
 
 		/* Read sco data */
-		if (!read_data(this, buffer_data->data, buffer_data->maxsize, &total_read)) {
+		if (!read_audio(this, buffer_data->data, buffer_data->maxsize, &total_read)) {
 			if (this->source.loop)
 				spa_loop_remove_source(this->data_loop, &this->source);
 			return;
@@ -379,6 +459,9 @@ static void sco_on_ready_read(struct spa_source *source)
 			/* Add the buffer to the ready list */
 			buffer->outstanding = true;
 			spa_list_append(&port->ready, &buffer->link);
+		} else {
+			/* Nothing to decode yet, keep the buffer for the next read */
+			spa_list_prepend(&port->free, &buffer->link);
 		}
 	}
 
@@ -431,6 +514,17 @@ static int do_start(struct impl *this)
 
 	/* Set the read MTU */
 	this->read_mtu = this->transport->read_mtu;
+
+	this->use_msbc = this->transport->codec == HFP_AUDIO_CODEC_MSBC;
+	if (this->use_msbc && (val = msbc_init(&this->msbc)) < 0) {
+		spa_log_error(this->log, "sco-source %p: can't init mSBC: %s",
+				this, spa_strerror(val));
+		spa_bt_transport_release(this->transport);
+		shutdown(this->sock_fd, SHUT_RDWR);
+		close(this->sock_fd);
+		this->sock_fd = -1;
+		return val;
+	}
 	val = FILL_FRAMES * this->read_mtu;
 	if (setsockopt(this->sock_fd, SOL_SOCKET, SO_RCVBUF, &val, sizeof(val)) < 0)
 		spa_log_warn(this->log, "sco-source %p: SO_RCVBUF %m", this);
@@ -442,7 +536,9 @@ static int do_start(struct impl *this)
 
 	/* Reset the buffers and sample count */
 	reset_buffers(&this->port);
+	reset_jitter_buffer(this);
 	this->sample_count = 0;
+	this->following = is_following(this);
 
 	/* Add the ready read callback */
 	this->source.data = this;
@@ -486,6 +582,9 @@ static int do_stop(struct impl *this)
 
 	this->started = false;
 
+	if (this->use_msbc)
+		msbc_deinit(&this->msbc);
+
 	if (this->transport) {
 		/* Release the transport */
 		res = spa_bt_transport_release(this->transport);
@@ -656,12 +755,12 @@ impl_node_port_enum_params(void *object, int seq,
 		info.channels = 1;
 		info.position[0] = SPA_AUDIO_CHANNEL_MONO;
 
-		 /* TODO: For now we only handle HSP profiles which has always CVSD format,
-		 * but we eventually need to support HFP that can have both CVSD and MSBC formats */
-
 		 /* CVSD format has a rate of 8kHz
 		  * MSBC format has a rate of 16kHz */
-		info.rate = 8000;
+		if (this->transport && this->transport->codec == HFP_AUDIO_CODEC_MSBC)
+			info.rate = MSBC_RATE;
+		else
+			info.rate = 8000;
 
 		/* build the param */
 		param = spa_format_audio_raw_build(&b, id, &info);
@@ -705,6 +804,25 @@ impl_node_port_enum_params(void *object, int seq,
 		}
 		break;
 
+	case SPA_PARAM_IO:
+		switch (result.index) {
+		case 0:
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_ParamIO, id,
+				SPA_PARAM_IO_id,   SPA_POD_Id(SPA_IO_Buffers),
+				SPA_PARAM_IO_size, SPA_POD_Int(sizeof(struct spa_io_buffers)));
+			break;
+		case 1:
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_ParamIO, id,
+				SPA_PARAM_IO_id,   SPA_POD_Id(SPA_IO_RateMatch),
+				SPA_PARAM_IO_size, SPA_POD_Int(sizeof(struct spa_io_rate_match)));
+			break;
+		default:
+			return 0;
+		}
+		break;
+
 	default:
 		return -ENOENT;
 	}
@@ -864,6 +982,9 @@ impl_node_port_set_io(void *object,
 	case SPA_IO_Buffers:
 		port->io = data;
 		break;
+	case SPA_IO_RateMatch:
+		port->rate_match = data;
+		break;
 	default:
 		return -ENOENT;
 	}
@@ -891,6 +1012,62 @@ static int impl_node_port_reuse_buffer(void *object, uint32_t port_id, uint32_t
 	return 0;
 }
 
+static int process_follower(struct impl *this)
+{
+	struct port *port = &this->port;
+	struct spa_io_buffers *io = port->io;
+	struct buffer *buffer;
+	struct spa_data *d;
+	uint32_t frames, quantum;
+
+	if (io->status == SPA_STATUS_HAVE_DATA)
+		return SPA_STATUS_HAVE_DATA;
+
+	if (spa_list_is_empty(&port->free)) {
+		spa_log_warn(this->log, NAME " %p: out of buffers", this);
+		return io->status;
+	}
+
+	quantum = this->position->clock.duration;
+	if (port->rate_match && port->rate_match->size > 0)
+		frames = port->rate_match->size;
+	else
+		frames = quantum;
+
+	buffer = spa_list_first(&port->free, struct buffer, link);
+	spa_list_remove(&buffer->link);
+
+	d = buffer->buf->datas;
+	frames = SPA_MIN(frames, d[0].maxsize / port->frame_size);
+
+	if (buffer->h) {
+		buffer->h->seq = this->sample_count;
+		buffer->h->pts = this->position->clock.nsec;
+		buffer->h->dts_offset = 0;
+	}
+
+	if (jitter_buffer_read(&this->jb, d[0].data, frames, quantum) < frames)
+		spa_log_trace(this->log, NAME " %p: underrun fill:%u target:%u", this,
+				jitter_buffer_get_fill(&this->jb), this->jb.target);
+
+	d[0].chunk->offset = 0;
+	d[0].chunk->size = frames * port->frame_size;
+	d[0].chunk->stride = port->frame_size;
+
+	if (port->rate_match) {
+		port->rate_match->rate = jitter_buffer_get_rate(&this->jb);
+		SPA_FLAG_SET(port->rate_match->flags, SPA_IO_RATE_MATCH_FLAG_ACTIVE);
+	}
+
+	io->buffer_id = buffer->id;
+	io->status = SPA_STATUS_HAVE_DATA;
+
+	spa_list_append(&port->free, &buffer->link);
+	buffer->outstanding = false;
+
+	return SPA_STATUS_HAVE_DATA;
+}
+
 static int impl_node_process(void *object)
 {
 	struct impl *this = object;
@@ -904,6 +1081,9 @@ static int impl_node_process(void *object)
 	io = port->io;
 	spa_return_val_if_fail(io != NULL, -EIO);
 
+	if (this->following)
+		return process_follower(this);
+
 	/* Return if we already have a buffer */
 	if (io->status == SPA_STATUS_HAVE_DATA)
 		return SPA_STATUS_HAVE_DATA;
@@ -0,0 +1,255 @@
+/* Spa A2DP rate control test
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/sockios.h>
+
+#include <spa/utils/defs.h>
+
+#include "a2dp-rate-control.h"
+
+/* A simulated link: the encoder sends a packet every PACKET_MSEC, its size
+ * follows the bitpool like SBC does. The other end of a socketpair drains
+ * the socket at a configurable byte rate, in virtual time. */
+#define PACKET_MSEC	10
+#define BYTES_PER_BITPOOL 10
+#define MIN_BITPOOL	2
+#define MAX_BITPOOL	53
+#define TARGET		(20 * SPA_NSEC_PER_MSEC)
+#define RATE		48000
+#define PACKET_FRAMES	(PACKET_MSEC * RATE / 1000)
+
+struct sim {
+	int fd[2];
+	int sndbuf;
+	int bitpool;
+	double budget;		/* bytes the reader may still drain */
+	uint64_t now;
+	struct a2dp_rate_control rc;
+	int packet_cost;
+	uint64_t max_delay;
+	uint32_t n_failed;
+};
+
+static void sim_init(struct sim *s)
+{
+	int val = 4096;
+	socklen_t len;
+
+	spa_assert(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, s->fd) == 0);
+	spa_assert(setsockopt(s->fd[0], SOL_SOCKET, SO_SNDBUF, &val, sizeof(val)) == 0);
+	/* read it back like the sink does, the kernel doubles it */
+	len = sizeof(s->sndbuf);
+	spa_assert(getsockopt(s->fd[0], SOL_SOCKET, SO_SNDBUF, &s->sndbuf, &len) == 0);
+
+	s->bitpool = MAX_BITPOOL;
+	s->budget = 0;
+	s->now = 0;
+	a2dp_rate_control_init(&s->rc, TARGET);
+}
+
+static void sim_clear(struct sim *s)
+{
+	close(s->fd[0]);
+	close(s->fd[1]);
+}
+
+static void sim_drain(struct sim *s, double bytes)
+{
+	uint8_t buf[4096];
+	ssize_t len;
+
+	s->budget += bytes;
+	while (s->budget > 0) {
+		if ((len = recv(s->fd[1], buf, sizeof(buf), 0)) < 0) {
+			spa_assert(errno == EAGAIN);
+			/* an idle link does not save up capacity */
+			s->budget = 0;
+			break;
+		}
+		s->budget -= len;
+	}
+}
+
+/* Bluetooth sockets return the free space in the send buffer for TIOCOUTQ,
+ * unix sockets return the queued bytes. Give what the sink would see. */
+static int sim_outq(struct sim *s)
+{
+	int queued;
+
+	spa_assert(ioctl(s->fd[0], SIOCOUTQ, &queued) == 0);
+	return s->sndbuf - queued;
+}
+
+static void sim_send(struct sim *s)
+{
+	uint8_t buf[MAX_BITPOOL * BYTES_PER_BITPOOL] = { 0, };
+	int size = s->bitpool * BYTES_PER_BITPOOL, res;
+	uint32_t queued, after;
+	uint64_t delay;
+	bool failed;
+
+	queued = a2dp_rate_control_queued(s->sndbuf, sim_outq(s));
+
+	failed = send(s->fd[0], buf, size, 0) < 0;
+	if (failed) {
+		spa_assert(errno == EAGAIN);
+		s->n_failed++;
+	} else {
+		/* unix sockets count the kernel overhead of each packet, learn
+		 * the real cost of a packet to turn the queue into time */
+		after = a2dp_rate_control_queued(s->sndbuf, sim_outq(s));
+		if (after > queued)
+			s->packet_cost = after - queued;
+	}
+
+	delay = a2dp_rate_control_queue_delay(queued, PACKET_FRAMES, s->packet_cost, RATE);
+	s->max_delay = SPA_MAX(s->max_delay, delay);
+
+	res = a2dp_rate_control_update(&s->rc, s->now, delay, failed);
+	/* the steps of the SBC codec */
+	if (res < 0)
+		s->bitpool = SPA_MAX(s->bitpool + 2 * res, MIN_BITPOOL);
+	else if (res > 0)
+		s->bitpool = SPA_MIN(s->bitpool + res, MAX_BITPOOL);
+}
+
+/* run for msec at a drain rate of rate bytes per second */
+static void sim_run(struct sim *s, uint32_t msec, double rate)
+{
+	uint32_t i;
+
+	s->max_delay = 0;
+	s->n_failed = 0;
+
+	for (i = 0; i < msec; i++) {
+		sim_drain(s, rate / 1000.0);
+		if (s->now % (PACKET_MSEC * SPA_NSEC_PER_MSEC) == 0)
+			sim_send(s);
+		s->now += SPA_NSEC_PER_MSEC;
+	}
+	fprintf(stderr, "rate %6.0f: bitpool %2d max delay %3"PRIu64"ms failed %u\n",
+			rate, s->bitpool, (uint64_t)(s->max_delay / SPA_NSEC_PER_MSEC), s->n_failed);
+}
+
+static void test_throttle(void)
+{
+	struct sim s;
+	/* what the top bitpool needs */
+	const double full = MAX_BITPOOL * BYTES_PER_BITPOOL * 1000.0 / PACKET_MSEC;
+
+	spa_zero(s);
+	sim_init(&s);
+
+	/* enough bandwidth, nothing changes */
+	sim_run(&s, 5000, full * 1.5);
+	spa_assert(s.bitpool == MAX_BITPOOL);
+	spa_assert(s.n_failed == 0);
+
+	/* the link halves, the bitpool must follow and settle */
+	sim_run(&s, 10000, full * 0.5);
+	spa_assert(s.bitpool < MAX_BITPOOL * 0.6);
+	sim_run(&s, 5000, full * 0.5);
+	spa_assert(s.n_failed == 0);
+	spa_assert(s.max_delay < 2 * TARGET);
+	/* it keeps probing around the link rate */
+	spa_assert(s.bitpool > MAX_BITPOOL * 0.5 * 0.6);
+	spa_assert(s.bitpool < MAX_BITPOOL * 0.5 * 1.2);
+
+	/* the link recovers, so does the bitpool */
+	sim_run(&s, 30000, full * 1.5);
+	spa_assert(s.bitpool == MAX_BITPOOL);
+	spa_assert(s.n_failed == 0);
+
+	sim_clear(&s);
+}
+
+static void test_queue(void)
+{
+	struct sim s;
+	uint8_t buf[MAX_BITPOOL * BYTES_PER_BITPOOL] = { 0, };
+	int queued, i;
+
+	spa_zero(s);
+	sim_init(&s);
+
+	/* an empty socket has nothing queued */
+	spa_assert(a2dp_rate_control_queued(s.sndbuf, sim_outq(&s)) == 0);
+
+	/* the free space converts back to what the kernel has queued */
+	for (i = 0; i < 4; i++) {
+		spa_assert(send(s.fd[0], buf, sizeof(buf), 0) == sizeof(buf));
+		spa_assert(ioctl(s.fd[0], SIOCOUTQ, &queued) == 0);
+		spa_assert(queued >= (i + 1) * (int)sizeof(buf));
+		spa_assert(a2dp_rate_control_queued(s.sndbuf, sim_outq(&s)) == (uint32_t)queued);
+	}
+	/* more free space than the buffer size, nothing queued */
+	spa_assert(a2dp_rate_control_queued(s.sndbuf, s.sndbuf + 100) == 0);
+
+	/* a packet of 10ms, two of them queued is 20ms */
+	spa_assert(a2dp_rate_control_queue_delay(2 * 530, PACKET_FRAMES, 530, RATE) ==
+			2 * PACKET_MSEC * SPA_NSEC_PER_MSEC);
+	spa_assert(a2dp_rate_control_queue_delay(530, PACKET_FRAMES, 0, RATE) == 0);
+
+	sim_clear(&s);
+}
+
+static void test_failure(void)
+{
+	struct a2dp_rate_control rc;
+	uint64_t now = SPA_NSEC_PER_SEC;
+
+	a2dp_rate_control_init(&rc, TARGET);
+
+	/* a failed write lowers right away, then not faster than down_interval */
+	spa_assert(a2dp_rate_control_update(&rc, now, 0, true) == -1);
+	spa_assert(a2dp_rate_control_update(&rc, now + 1, 0, true) == 0);
+	now += rc.down_interval;
+	spa_assert(a2dp_rate_control_update(&rc, now, 0, true) == -1);
+
+	/* a quiet link raises only after quiet_time, then every up_interval */
+	spa_assert(a2dp_rate_control_update(&rc, now + rc.quiet_time / 2, 0, false) == 0);
+	now += rc.quiet_time;
+	spa_assert(a2dp_rate_control_update(&rc, now, 0, false) == 1);
+	spa_assert(a2dp_rate_control_update(&rc, now + 1, 0, false) == 0);
+	now += rc.up_interval;
+	spa_assert(a2dp_rate_control_update(&rc, now, 0, false) == 1);
+
+	/* a queue far above the target takes bigger steps */
+	now += rc.down_interval;
+	spa_assert(a2dp_rate_control_update(&rc, now, 100 * TARGET, false) ==
+			-A2DP_RATE_CONTROL_MAX_STEPS);
+}
+
+int main(int argc, char *argv[])
+{
+	test_queue();
+	test_failure();
+	test_throttle();
+	return 0;
+}
@@ -0,0 +1,320 @@
+/* Spa Bluez5 jitter buffer test
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/socket.h>
+
+#include <spa/utils/defs.h>
+
+#include "jitter-buffer.h"
+
+/* Packet arrival traces are replayed over a socketpair in virtual time. The
+ * receiving end reads the socket into the jitter buffer like the data loop
+ * does and a graph clock pulls a quantum from it, with the input size that
+ * the resampler would ask for at the reported rate. A trace can be given on
+ * the command line as lines of "<usec> <bytes>", one per received packet. */
+#define RATE		48000
+#define FRAME_SIZE	4
+#define QUANTUM		1024
+#define PACKET_FRAMES	512
+#define SETTLE_SEC	20
+
+struct packet {
+	uint64_t time;		/* nsec */
+	uint32_t bytes;
+};
+
+struct trace {
+	struct packet *packets;
+	uint32_t n_packets;
+};
+
+struct stats {
+	uint32_t underruns;
+	double min_rate, max_rate;
+	double fill_sum;
+	uint32_t fill_count;
+	uint32_t target;
+};
+
+static void trace_add(struct trace *t, uint64_t time, uint32_t bytes)
+{
+	if ((t->n_packets & 1023) == 0) {
+		t->packets = realloc(t->packets, (t->n_packets + 1024) * sizeof(struct packet));
+		spa_assert(t->packets != NULL);
+	}
+	t->packets[t->n_packets].time = time;
+	t->packets[t->n_packets].bytes = bytes;
+	t->n_packets++;
+}
+
+/* Packets of PACKET_FRAMES from a device whose clock is off by ppm. The
+ * controller hands them over in bursts of up to 3 packets, about every
+ * 20 msec there is a late one and every few seconds the link stalls for
+ * 60 msec and then catches up. */
+static void trace_synthesize(struct trace *t, double ppm, uint32_t seconds)
+{
+	uint64_t period = PACKET_FRAMES * SPA_NSEC_PER_SEC / RATE;
+	uint32_t i, n_packets = seconds * RATE / PACKET_FRAMES;
+	uint64_t last = 0;
+
+	srand(1234);
+	for (i = 0; i < n_packets; i++) {
+		uint64_t time = i * period / (1.0 + ppm / 1e6);
+
+		time += (i % 3) == 0 ? 0 : (3 - i % 3) * period / 2;
+		time += rand() % (4 * SPA_NSEC_PER_MSEC);
+		if (rand() % 4 == 0)
+			time += 8 * SPA_NSEC_PER_MSEC;
+		if ((i % 300) >= 295)
+			time = (i - i % 300 + 300) * period / (1.0 + ppm / 1e6);
+
+		last = SPA_MAX(last, time);
+		trace_add(t, last, PACKET_FRAMES * FRAME_SIZE);
+	}
+}
+
+static int trace_load(struct trace *t, const char *filename)
+{
+	FILE *f;
+	uint64_t usec;
+	uint32_t bytes;
+
+	if ((f = fopen(filename, "r")) == NULL)
+		return -errno;
+	while (fscanf(f, "%"SCNu64" %u", &usec, &bytes) == 2)
+		trace_add(t, usec * SPA_NSEC_PER_USEC, bytes);
+	fclose(f);
+	return 0;
+}
+
+static void replay(struct trace *t, double graph_ppm, struct stats *st)
+{
+	struct jitter_buffer jb;
+	static uint8_t jb_data[1u << 17];
+	uint8_t buf[8192], out[QUANTUM * 2 * FRAME_SIZE];
+	uint64_t cycle = 0, now, next_cycle, settle;
+	uint32_t i = 0, frames, settle_underruns = 0;
+	double period, accum = 0.0, rate;
+	ssize_t len;
+	int fd[2];
+
+	spa_assert(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, fd) == 0);
+
+	jitter_buffer_init(&jb, jb_data, sizeof(jb_data), FRAME_SIZE, RATE,
+			RATE * 20 / 1000, RATE * 200 / 1000);
+
+	memset(st, 0, sizeof(*st));
+	st->min_rate = st->max_rate = 1.0;
+
+	period = (double)QUANTUM * SPA_NSEC_PER_SEC / RATE / (1.0 + graph_ppm / 1e6);
+	settle = t->packets[0].time + SETTLE_SEC * SPA_NSEC_PER_SEC;
+	next_cycle = t->packets[0].time;
+
+	while (i < t->n_packets) {
+		now = SPA_MIN(t->packets[i].time, next_cycle);
+
+		/* everything that arrived before now goes through the socket */
+		while (i < t->n_packets && t->packets[i].time <= now) {
+			memset(buf, 0, t->packets[i].bytes);
+			spa_assert(write(fd[0], buf, t->packets[i].bytes) ==
+					(ssize_t)t->packets[i].bytes);
+			i++;
+		}
+		while ((len = read(fd[1], buf, sizeof(buf))) > 0)
+			jitter_buffer_write(&jb, buf, len / FRAME_SIZE);
+		spa_assert(len < 0 && errno == EAGAIN);
+
+		if (now < next_cycle)
+			continue;
+
+		/* the resampler asks for quantum / rate input frames */
+		rate = jitter_buffer_get_rate(&jb);
+		accum += QUANTUM / rate;
+		frames = (uint32_t)accum;
+		accum -= frames;
+
+		jitter_buffer_read(&jb, out, frames, QUANTUM);
+
+		if (now <= settle) {
+			settle_underruns = jb.underruns;
+		} else {
+			rate = jitter_buffer_get_rate(&jb);
+			st->min_rate = SPA_MIN(st->min_rate, rate);
+			st->max_rate = SPA_MAX(st->max_rate, rate);
+			st->fill_sum += jitter_buffer_get_fill(&jb);
+			st->fill_count++;
+		}
+		next_cycle = t->packets[0].time + (uint64_t)(++cycle * period);
+	}
+	st->target = jb.target;
+	st->underruns = jb.underruns - settle_underruns;
+
+	fprintf(stderr, "graph %+5.0fppm: rate %.6f..%.6f avg fill %5.0f target %5u "
+			"underruns %u (%u while settling, overruns %u)\n",
+			graph_ppm, st->min_rate, st->max_rate,
+			st->fill_sum / SPA_MAX(st->fill_count, 1u), st->target,
+			st->underruns, settle_underruns, jb.overruns);
+
+	close(fd[0]);
+	close(fd[1]);
+}
+
+static void test_drift(void)
+{
+	struct trace t = { 0 };
+	struct stats st;
+	double ppm[] = { 0.0, 300.0, -300.0 };
+	uint32_t i;
+
+	trace_synthesize(&t, 0.0, 120);
+
+	for (i = 0; i < SPA_N_ELEMENTS(ppm); i++) {
+		replay(&t, ppm[i], &st);
+
+		spa_assert(st.underruns == 0);
+		spa_assert(st.target <= RATE * 200 / 1000);
+		/* the rate follows the clock drift, it does not hunt */
+		spa_assert(st.min_rate > 1.0 + ppm[i] / 1e6 - 0.002);
+		spa_assert(st.max_rate < 1.0 + ppm[i] / 1e6 + 0.002);
+		/* the fill stays around the target */
+		spa_assert(st.fill_sum / st.fill_count > st.target / 2.0);
+		spa_assert(st.fill_sum / st.fill_count < st.target * 2.0);
+	}
+	free(t.packets);
+}
+
+static void test_reset(void)
+{
+	struct jitter_buffer jb;
+	uint8_t data[4096], in[64 * FRAME_SIZE], out[64 * FRAME_SIZE];
+	uint32_t i;
+
+	jitter_buffer_init(&jb, data, sizeof(data), FRAME_SIZE, RATE, 128, 512);
+	spa_assert(jb.target == 128);
+
+	/* nothing comes out before the target is reached */
+	for (i = 0; i < sizeof(in); i++)
+		in[i] = i;
+	spa_assert(jitter_buffer_write(&jb, in, 64) == 64);
+	memset(out, 0xff, sizeof(out));
+	spa_assert(jitter_buffer_read(&jb, out, 64, 64) == 0);
+	spa_assert(out[0] == 0 && out[sizeof(out) - 1] == 0);
+	spa_assert(jitter_buffer_get_fill(&jb) == 64);
+
+	spa_assert(jitter_buffer_write(&jb, in, 64) == 64);
+	spa_assert(jitter_buffer_read(&jb, out, 64, 64) == 64);
+	spa_assert(memcmp(in, out, sizeof(in)) == 0);
+
+	/* running dry raises the target when data comes in again, by at
+	 * least the frames we went without */
+	spa_assert(jitter_buffer_read(&jb, out, 128, 64) == 64);
+	spa_assert(jb.underruns == 1);
+	spa_assert(jitter_buffer_read(&jb, out, 64, 64) == 0);
+	spa_assert(jitter_buffer_read(&jb, out, 64, 64) == 0);
+	spa_assert(jb.target == 128);
+	spa_assert(jitter_buffer_write(&jb, in, 64) == 64);
+	spa_assert(jitter_buffer_read(&jb, out, 64, 64) == 0);
+	spa_assert(jb.target == 128 + 64 + 64 + 64 + 64);
+
+	/* a full buffer drops the oldest data */
+	for (i = 0; i < 20; i++)
+		jitter_buffer_write(&jb, in, 64);
+	spa_assert(jb.overruns > 0);
+	spa_assert(jitter_buffer_get_fill(&jb) == sizeof(data) / FRAME_SIZE);
+
+	jitter_buffer_reset(&jb);
+	spa_assert(jitter_buffer_get_fill(&jb) == 0);
+	spa_assert(jb.target == 128);
+	spa_assert(jitter_buffer_get_rate(&jb) == 1.0);
+}
+
+static void test_overrun(void)
+{
+	struct jitter_buffer jb;
+	static uint8_t big[1000 * 6];
+	uint8_t data[4096], in[100 * 6], out[100 * 6];
+	uint32_t i, j, fill, first;
+
+	/* 4096 is not a multiple of the frame size, only whole frames are
+	 * kept and dropped */
+	jitter_buffer_init(&jb, data, sizeof(data), 6, RATE, 16, 512);
+
+	for (i = 0; i < 20; i++) {
+		for (j = 0; j < sizeof(in); j++)
+			in[j] = (i * 100 + j / 6) & 0xff;
+		spa_assert(jitter_buffer_write(&jb, in, 100) == 100);
+	}
+	spa_assert(jb.overruns > 0);
+	fill = jitter_buffer_get_fill(&jb);
+	spa_assert(fill == sizeof(data) / 6);
+
+	/* the newest frames are left, in order and each one complete */
+	first = 20 * 100 - fill;
+	while (fill > 0) {
+		uint32_t n = SPA_MIN(fill, 100u);
+		spa_assert(jitter_buffer_read(&jb, out, n, n) == n);
+		for (j = 0; j < n * 6; j++)
+			spa_assert(out[j] == ((first + j / 6) & 0xff));
+		first += n;
+		fill -= n;
+	}
+	spa_assert(jitter_buffer_get_fill(&jb) == 0);
+
+	/* a write larger than the buffer keeps its last frames */
+	for (j = 0; j < sizeof(big); j++)
+		big[j] = (j / 6) & 0xff;
+	spa_assert(jitter_buffer_write(&jb, big, 1000) == sizeof(data) / 6);
+	spa_assert(jitter_buffer_read(&jb, out, 16, 16) == 16);
+	first = 1000 - sizeof(data) / 6;
+	for (j = 0; j < 16 * 6; j++)
+		spa_assert(out[j] == ((first + j / 6) & 0xff));
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc > 1) {
+		struct trace t = { 0 };
+		struct stats st;
+
+		if (trace_load(&t, argv[1]) < 0 || t.n_packets == 0) {
+			fprintf(stderr, "can't load trace %s: %m\n", argv[1]);
+			return -1;
+		}
+		replay(&t, 0.0, &st);
+		free(t.packets);
+		return st.underruns == 0 ? 0 : -1;
+	}
+
+	test_reset();
+	test_overrun();
+	test_drift();
+
+	return 0;
+}
@@ -0,0 +1,255 @@
+/* Spa Bluez5 SCO framing test
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <spa/utils/defs.h>
+
+#include "sco-framing.h"
+#include "msbc.h"
+
+/* Data goes through the framing ring into one end of a socketpair, like
+ * sco-sink does, and is read back in MTU sized packets from the other end,
+ * like sco-source does. The socket buffer is kept small so that writes
+ * also hit EAGAIN. The MTU can be given on the command line. */
+#define N_FRAMES	400
+#define MAX_MTU		1024
+
+static void open_link(int fd[2])
+{
+	int val = 1024;
+
+	spa_assert(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, fd) == 0);
+	spa_assert(setsockopt(fd[0], SOL_SOCKET, SO_SNDBUF, &val, sizeof(val)) == 0);
+}
+
+static void close_link(int fd[2])
+{
+	close(fd[0]);
+	close(fd[1]);
+}
+
+/* Reads all queued packets, checks that each is exactly mtu. */
+static uint32_t receive(int fd, uint32_t mtu, uint8_t *data, uint32_t size)
+{
+	uint8_t packet[MAX_MTU + 1];
+	uint32_t total = 0;
+	ssize_t len;
+
+	while ((len = read(fd, packet, sizeof(packet))) > 0) {
+		spa_assert(len == (ssize_t)mtu);
+		spa_assert(total + len <= size);
+		memcpy(data + total, packet, len);
+		total += len;
+	}
+	spa_assert(len < 0 && errno == EAGAIN);
+	return total;
+}
+
+static void test_framing(uint32_t mtu)
+{
+	static struct sco_framing f;
+	static uint8_t in[N_FRAMES * MSBC_PACKET_SIZE], out[sizeof(in)];
+	uint32_t i, pushed = 0, received = 0, again = 0, chunk;
+	int fd[2], res;
+
+	open_link(fd);
+	sco_framing_init(&f, mtu);
+
+	for (i = 0; i < sizeof(in); i++)
+		in[i] = i * 7 + (i >> 8);
+
+	/* chunks of all sizes, never aligned to the mtu */
+	for (chunk = 1; pushed < sizeof(in); chunk = chunk % 97 + 13) {
+		pushed += sco_framing_push(&f, &in[pushed], SPA_MIN(chunk, sizeof(in) - pushed));
+
+		res = sco_framing_flush(&f, fd[0]);
+		spa_assert(res >= 0);
+		if (sco_framing_get_queued(&f) >= mtu) {
+			/* the socket is full, the rest waits in the ring */
+			again++;
+			received += receive(fd[1], mtu, &out[received], sizeof(out) - received);
+		}
+	}
+	while (sco_framing_get_queued(&f) >= mtu) {
+		spa_assert(sco_framing_flush(&f, fd[0]) >= 0);
+		received += receive(fd[1], mtu, &out[received], sizeof(out) - received);
+	}
+	received += receive(fd[1], mtu, &out[received], sizeof(out) - received);
+
+	/* everything but the last partial packet made it, in order */
+	spa_assert(received == sizeof(in) / mtu * mtu);
+	spa_assert(sco_framing_get_queued(&f) == sizeof(in) - received);
+	spa_assert(memcmp(in, out, received) == 0);
+
+	fprintf(stderr, "mtu %3u: %u bytes in %u packets, %u times full\n",
+			mtu, received, received / mtu, again);
+
+	close_link(fd);
+}
+
+static double rms(const int16_t *s, uint32_t n_samples)
+{
+	double sum = 0.0;
+	uint32_t i;
+	for (i = 0; i < n_samples; i++)
+		sum += (double)s[i] * s[i];
+	return sqrt(sum / SPA_MAX(n_samples, 1u));
+}
+
+static void test_msbc(uint32_t mtu, uint32_t drop)
+{
+	static struct sco_framing f;
+	static int16_t pcm[N_FRAMES * MSBC_DECODED_SIZE / 2];
+	static int16_t decoded[(N_FRAMES + 4) * MSBC_DECODED_SIZE / 2];
+	static uint8_t stream[N_FRAMES * MSBC_PACKET_SIZE];
+	struct msbc enc, dec;
+	uint8_t packet[MSBC_PACKET_SIZE];
+	uint32_t i, n_packets = 0, received = 0, offset = 0;
+	size_t consumed, written, n_decoded = 0;
+	double in_rms, out_rms;
+	int fd[2];
+
+	open_link(fd);
+	sco_framing_init(&f, mtu);
+	spa_assert(msbc_init(&enc) == 0);
+	spa_assert(msbc_init(&dec) == 0);
+
+	for (i = 0; i < SPA_N_ELEMENTS(pcm); i++)
+		pcm[i] = 8000 * sin(2 * M_PI * 1000 * i / MSBC_RATE);
+
+	for (i = 0; i < N_FRAMES; i++) {
+		spa_assert(msbc_encode(&enc, &pcm[i * MSBC_DECODED_SIZE / 2], packet) ==
+				MSBC_PACKET_SIZE);
+		spa_assert(packet[0] == 0x01);
+
+		/* lose a packet on the way */
+		if (drop > 0 && i == drop)
+			continue;
+		n_packets++;
+
+		while (sco_framing_get_space(&f) < MSBC_PACKET_SIZE) {
+			spa_assert(sco_framing_flush(&f, fd[0]) >= 0);
+			received += receive(fd[1], mtu, &stream[received], sizeof(stream) - received);
+		}
+		spa_assert(sco_framing_push(&f, packet, sizeof(packet)) == sizeof(packet));
+	}
+	while (sco_framing_get_queued(&f) >= mtu) {
+		spa_assert(sco_framing_flush(&f, fd[0]) >= 0);
+		received += receive(fd[1], mtu, &stream[received], sizeof(stream) - received);
+	}
+	received += receive(fd[1], mtu, &stream[received], sizeof(stream) - received);
+
+	/* decode the packets as they were read from the socket */
+	while (offset < received) {
+		consumed = msbc_decode(&dec, &stream[offset], SPA_MIN(mtu, received - offset),
+				SPA_MEMBER(decoded, n_decoded, void), sizeof(decoded) - n_decoded,
+				&written);
+		spa_assert(consumed == SPA_MIN(mtu, received - offset));
+		offset += consumed;
+		n_decoded += written;
+	}
+
+	/* whole packets that were sent all decode, a lost one is silence */
+	spa_assert(dec.errors == 0);
+	spa_assert(dec.lost == (drop > 0 ? 1u : 0u));
+	spa_assert(n_decoded / MSBC_DECODED_SIZE ==
+			received / MSBC_PACKET_SIZE + dec.lost);
+
+	/* the codec is lossy, compare the level of the tone past the
+	 * start up of the decoder */
+	in_rms = rms(&pcm[MSBC_DECODED_SIZE], N_FRAMES * MSBC_DECODED_SIZE / 4);
+	out_rms = rms(&decoded[MSBC_DECODED_SIZE], N_FRAMES * MSBC_DECODED_SIZE / 4);
+	fprintf(stderr, "mtu %3u: %u mSBC packets, %zd frames decoded, lost %u, "
+			"level %.0f -> %.0f\n", mtu, n_packets,
+			n_decoded / MSBC_DECODED_SIZE, dec.lost, in_rms, out_rms);
+	if (drop == 0)
+		spa_assert(out_rms > in_rms * 0.7 && out_rms < in_rms * 1.3);
+
+	msbc_deinit(&enc);
+	msbc_deinit(&dec);
+	close_link(fd);
+}
+
+static void test_msbc_resync(void)
+{
+	struct msbc enc, dec;
+	int16_t pcm[MSBC_DECODED_SIZE / 2] = { 0 };
+	uint8_t stream[3 * MSBC_PACKET_SIZE + 7], out[4 * MSBC_DECODED_SIZE];
+	size_t written;
+
+	spa_assert(msbc_init(&enc) == 0);
+	spa_assert(msbc_init(&dec) == 0);
+
+	/* garbage before the first packet and a broken header in the middle */
+	memset(stream, 0x01, 7);
+	msbc_encode(&enc, pcm, &stream[7]);
+	msbc_encode(&enc, pcm, &stream[7 + MSBC_PACKET_SIZE]);
+	msbc_encode(&enc, pcm, &stream[7 + 2 * MSBC_PACKET_SIZE]);
+	stream[7 + MSBC_PACKET_SIZE + 2] = 0;
+
+	spa_assert(msbc_decode(&dec, stream, sizeof(stream), out, sizeof(out), &written) ==
+			sizeof(stream));
+	/* the broken packet is counted as lost and filled in */
+	spa_assert(written == 3 * MSBC_DECODED_SIZE);
+	spa_assert(dec.lost == 1);
+
+	/* no room in the output, nothing is taken */
+	spa_assert(msbc_decode(&dec, stream, sizeof(stream), out,
+				MSBC_DECODED_SIZE - 1, &written) == 0);
+	spa_assert(written == 0);
+
+	msbc_deinit(&enc);
+	msbc_deinit(&dec);
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t mtus[] = { 24, 48, 60, 72, 120 };
+	uint32_t i;
+
+	if (argc > 1) {
+		mtus[0] = atoi(argv[1]);
+		spa_assert(mtus[0] > 0 && mtus[0] <= MAX_MTU);
+		test_framing(mtus[0]);
+		test_msbc(mtus[0], 0);
+		test_msbc(mtus[0], 17);
+		return 0;
+	}
+
+	for (i = 0; i < SPA_N_ELEMENTS(mtus); i++) {
+		test_framing(mtus[i]);
+		test_msbc(mtus[i], 0);
+		test_msbc(mtus[i], 17);
+	}
+	test_msbc_resync();
+
+	return 0;
+}
@@ -0,0 +1,525 @@
+/* Spa Bluez5 SCO nodes test
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <spa/support/loop.h>
+#include <spa/support/system.h>
+#include <spa/support/plugin.h>
+#include <spa/node/node.h>
+#include <spa/node/io.h>
+#include <spa/node/utils.h>
+#include <spa/param/audio/format-utils.h>
+#include <spa/utils/keys.h>
+
+#include "defs.h"
+#include "msbc.h"
+
+extern const struct spa_handle_factory spa_sco_sink_factory;
+extern const struct spa_handle_factory spa_sco_source_factory;
+
+/* sco-sink and sco-source run on a transport that hands out one end of a
+ * socketpair, the test plays the remote device on the other end. The data
+ * loop only records the sources, the test calls them when the node would
+ * be woken up. */
+#define MAX_SOURCES	4
+#define BUFFER_SIZE	4096
+#define N_BUFFERS	2
+#define N_CYCLES	200
+#define CYCLE_SAMPLES	360	/* not a whole number of mSBC frames */
+#define MAX_MTU		120
+/* the bytes of silence sco-sink queues on the first timeout */
+#define FILL_SILENCE(mtu)	(2 * (mtu))
+
+struct data {
+	struct spa_loop loop;
+	struct spa_system system;
+	struct spa_source *sources[MAX_SOURCES];
+
+	struct spa_bt_transport transport;
+	int fd[2];
+
+	struct spa_handle *handle;
+	struct spa_node *node;
+	struct spa_io_buffers io;
+	int ready;
+	bool recycled[N_BUFFERS];
+
+	struct spa_buffer *buffers[N_BUFFERS];
+	struct spa_buffer buffer[N_BUFFERS];
+	struct spa_data datas[N_BUFFERS];
+	struct spa_chunk chunks[N_BUFFERS];
+	uint8_t memory[N_BUFFERS][BUFFER_SIZE];
+};
+
+static int loop_add_source(void *object, struct spa_source *source)
+{
+	struct data *d = object;
+	uint32_t i;
+
+	for (i = 0; i < MAX_SOURCES; i++) {
+		if (d->sources[i] == NULL) {
+			d->sources[i] = source;
+			source->loop = &d->loop;
+			return 0;
+		}
+	}
+	return -ENOSPC;
+}
+
+static int loop_update_source(void *object, struct spa_source *source)
+{
+	return 0;
+}
+
+static int loop_remove_source(void *object, struct spa_source *source)
+{
+	struct data *d = object;
+	uint32_t i;
+
+	for (i = 0; i < MAX_SOURCES; i++) {
+		if (d->sources[i] == source)
+			d->sources[i] = NULL;
+	}
+	source->loop = NULL;
+	return 0;
+}
+
+static int loop_invoke(void *object, spa_invoke_func_t func, uint32_t seq,
+		const void *data, size_t size, bool block, void *user_data)
+{
+	struct data *d = object;
+	return func(&d->loop, false, seq, data, size, user_data);
+}
+
+static const struct spa_loop_methods loop_methods = {
+	SPA_VERSION_LOOP_METHODS,
+	.add_source = loop_add_source,
+	.update_source = loop_update_source,
+	.remove_source = loop_remove_source,
+	.invoke = loop_invoke,
+};
+
+static int system_clock_gettime(void *object, int clockid, struct timespec *value)
+{
+	return clock_gettime(clockid, value);
+}
+
+static int system_timerfd_create(void *object, int clockid, int flags)
+{
+	return 1000;
+}
+
+static int system_timerfd_settime(void *object, int fd, int flags,
+		const struct itimerspec *new_value, struct itimerspec *old_value)
+{
+	return 0;
+}
+
+static int system_timerfd_read(void *object, int fd, uint64_t *expirations)
+{
+	*expirations = 1;
+	return 0;
+}
+
+static int system_close(void *object, int fd)
+{
+	return 0;
+}
+
+static const struct spa_system_methods system_methods = {
+	SPA_VERSION_SYSTEM_METHODS,
+	.close = system_close,
+	.clock_gettime = system_clock_gettime,
+	.timerfd_create = system_timerfd_create,
+	.timerfd_settime = system_timerfd_settime,
+	.timerfd_read = system_timerfd_read,
+};
+
+static int transport_acquire(void *data, bool optional)
+{
+	struct data *d = data;
+	/* the node closes its end when it stops */
+	return d->fd[0];
+}
+
+static int transport_release(void *data)
+{
+	return 0;
+}
+
+static const struct spa_bt_transport_implementation transport_impl = {
+	SPA_VERSION_BT_TRANSPORT_IMPLEMENTATION,
+	.acquire = transport_acquire,
+	.release = transport_release,
+};
+
+static int node_ready(void *data, int status)
+{
+	struct data *d = data;
+	d->ready = status;
+	return 0;
+}
+
+static int node_reuse_buffer(void *data, uint32_t port_id, uint32_t buffer_id)
+{
+	struct data *d = data;
+	spa_assert(buffer_id < N_BUFFERS);
+	d->recycled[buffer_id] = true;
+	return 0;
+}
+
+static const struct spa_node_callbacks node_callbacks = {
+	SPA_VERSION_NODE_CALLBACKS,
+	.ready = node_ready,
+	.reuse_buffer = node_reuse_buffer,
+};
+
+static void node_start(struct data *d, const struct spa_handle_factory *factory,
+		enum spa_direction direction, int codec, uint32_t mtu)
+{
+	struct spa_support support[2];
+	struct spa_dict_item items[1];
+	char transport[64];
+	uint8_t buffer[1024];
+	struct spa_pod_builder b;
+	struct spa_pod *param;
+	struct spa_audio_info_raw info;
+	uint32_t i, index = 0;
+	void *iface;
+
+	spa_zero(*d);
+
+	d->loop.iface = SPA_INTERFACE_INIT(SPA_TYPE_INTERFACE_DataLoop,
+			SPA_VERSION_LOOP, &loop_methods, d);
+	d->system.iface = SPA_INTERFACE_INIT(SPA_TYPE_INTERFACE_DataSystem,
+			SPA_VERSION_SYSTEM, &system_methods, d);
+	support[0] = SPA_SUPPORT_INIT(SPA_TYPE_INTERFACE_DataLoop, &d->loop);
+	support[1] = SPA_SUPPORT_INIT(SPA_TYPE_INTERFACE_DataSystem, &d->system);
+
+	spa_assert(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, d->fd) == 0);
+
+	d->transport.profile = SPA_BT_PROFILE_HEADSET_AUDIO_GATEWAY;
+	d->transport.codec = codec;
+	d->transport.read_mtu = mtu;
+	d->transport.write_mtu = mtu;
+	spa_hook_list_init(&d->transport.listener_list);
+	spa_bt_transport_set_implementation(&d->transport, &transport_impl, d);
+
+	snprintf(transport, sizeof(transport), "pointer:%p", &d->transport);
+	items[0] = SPA_DICT_ITEM_INIT(SPA_KEY_API_BLUEZ5_TRANSPORT, transport);
+
+	d->handle = calloc(1, spa_handle_factory_get_size(factory, NULL));
+	spa_assert(d->handle != NULL);
+	spa_assert(spa_handle_factory_init(factory, d->handle,
+				&SPA_DICT_INIT_ARRAY(items), support, 2) == 0);
+	spa_assert(spa_handle_get_interface(d->handle, SPA_TYPE_INTERFACE_Node, &iface) == 0);
+	d->node = iface;
+	spa_node_set_callbacks(d->node, &node_callbacks, d);
+
+	/* the transport codec decides the rate */
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	spa_assert(spa_node_port_enum_params_sync(d->node, direction, 0,
+				SPA_PARAM_EnumFormat, &index, NULL, &param, &b) == 1);
+	spa_zero(info);
+	spa_assert(spa_format_audio_raw_parse(param, &info) >= 0);
+	spa_assert(info.rate == (codec == HFP_AUDIO_CODEC_MSBC ? MSBC_RATE : 8000u));
+	spa_assert(info.channels == 1);
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	param = spa_format_audio_raw_build(&b, SPA_PARAM_Format, &info);
+	spa_assert(spa_node_port_set_param(d->node, direction, 0,
+				SPA_PARAM_Format, 0, param) == 0);
+
+	for (i = 0; i < N_BUFFERS; i++) {
+		d->datas[i].type = SPA_DATA_MemPtr;
+		d->datas[i].maxsize = BUFFER_SIZE;
+		d->datas[i].data = d->memory[i];
+		d->datas[i].chunk = &d->chunks[i];
+		d->buffer[i].n_datas = 1;
+		d->buffer[i].datas = &d->datas[i];
+		d->buffers[i] = &d->buffer[i];
+		d->recycled[i] = true;
+	}
+	spa_assert(spa_node_port_use_buffers(d->node, direction, 0, 0,
+				d->buffers, N_BUFFERS) == 0);
+
+	d->io = SPA_IO_BUFFERS_INIT;
+	spa_assert(spa_node_port_set_io(d->node, direction, 0,
+				SPA_IO_Buffers, &d->io, sizeof(d->io)) == 0);
+
+	spa_assert(spa_node_send_command(d->node,
+				&SPA_NODE_COMMAND_INIT(SPA_NODE_COMMAND_Start)) == 0);
+}
+
+static void node_stop(struct data *d)
+{
+	spa_assert(spa_node_send_command(d->node,
+				&SPA_NODE_COMMAND_INIT(SPA_NODE_COMMAND_Pause)) == 0);
+	spa_handle_clear(d->handle);
+	free(d->handle);
+	close(d->fd[1]);
+}
+
+static struct spa_source *find_source(struct data *d, int fd)
+{
+	uint32_t i;
+
+	for (i = 0; i < MAX_SOURCES; i++) {
+		if (d->sources[i] && d->sources[i]->fd == fd)
+			return d->sources[i];
+	}
+	return NULL;
+}
+
+static void dispatch(struct spa_source *source, uint32_t rmask)
+{
+	source->rmask = rmask;
+	source->func(source);
+}
+
+/* Reads all queued packets, checks that each is exactly mtu. */
+static uint32_t receive(int fd, uint32_t mtu, uint8_t *data, uint32_t size)
+{
+	uint8_t packet[MAX_MTU + 1];
+	uint32_t total = 0;
+	ssize_t len;
+
+	while ((len = read(fd, packet, sizeof(packet))) > 0) {
+		spa_assert(len == (ssize_t)mtu);
+		spa_assert(total + len <= size);
+		memcpy(data + total, packet, len);
+		total += len;
+	}
+	spa_assert(len < 0 && errno == EAGAIN);
+	return total;
+}
+
+static double rms(const int16_t *s, uint32_t n_samples)
+{
+	double sum = 0.0;
+	uint32_t i;
+	for (i = 0; i < n_samples; i++)
+		sum += (double)s[i] * s[i];
+	return sqrt(sum / SPA_MAX(n_samples, 1u));
+}
+
+static void make_tone(int16_t *pcm, uint32_t n_samples, uint32_t rate)
+{
+	uint32_t i;
+	for (i = 0; i < n_samples; i++)
+		pcm[i] = 8000 * sin(2 * M_PI * 1000 * i / rate);
+}
+
+static void test_sink(int codec, uint32_t mtu)
+{
+	static struct data d;
+	static int16_t pcm[N_CYCLES * CYCLE_SAMPLES];
+	static uint8_t stream[N_CYCLES * CYCLE_SAMPLES * 2 + 4096];
+	static int16_t decoded[N_CYCLES * CYCLE_SAMPLES + 2048];
+	bool msbc = codec == HFP_AUDIO_CODEC_MSBC;
+	struct spa_source *timer, *flush;
+	uint32_t i, id, received = 0, n_packets, n_silence, n_samples;
+	size_t written = 0;
+	double in_rms, out_rms;
+
+	node_start(&d, &spa_sco_sink_factory, SPA_DIRECTION_INPUT, codec, mtu);
+	make_tone(pcm, SPA_N_ELEMENTS(pcm), msbc ? MSBC_RATE : 8000);
+
+	timer = find_source(&d, 1000);
+	flush = find_source(&d, d.fd[0]);
+	spa_assert(timer != NULL && flush != NULL);
+
+	/* the first timeout fills the socket with silence and asks for data */
+	dispatch(timer, SPA_IO_IN);
+	spa_assert(d.ready == SPA_STATUS_NEED_DATA);
+
+	for (i = 0; i < N_CYCLES; i++) {
+		struct spa_data *data;
+
+		/* only buffers the node gave back can be filled again */
+		for (id = 0; id < N_BUFFERS && !d.recycled[id]; id++);
+		spa_assert(id < N_BUFFERS);
+		d.recycled[id] = false;
+
+		data = &d.datas[id];
+		memcpy(data->data, &pcm[i * CYCLE_SAMPLES], CYCLE_SAMPLES * 2);
+		data->chunk->offset = 0;
+		data->chunk->size = CYCLE_SAMPLES * 2;
+		d.io.buffer_id = id;
+		d.io.status = SPA_STATUS_HAVE_DATA;
+		spa_node_process(d.node);
+		spa_assert(d.io.status == SPA_STATUS_OK);
+
+		/* the remote reads and the socket drains, what waited in the
+		 * ring goes out for as long as the node waits for it */
+		do {
+			received += receive(d.fd[1], mtu, &stream[received],
+					sizeof(stream) - received);
+			dispatch(flush, SPA_IO_OUT);
+		} while (SPA_FLAG_IS_SET(flush->mask, SPA_IO_OUT));
+	}
+	received += receive(d.fd[1], mtu, &stream[received], sizeof(stream) - received);
+	n_packets = received / mtu;
+
+	if (msbc) {
+		struct msbc dec;
+
+		spa_assert(msbc_init(&dec) == 0);
+		spa_assert(msbc_decode(&dec, stream, received, decoded,
+					sizeof(decoded), &written) == received);
+		spa_assert(dec.errors == 0);
+		spa_assert(dec.lost == 0);
+		spa_assert(written == received / MSBC_PACKET_SIZE * MSBC_DECODED_SIZE);
+		msbc_deinit(&dec);
+
+		/* the fill of the first timeout is silence */
+		n_silence = (FILL_SILENCE(mtu) + MSBC_PACKET_SIZE - 1) /
+			MSBC_PACKET_SIZE * MSBC_DECODED_SIZE / 2;
+	} else {
+		memcpy(decoded, stream, received);
+		written = received;
+		n_silence = FILL_SILENCE(mtu) / 2;
+	}
+	n_samples = written / 2;
+
+	/* nothing got lost, only what does not fill a packet yet is left */
+	spa_assert(n_samples > n_silence);
+	spa_assert(n_samples <= n_silence + N_CYCLES * CYCLE_SAMPLES);
+	spa_assert(n_silence + N_CYCLES * CYCLE_SAMPLES - n_samples <
+			(msbc ? MSBC_DECODED_SIZE / 2 + mtu * 2 : mtu / 2));
+	spa_assert(rms(decoded, n_silence) < 100.0);
+
+	if (msbc) {
+		in_rms = rms(&pcm[MSBC_DECODED_SIZE], n_samples / 2);
+		out_rms = rms(&decoded[n_silence + MSBC_DECODED_SIZE], n_samples / 2);
+		spa_assert(out_rms > in_rms * 0.7 && out_rms < in_rms * 1.3);
+	} else {
+		in_rms = out_rms = rms(pcm, n_samples - n_silence);
+		spa_assert(memcmp(&decoded[n_silence], pcm,
+					(n_samples - n_silence) * 2) == 0);
+	}
+
+	fprintf(stderr, "sink   %s mtu %3u: %u packets, %u samples, level %.0f -> %.0f\n",
+			msbc ? "mSBC" : "CVSD", mtu, n_packets, n_samples, in_rms, out_rms);
+
+	node_stop(&d);
+}
+
+static void test_source(int codec, uint32_t mtu)
+{
+	static struct data d;
+	static int16_t pcm[N_CYCLES * CYCLE_SAMPLES];
+	static uint8_t stream[N_CYCLES * CYCLE_SAMPLES * 2];
+	static int16_t out[N_CYCLES * CYCLE_SAMPLES + 2048];
+	bool msbc = codec == HFP_AUDIO_CODEC_MSBC;
+	struct spa_source *source;
+	struct spa_chunk *chunk;
+	uint32_t i, size = 0, sent = 0, received = 0, n_buffers = 0;
+	double in_rms, out_rms;
+
+	node_start(&d, &spa_sco_source_factory, SPA_DIRECTION_OUTPUT, codec, mtu);
+	make_tone(pcm, SPA_N_ELEMENTS(pcm), msbc ? MSBC_RATE : 8000);
+
+	source = find_source(&d, d.fd[0]);
+	spa_assert(source != NULL);
+
+	if (msbc) {
+		struct msbc enc;
+
+		spa_assert(msbc_init(&enc) == 0);
+		for (i = 0; i + MSBC_DECODED_SIZE / 2 <= SPA_N_ELEMENTS(pcm); i += MSBC_DECODED_SIZE / 2) {
+			spa_assert(msbc_encode(&enc, &pcm[i], &stream[size]) == MSBC_PACKET_SIZE);
+			size += MSBC_PACKET_SIZE;
+		}
+		msbc_deinit(&enc);
+	} else {
+		memcpy(stream, pcm, sizeof(pcm));
+		size = sizeof(pcm);
+	}
+	size = size / mtu * mtu;
+
+	while (sent < size) {
+		/* the remote sends a few packets at a time */
+		for (i = 0; i < 4 && sent < size; i++) {
+			spa_assert(write(d.fd[1], &stream[sent], mtu) == (ssize_t)mtu);
+			sent += mtu;
+		}
+
+		do {
+			dispatch(source, SPA_IO_IN);
+			if (d.io.status != SPA_STATUS_HAVE_DATA)
+				break;
+
+			/* the graph takes the buffer */
+			chunk = &d.chunks[d.io.buffer_id];
+			spa_assert(chunk->size % 2 == 0);
+			spa_assert(received + chunk->size <= sizeof(out));
+			memcpy(SPA_MEMBER(out, received, void),
+					SPA_MEMBER(d.memory[d.io.buffer_id], chunk->offset, void),
+					chunk->size);
+			received += chunk->size;
+			n_buffers++;
+			d.io.status = SPA_STATUS_NEED_DATA;
+		} while (d.ready == SPA_STATUS_HAVE_DATA);
+	}
+
+	if (msbc) {
+		/* every packet decodes to one frame */
+		spa_assert(received == size / MSBC_PACKET_SIZE * MSBC_DECODED_SIZE);
+		in_rms = rms(&pcm[MSBC_DECODED_SIZE], received / 4);
+		out_rms = rms(&out[MSBC_DECODED_SIZE], received / 4);
+		spa_assert(out_rms > in_rms * 0.7 && out_rms < in_rms * 1.3);
+	} else {
+		spa_assert(received == size);
+		spa_assert(memcmp(out, pcm, received) == 0);
+		in_rms = out_rms = rms(out, received / 2);
+	}
+
+	fprintf(stderr, "source %s mtu %3u: %u bytes in %u buffers, level %.0f -> %.0f\n",
+			msbc ? "mSBC" : "CVSD", mtu, received, n_buffers, in_rms, out_rms);
+
+	node_stop(&d);
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t mtus[] = { 48, 60, 72, 120 };
+	uint32_t i;
+
+	for (i = 0; i < SPA_N_ELEMENTS(mtus); i++) {
+		test_sink(HFP_AUDIO_CODEC_CVSD, mtus[i]);
+		test_sink(HFP_AUDIO_CODEC_MSBC, mtus[i]);
+		test_source(HFP_AUDIO_CODEC_CVSD, mtus[i]);
+		test_source(HFP_AUDIO_CODEC_MSBC, mtus[i]);
+	}
+	return 0;
+}
@@ -928,6 +928,11 @@ client_node_update(void *data,
 
 		for (i = 0; i < this->n_params; i++)
 			this->params[i] = params[i] ? spa_pod_copy(params[i]) : NULL;
+
+		/* the client can change the params without changing their
+		 * info, don't let the node answer from its cache */
+		if (impl->this.node)
+			pw_impl_node_clear_param_caches(impl->this.node);
 	}
 	if (change_mask & PW_CLIENT_NODE_UPDATE_INFO) {
 		spa_node_emit_info(&this->hooks, info);
@@ -977,6 +982,9 @@ client_node_port_update(void *data,
 			       change_mask,
 			       n_params, params,
 			       info);
+
+		if ((change_mask & PW_CLIENT_NODE_PORT_UPDATE_PARAMS) && impl->this.node)
+			pw_impl_node_clear_param_caches(impl->this.node);
 	}
 	return 0;
 }
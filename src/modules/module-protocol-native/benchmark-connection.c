@@ -0,0 +1,153 @@
+/* PipeWire
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <spa/pod/builder.h>
+#include <spa/pod/parser.h>
+#include <spa/utils/result.h>
+
+#include <pipewire/pipewire.h>
+
+#include "connection.h"
+
+#define MAX_BATCH	64
+
+static uint8_t payload[16 * 1024];
+
+static void write_message(struct pw_protocol_native_connection *conn, uint32_t size, int fd)
+{
+	struct spa_pod_builder *b;
+
+	b = pw_protocol_native_connection_begin(conn, 1, 5, NULL);
+	spa_pod_builder_add_struct(b,
+			SPA_POD_Int(42),
+			SPA_POD_Bytes(payload, size),
+			SPA_POD_Int(pw_protocol_native_connection_add_fd(conn, fd)));
+	pw_protocol_native_connection_end(conn, b);
+}
+
+static int read_message(struct pw_protocol_native_connection *conn)
+{
+	const struct pw_protocol_native_message *msg;
+	struct spa_pod_parser prs;
+	const void *data;
+	uint32_t v_int, size;
+	int32_t fdidx;
+	int fd;
+
+	if (pw_protocol_native_connection_get_next(conn, &msg) != 1)
+		return -1;
+
+	spa_pod_parser_init(&prs, msg->data, msg->size);
+	if (spa_pod_parser_get_struct(&prs,
+			SPA_POD_Int(&v_int),
+			SPA_POD_Bytes(&data, &size),
+			SPA_POD_Int(&fdidx)) < 0)
+		spa_assert_not_reached();
+
+	if ((fd = pw_protocol_native_connection_get_fd(conn, fdidx)) >= 0)
+		close(fd);
+
+	return size;
+}
+
+static void run(const char *name, struct pw_protocol_native_connection *in,
+		struct pw_protocol_native_connection *out,
+		uint32_t size, uint32_t batch, bool with_fds)
+{
+	struct timespec ts;
+	uint64_t t1, t2, count = 0, bytes = 0;
+	uint32_t i;
+	int res;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t1 = SPA_TIMESPEC_TO_NSEC(&ts);
+
+	fprintf(stderr, "%s : ", name);
+	while (true) {
+		for (i = 0; i < batch; i++)
+			write_message(out, size, with_fds ? 0 : -1);
+		if ((res = pw_protocol_native_connection_flush(out)) < 0) {
+			fprintf(stderr, "flush error: %s\n", spa_strerror(res));
+			return;
+		}
+		for (i = 0; i < batch; i++) {
+			if ((res = read_message(in)) < 0)
+				spa_assert_not_reached();
+			bytes += res;
+		}
+		count += batch;
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		t2 = SPA_TIMESPEC_TO_NSEC(&ts);
+		if (t2 - t1 > 1 * SPA_NSEC_PER_SEC)
+			break;
+	}
+	fprintf(stderr, "elapsed %"PRIu64" count %"PRIu64" = %"PRIu64"/sec %"PRIu64" MB/sec\n",
+			t2 - t1, count, count * (uint64_t)SPA_NSEC_PER_SEC / (t2 - t1),
+			bytes * (uint64_t)SPA_NSEC_PER_SEC / (t2 - t1) / (1024 * 1024));
+}
+
+int main(int argc, char *argv[])
+{
+	struct pw_main_loop *loop;
+	struct pw_context *context;
+	struct pw_protocol_native_connection *in, *out;
+	int fds[2], size = 1024 * 1024;
+
+	pw_init(&argc, &argv);
+
+	loop = pw_main_loop_new(NULL);
+	context = pw_context_new(pw_main_loop_get_loop(loop), NULL, 0);
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+		spa_assert_not_reached();
+		return -1;
+	}
+	/* make room for a complete batch */
+	setsockopt(fds[0], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	setsockopt(fds[1], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+	in = pw_protocol_native_connection_new(context, fds[0]);
+	spa_assert(in != NULL);
+	out = pw_protocol_native_connection_new(context, fds[1]);
+	spa_assert(out != NULL);
+
+	run("small", in, out, 16, MAX_BATCH, false);
+	run("small_fds", in, out, 16, MAX_BATCH, true);
+	run("large", in, out, sizeof(payload), 16, false);
+	run("large_fds", in, out, sizeof(payload), 16, true);
+
+	pw_protocol_native_connection_destroy(in);
+	pw_protocol_native_connection_destroy(out);
+	pw_context_destroy(context);
+	pw_main_loop_destroy(loop);
+
+	return 0;
+}
@@ -0,0 +1,222 @@
+/* PipeWire
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include <spa/pod/builder.h>
+#include <spa/utils/result.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/private.h>
+#include <extensions/protocol-native.h>
+
+#define MAX_BATCH	64
+#define N_ITEMS		16
+#define N_PERMISSIONS	64
+
+void pw_protocol_native_init(struct pw_protocol *protocol);
+
+/* count every heap allocation made while dispatching */
+static uint64_t n_allocs;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+	n_allocs++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	n_allocs++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	n_allocs++;
+	return __libc_realloc(ptr, size);
+}
+
+struct data {
+	struct pw_main_loop *loop;
+	struct pw_context *context;
+	struct pw_protocol *protocol;
+	struct pw_impl_client *client;
+	struct pw_resource *resource;
+	struct spa_hook object_listener;
+	struct pw_properties *props;
+
+	uint8_t buffer[4096];
+	struct pw_protocol_native_message msg;
+	uint32_t total;
+};
+
+static int client_update_properties(void *object, const struct spa_dict *dict)
+{
+	struct data *d = object;
+	d->total += dict->n_items;
+	return 0;
+}
+
+static int client_update_permissions(void *object,
+		uint32_t n_permissions, const struct pw_permission *permissions)
+{
+	struct data *d = object;
+	d->total += n_permissions;
+	return 0;
+}
+
+static const struct pw_client_methods client_methods = {
+	PW_VERSION_CLIENT_METHODS,
+	.update_properties = client_update_properties,
+	.update_permissions = client_update_permissions,
+};
+
+static void build_update_properties(struct data *d)
+{
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(d->buffer, sizeof(d->buffer));
+	struct spa_pod_frame f[2];
+	char key[32];
+	uint32_t i;
+
+	spa_pod_builder_push_struct(&b, &f[0]);
+	spa_pod_builder_push_struct(&b, &f[1]);
+	spa_pod_builder_int(&b, N_ITEMS);
+	for (i = 0; i < N_ITEMS; i++) {
+		snprintf(key, sizeof(key), "bench.key.%d", i);
+		spa_pod_builder_string(&b, key);
+		spa_pod_builder_string(&b, "value");
+	}
+	spa_pod_builder_pop(&b, &f[1]);
+	spa_pod_builder_pop(&b, &f[0]);
+
+	d->msg.opcode = PW_CLIENT_METHOD_UPDATE_PROPERTIES;
+	d->msg.size = b.state.offset;
+}
+
+static void build_update_permissions(struct data *d)
+{
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(d->buffer, sizeof(d->buffer));
+	struct spa_pod_frame f;
+	uint32_t i;
+
+	spa_pod_builder_push_struct(&b, &f);
+	spa_pod_builder_int(&b, N_PERMISSIONS);
+	for (i = 0; i < N_PERMISSIONS; i++) {
+		spa_pod_builder_int(&b, i);
+		spa_pod_builder_int(&b, PW_PERM_RWX);
+	}
+	spa_pod_builder_pop(&b, &f);
+
+	d->msg.opcode = PW_CLIENT_METHOD_UPDATE_PERMISSIONS;
+	d->msg.size = b.state.offset;
+}
+
+static int dispatch(struct data *d)
+{
+	const struct pw_protocol_native_demarshal *demarshal = d->resource->marshal->server_demarshal;
+	return demarshal[d->msg.opcode].func(d->resource, &d->msg);
+}
+
+static int set_props(struct data *d)
+{
+	return pw_properties_setf(d->props, "bench.id", "%d", 42);
+}
+
+static void run(const char *name, struct data *d, int (*func) (struct data *d))
+{
+	struct timespec ts;
+	uint64_t t1, t2, count = 0, allocs;
+	uint32_t i;
+
+	/* warm up so that one time allocations are not counted */
+	for (i = 0; i < MAX_BATCH; i++)
+		func(d);
+
+	allocs = n_allocs;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t1 = SPA_TIMESPEC_TO_NSEC(&ts);
+
+	fprintf(stderr, "%s : ", name);
+	while (true) {
+		for (i = 0; i < MAX_BATCH; i++) {
+			if (func(d) < 0)
+				spa_assert_not_reached();
+		}
+		count += MAX_BATCH;
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		t2 = SPA_TIMESPEC_TO_NSEC(&ts);
+		if (t2 - t1 > 1 * SPA_NSEC_PER_SEC)
+			break;
+	}
+	allocs = n_allocs - allocs;
+	fprintf(stderr, "elapsed %"PRIu64" count %"PRIu64" = %"PRIu64"/sec allocs/msg %.3f\n",
+			t2 - t1, count, count * (uint64_t)SPA_NSEC_PER_SEC / (t2 - t1),
+			(double)allocs / count);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { 0, };
+	struct data *d = &data;
+
+	pw_init(&argc, &argv);
+
+	d->loop = pw_main_loop_new(NULL);
+	d->context = pw_context_new(pw_main_loop_get_loop(d->loop), NULL, 0);
+	d->protocol = pw_protocol_new(d->context, "benchmark", 0);
+	pw_protocol_native_init(d->protocol);
+
+	d->client = pw_context_create_client(d->context->core, d->protocol, NULL, 0);
+	spa_assert(d->client != NULL);
+	d->resource = pw_resource_new(d->client, 0, PW_PERM_RWX,
+			PW_TYPE_INTERFACE_Client, PW_VERSION_CLIENT, 0);
+	spa_assert(d->resource != NULL);
+	pw_resource_add_object_listener(d->resource, &d->object_listener,
+			&client_methods, d);
+
+	d->msg.data = d->buffer;
+	d->props = pw_properties_new(NULL, NULL);
+
+	build_update_properties(d);
+	run("update_properties", d, dispatch);
+	build_update_permissions(d);
+	run("update_permissions", d, dispatch);
+	run("properties_setf", d, set_props);
+
+	pw_properties_free(d->props);
+	pw_resource_destroy(d->resource);
+	pw_impl_client_destroy(d->client);
+	pw_protocol_destroy(d->protocol);
+	pw_context_destroy(d->context);
+	pw_main_loop_destroy(d->loop);
+
+	return 0;
+}
@@ -0,0 +1,114 @@
+/* PipeWire
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include <spa/pod/builder.h>
+#include <spa/pod/parser.h>
+
+#include "typed.h"
+
+#define MAX_COUNT 10000000
+
+/* Build and parse a sync-like message of two ints, with the generic
+ * varargs builder and parser and with the fixed layout functions that the
+ * native protocol uses for int-only messages. */
+static void test_struct_varargs(void)
+{
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = { NULL, };
+	struct spa_pod_parser prs;
+	struct timespec ts;
+	uint64_t t1, t2 = 0;
+	uint64_t count = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t1 = SPA_TIMESPEC_TO_NSEC(&ts);
+
+	fprintf(stderr, "test_struct_varargs() : ");
+	for (count = 0; count < MAX_COUNT; count++) {
+		int32_t id = 0, seq = 0;
+
+		spa_pod_builder_init(&b, buffer, sizeof(buffer));
+		spa_pod_builder_add_struct(&b,
+				SPA_POD_Int(count),
+				SPA_POD_Int(1));
+
+		spa_pod_parser_init(&prs, buffer, b.state.offset);
+		spa_pod_parser_get_struct(&prs,
+				SPA_POD_Int(&id),
+				SPA_POD_Int(&seq));
+
+		spa_assert(id == (int32_t)count && seq == 1);
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		t2 = SPA_TIMESPEC_TO_NSEC(&ts);
+		if (t2 - t1 > 1 * SPA_NSEC_PER_SEC)
+			break;
+	}
+	fprintf(stderr, "elapsed %"PRIu64" count %"PRIu64" = %"PRIu64"/sec\n",
+			t2 - t1, count, count * (uint64_t)SPA_NSEC_PER_SEC / (t2 - t1));
+}
+
+static void test_struct_typed(void)
+{
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = { NULL, };
+	struct timespec ts;
+	uint64_t t1, t2 = 0;
+	uint64_t count = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t1 = SPA_TIMESPEC_TO_NSEC(&ts);
+
+	fprintf(stderr, "test_struct_typed() : ");
+	for (count = 0; count < MAX_COUNT; count++) {
+		int32_t id = 0, seq = 0;
+
+		spa_pod_builder_init(&b, buffer, sizeof(buffer));
+		push_ints(&b, 2, (int32_t[]) { count, 1 });
+
+		spa_assert(parse_ints(buffer, b.state.offset, 2,
+					(void*[]) { &id, &seq }) == 0);
+
+		spa_assert(id == (int32_t)count && seq == 1);
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		t2 = SPA_TIMESPEC_TO_NSEC(&ts);
+		if (t2 - t1 > 1 * SPA_NSEC_PER_SEC)
+			break;
+	}
+	fprintf(stderr, "elapsed %"PRIu64" count %"PRIu64" = %"PRIu64"/sec\n",
+			t2 - t1, count, count * (uint64_t)SPA_NSEC_PER_SEC / (t2 - t1));
+}
+
+int main(int argc, char *argv[])
+{
+	test_struct_varargs();
+	test_struct_typed();
+	return 0;
+}
@@ -56,6 +56,8 @@ struct buffer {
 	uint32_t seq;
 	size_t offset;
 	size_t fds_offset;
+	int fds_credit;		/**< out: fds sent but not used by the messages before offset,
+				  *  negative when those messages still need fds */
 	struct pw_protocol_native_message msg;
 };
 
@@ -134,7 +136,10 @@ static void *connection_ensure_size(struct pw_protocol_native_connection *conn,
 	int res;
 
 	if (buf->buffer_size + size > buf->buffer_maxsize) {
-		buf->buffer_maxsize = SPA_ROUND_UP_N(buf->buffer_size + size, MAX_BUFFER_SIZE);
+		/* grow at least by a factor of 2 so that large messages, built
+		 * with many small builder overflows, don't realloc all the time */
+		buf->buffer_maxsize = SPA_ROUND_UP_N(SPA_MAX(buf->buffer_size + size,
+					buf->buffer_maxsize * 2), MAX_BUFFER_SIZE);
 		buf->buffer_data = realloc(buf->buffer_data, buf->buffer_maxsize);
 		if (buf->buffer_data == NULL) {
 			res = -errno;
@@ -214,6 +219,7 @@ static void clear_buffer(struct buffer *buf)
 	buf->buffer_size = 0;
 	buf->offset = 0;
 	buf->fds_offset = 0;
+	buf->fds_credit = 0;
 }
 
 /** Make a new connection object for the given socket
@@ -480,47 +486,78 @@ pw_protocol_native_connection_end(struct pw_protocol_native_connection *conn,
 	return res;
 }
 
+/* Find the amount of data that can be sent along with n_fds more fds. All
+ * messages that have their fds sent before or with the data can go out.
+ * With force, skip to the first message after done, even when its fds
+ * were not sent yet. */
+static size_t scan_messages(struct impl *impl, struct buffer *buf, size_t done,
+		uint32_t n_fds, bool last, bool force)
+{
+	uint32_t *p, len, msg_fds;
+
+	if (impl->version < 3)
+		/* no fds in the header, send all data with the last fds */
+		return last ? buf->buffer_size : done;
+
+	while (buf->offset + impl->hdr_size <= buf->buffer_size) {
+		p = SPA_MEMBER(buf->buffer_data, buf->offset, uint32_t);
+		len = p[1] & 0xffffff;
+		msg_fds = p[3];
+
+		if (force ? buf->offset >= done :
+		    (int)msg_fds > buf->fds_credit + (int)n_fds)
+			break;
+
+		buf->fds_credit -= msg_fds;
+		buf->offset += impl->hdr_size + len;
+	}
+	return buf->offset;
+}
+
 /** Flush the connection object
  *
  * \param conn the connection object
  * \return 0 on success < 0 error code on error
  *
- * Write the queued messages on the connection to the socket
+ * Write the queued messages on the connection to the socket. As many
+ * messages as possible are sent with each chunk of MAX_FDS_MSG fds so
+ * that a flush needs as few sendmsg calls as possible.
  *
  * \memberof pw_protocol_native_connection
  */
 int pw_protocol_native_connection_flush(struct pw_protocol_native_connection *conn)
 {
 	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
-	ssize_t sent, outsize;
+	ssize_t sent;
 	struct msghdr msg = { 0 };
 	struct iovec iov[1];
 	struct cmsghdr *cmsg;
 	char cmsgbuf[CMSG_SPACE(MAX_FDS_MSG * sizeof(int))];
-	int res = 0, *fds;
-	uint32_t fds_len, n_fds, outfds;
+	int res = 0;
+	uint32_t fds_len, fds_done, outfds;
 	struct buffer *buf;
-	void *data;
-	size_t size;
+	size_t done, limit, outsize;
 
 	buf = &impl->out;
-	data = buf->buffer_data;
-	size = buf->buffer_size;
-	fds = buf->fds;
-	n_fds = buf->n_fds;
+	done = 0;
+	fds_done = 0;
 
-	while (size > 0) {
-		if (n_fds > MAX_FDS_MSG) {
+	while (done < buf->buffer_size) {
+		outfds = buf->n_fds - fds_done;
+		if (outfds > MAX_FDS_MSG)
 			outfds = MAX_FDS_MSG;
-			outsize = SPA_MIN(sizeof(uint32_t), size);
-		} else {
-			outfds = n_fds;
-			outsize = size;
-		}
+
+		limit = scan_messages(impl, buf, done, outfds,
+				fds_done + outfds == buf->n_fds, false);
+		if (limit > done)
+			outsize = limit - done;
+		else
+			/* fds need at least some data to go with */
+			outsize = SPA_MIN(sizeof(uint32_t), buf->buffer_size - done);
 
 		fds_len = outfds * sizeof(int);
 
-		iov[0].iov_base = data;
+		iov[0].iov_base = buf->buffer_data + done;
 		iov[0].iov_len = outsize;
 		msg.msg_iov = iov;
 		msg.msg_iovlen = 1;
@@ -532,7 +569,7 @@ int pw_protocol_native_connection_flush(struct pw_protocol_native_connection *co
 			cmsg->cmsg_level = SOL_SOCKET;
 			cmsg->cmsg_type = SCM_RIGHTS;
 			cmsg->cmsg_len = CMSG_LEN(fds_len);
-			memcpy(CMSG_DATA(cmsg), fds, fds_len);
+			memcpy(CMSG_DATA(cmsg), &buf->fds[fds_done], fds_len);
 			msg.msg_controllen = cmsg->cmsg_len;
 		} else {
 			msg.msg_control = NULL;
@@ -554,21 +591,28 @@ int pw_protocol_native_connection_flush(struct pw_protocol_native_connection *co
 		pw_log_trace("connection %p: %d written %zd bytes and %u fds", conn, conn->fd, sent,
 			     outfds);
 
-		size -= sent;
-		data = SPA_MEMBER(data, sent, void);
-		n_fds -= outfds;
-		fds += outfds;
+		done += sent;
+		fds_done += outfds;
+		buf->fds_credit += outfds;
 	}
 
 	res = 0;
 
 exit:
-	if (size > 0)
-		memmove(buf->buffer_data, data, size);
-	buf->buffer_size = size;
-	if (n_fds > 0)
-		memmove(buf->fds, fds, n_fds * sizeof(int));
-	buf->n_fds = n_fds;
+	if (done < buf->buffer_size) {
+		/* keep the scan position valid for the remaining data */
+		if (impl->version >= 3) {
+			scan_messages(impl, buf, done, 0, false, true);
+			buf->offset -= done;
+		}
+		memmove(buf->buffer_data, buf->buffer_data + done, buf->buffer_size - done);
+	}
+	buf->buffer_size -= done;
+	if (fds_done < buf->n_fds)
+		memmove(buf->fds, &buf->fds[fds_done], (buf->n_fds - fds_done) * sizeof(int));
+	buf->n_fds -= fds_done;
+	if (buf->buffer_size == 0)
+		clear_buffer(buf);
 	return res;
 }
 
@@ -33,6 +33,14 @@
 #include <extensions/protocol-native.h>
 
 #include "connection.h"
+#include "typed.h"
+
+/* Arrays in a message are sized by a count from the peer. Every item takes
+ * at least one pod in the message, check that before the array goes on the
+ * stack so that a bad count can't overflow it. */
+#define alloca_array(msg,n_items,item_size)					\
+	((n_items) > (msg)->size / sizeof(struct spa_pod) ?			\
+	 NULL : alloca((n_items) * (item_size)))
 
 static int core_method_marshal_add_listener(void *object,
 			struct spa_hook *listener,
@@ -51,8 +59,7 @@ static int core_method_marshal_hello(void *object, uint32_t version)
 
 	b = pw_protocol_native_begin_proxy(proxy, PW_CORE_METHOD_HELLO, NULL);
 
-	spa_pod_builder_add_struct(b,
-			SPA_POD_Int(version));
+	push_ints(b, 1, (int32_t[]) { version });
 
 	return pw_protocol_native_end_proxy(proxy, b);
 }
@@ -65,9 +72,7 @@ static int core_method_marshal_sync(void *object, uint32_t id, int seq)
 
 	b = pw_protocol_native_begin_proxy(proxy, PW_CORE_METHOD_SYNC, &msg);
 
-	spa_pod_builder_add_struct(b,
-			SPA_POD_Int(id),
-			SPA_POD_Int(SPA_RESULT_RETURN_ASYNC(msg->seq)));
+	push_ints(b, 2, (int32_t[]) { id, SPA_RESULT_RETURN_ASYNC(msg->seq) });
 
 	return pw_protocol_native_end_proxy(proxy, b);
 }
@@ -79,9 +84,7 @@ static int core_method_marshal_pong(void *object, uint32_t id, int seq)
 
 	b = pw_protocol_native_begin_proxy(proxy, PW_CORE_METHOD_PONG, NULL);
 
-	spa_pod_builder_add_struct(b,
-			SPA_POD_Int(id),
-			SPA_POD_Int(seq));
+	push_ints(b, 2, (int32_t[]) { id, seq });
 
 	return pw_protocol_native_end_proxy(proxy, b);
 }
@@ -118,9 +121,7 @@ static struct pw_registry * core_method_marshal_get_registry(void *object,
 
 	b = pw_protocol_native_begin_proxy(proxy, PW_CORE_METHOD_GET_REGISTRY, NULL);
 
-	spa_pod_builder_add_struct(b,
-		       SPA_POD_Int(version),
-		       SPA_POD_Int(new_id));
+	push_ints(b, 2, (int32_t[]) { version, new_id });
 
 	pw_protocol_native_end_proxy(proxy, b);
 
@@ -234,8 +235,7 @@ core_method_marshal_destroy(void *object, void *p)
 
 	b = pw_protocol_native_begin_proxy(proxy, PW_CORE_METHOD_DESTROY, NULL);
 
-	spa_pod_builder_add_struct(b,
-			SPA_POD_Int(id));
+	push_ints(b, 1, (int32_t[]) { id });
 
 	return pw_protocol_native_end_proxy(proxy, b);
 }
@@ -268,7 +268,9 @@ static int core_event_demarshal_info(void *object, const struct pw_protocol_nati
 		return -EINVAL;
 
 	info.props = &props;
-	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
+	props.items = alloca_array(msg, props.n_items, sizeof(struct spa_dict_item));
+	if (props.items == NULL)
+		return -EINVAL;
 	if (parse_dict(&prs, &props) < 0)
 		return -EINVAL;
 
@@ -278,13 +280,9 @@ static int core_event_demarshal_info(void *object, const struct pw_protocol_nati
 static int core_event_demarshal_done(void *object, const struct pw_protocol_native_message *msg)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_parser prs;
 	uint32_t id, seq;
 
-	spa_pod_parser_init(&prs, msg->data, msg->size);
-	if (spa_pod_parser_get_struct(&prs,
-				SPA_POD_Int(&id),
-				SPA_POD_Int(&seq)) < 0)
+	if (parse_ints(msg->data, msg->size, 2, (void*[]) { &id, &seq }) < 0)
 		return -EINVAL;
 
 	return pw_proxy_notify(proxy, struct pw_core_events, done, 0, id, seq);
@@ -293,13 +291,9 @@ static int core_event_demarshal_done(void *object, const struct pw_protocol_nati
 static int core_event_demarshal_ping(void *object, const struct pw_protocol_native_message *msg)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_parser prs;
 	uint32_t id, seq;
 
-	spa_pod_parser_init(&prs, msg->data, msg->size);
-	if (spa_pod_parser_get_struct(&prs,
-				SPA_POD_Int(&id),
-				SPA_POD_Int(&seq)) < 0)
+	if (parse_ints(msg->data, msg->size, 2, (void*[]) { &id, &seq }) < 0)
 		return -EINVAL;
 
 	return pw_proxy_notify(proxy, struct pw_core_events, ping, 0, id, seq);
@@ -327,11 +321,9 @@ static int core_event_demarshal_error(void *object, const struct pw_protocol_nat
 static int core_event_demarshal_remove_id(void *object, const struct pw_protocol_native_message *msg)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_parser prs;
 	uint32_t id;
 
-	spa_pod_parser_init(&prs, msg->data, msg->size);
-	if (spa_pod_parser_get_struct(&prs, SPA_POD_Int(&id)) < 0)
+	if (parse_ints(msg->data, msg->size, 1, (void*[]) { &id }) < 0)
 		return -EINVAL;
 
 	return pw_proxy_notify(proxy, struct pw_core_events, remove_id, 0, id);
@@ -340,13 +332,9 @@ static int core_event_demarshal_remove_id(void *object, const struct pw_protocol
 static int core_event_demarshal_bound_id(void *object, const struct pw_protocol_native_message *msg)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_parser prs;
 	uint32_t id, global_id;
 
-	spa_pod_parser_init(&prs, msg->data, msg->size);
-	if (spa_pod_parser_get_struct(&prs,
-				SPA_POD_Int(&id),
-				SPA_POD_Int(&global_id)) < 0)
+	if (parse_ints(msg->data, msg->size, 2, (void*[]) { &id, &global_id }) < 0)
 		return -EINVAL;
 
 	return pw_proxy_notify(proxy, struct pw_core_events, bound_id, 0, id, global_id);
@@ -376,12 +364,9 @@ static int core_event_demarshal_add_mem(void *object, const struct pw_protocol_n
 static int core_event_demarshal_remove_mem(void *object, const struct pw_protocol_native_message *msg)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_parser prs;
 	uint32_t id;
 
-	spa_pod_parser_init(&prs, msg->data, msg->size);
-	if (spa_pod_parser_get_struct(&prs,
-				SPA_POD_Int(&id)) < 0)
+	if (parse_ints(msg->data, msg->size, 1, (void*[]) { &id }) < 0)
 		return -EINVAL;
 
 	return pw_proxy_notify(proxy, struct pw_core_events, remove_mem, 0, id);
@@ -418,9 +403,7 @@ static void core_event_marshal_done(void *object, uint32_t id, int seq)
 
 	b = pw_protocol_native_begin_resource(resource, PW_CORE_EVENT_DONE, NULL);
 
-	spa_pod_builder_add_struct(b,
-			SPA_POD_Int(id),
-			SPA_POD_Int(seq));
+	push_ints(b, 2, (int32_t[]) { id, seq });
 
 	pw_protocol_native_end_resource(resource, b);
 }
@@ -433,9 +416,7 @@ static void core_event_marshal_ping(void *object, uint32_t id, int seq)
 
 	b = pw_protocol_native_begin_resource(resource, PW_CORE_EVENT_PING, &msg);
 
-	spa_pod_builder_add_struct(b,
-			SPA_POD_Int(id),
-			SPA_POD_Int(SPA_RESULT_RETURN_ASYNC(msg->seq)));
+	push_ints(b, 2, (int32_t[]) { id, SPA_RESULT_RETURN_ASYNC(msg->seq) });
 
 	pw_protocol_native_end_resource(resource, b);
 }
@@ -463,8 +444,7 @@ static void core_event_marshal_remove_id(void *object, uint32_t id)
 
 	b = pw_protocol_native_begin_resource(resource, PW_CORE_EVENT_REMOVE_ID, NULL);
 
-	spa_pod_builder_add_struct(b,
-			SPA_POD_Int(id));
+	push_ints(b, 1, (int32_t[]) { id });
 
 	pw_protocol_native_end_resource(resource, b);
 }
@@ -476,9 +456,7 @@ static void core_event_marshal_bound_id(void *object, uint32_t id, uint32_t glob
 
 	b = pw_protocol_native_begin_resource(resource, PW_CORE_EVENT_BOUND_ID, NULL);
 
-	spa_pod_builder_add_struct(b,
-			SPA_POD_Int(id),
-			SPA_POD_Int(global_id));
+	push_ints(b, 2, (int32_t[]) { id, global_id });
 
 	pw_protocol_native_end_resource(resource, b);
 }
@@ -506,8 +484,7 @@ static void core_event_marshal_remove_mem(void *object, uint32_t id)
 
 	b = pw_protocol_native_begin_resource(resource, PW_CORE_EVENT_REMOVE_MEM, NULL);
 
-	spa_pod_builder_add_struct(b,
-			SPA_POD_Int(id));
+	push_ints(b, 1, (int32_t[]) { id });
 
 	pw_protocol_native_end_resource(resource, b);
 }
@@ -515,12 +492,9 @@ static void core_event_marshal_remove_mem(void *object, uint32_t id)
 static int core_method_demarshal_hello(void *object, const struct pw_protocol_native_message *msg)
 {
 	struct pw_resource *resource = object;
-	struct spa_pod_parser prs;
 	uint32_t version;
 
-	spa_pod_parser_init(&prs, msg->data, msg->size);
-	if (spa_pod_parser_get_struct(&prs,
-				SPA_POD_Int(&version)) < 0)
+	if (parse_ints(msg->data, msg->size, 1, (void*[]) { &version }) < 0)
 		return -EINVAL;
 
 	return pw_resource_notify(resource, struct pw_core_methods, hello, 0, version);
@@ -529,13 +503,9 @@ static int core_method_demarshal_hello(void *object, const struct pw_protocol_na
 static int core_method_demarshal_sync(void *object, const struct pw_protocol_native_message *msg)
 {
 	struct pw_resource *resource = object;
-	struct spa_pod_parser prs;
 	uint32_t id, seq;
 
-	spa_pod_parser_init(&prs, msg->data, msg->size);
-	if (spa_pod_parser_get_struct(&prs,
-				SPA_POD_Int(&id),
-				SPA_POD_Int(&seq)) < 0)
+	if (parse_ints(msg->data, msg->size, 2, (void*[]) { &id, &seq }) < 0)
 		return -EINVAL;
 
 	return pw_resource_notify(resource, struct pw_core_methods, sync, 0, id, seq);
@@ -544,13 +514,9 @@ static int core_method_demarshal_sync(void *object, const struct pw_protocol_nat
 static int core_method_demarshal_pong(void *object, const struct pw_protocol_native_message *msg)
 {
 	struct pw_resource *resource = object;
-	struct spa_pod_parser prs;
 	uint32_t id, seq;
 
-	spa_pod_parser_init(&prs, msg->data, msg->size);
-	if (spa_pod_parser_get_struct(&prs,
-				SPA_POD_Int(&id),
-				SPA_POD_Int(&seq)) < 0)
+	if (parse_ints(msg->data, msg->size, 2, (void*[]) { &id, &seq }) < 0)
 		return -EINVAL;
 
 	return pw_resource_notify(resource, struct pw_core_methods, pong, 0, id, seq);
@@ -578,13 +544,9 @@ static int core_method_demarshal_error(void *object, const struct pw_protocol_na
 static int core_method_demarshal_get_registry(void *object, const struct pw_protocol_native_message *msg)
 {
 	struct pw_resource *resource = object;
-	struct spa_pod_parser prs;
 	int32_t version, new_id;
 
-	spa_pod_parser_init(&prs, msg->data, msg->size);
-	if (spa_pod_parser_get_struct(&prs,
-				SPA_POD_Int(&version),
-				SPA_POD_Int(&new_id)) < 0)
+	if (parse_ints(msg->data, msg->size, 2, (void*[]) { &version, &new_id }) < 0)
 		return -EINVAL;
 
 	return pw_resource_notify(resource, struct pw_core_methods, get_registry, 0, version, new_id);
@@ -613,7 +575,9 @@ static int core_method_demarshal_create_object(void *object, const struct pw_pro
 			SPA_POD_Int(&props.n_items), NULL) < 0)
 		return -EINVAL;
 
-	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
+	props.items = alloca_array(msg, props.n_items, sizeof(struct spa_dict_item));
+	if (props.items == NULL)
+		return -EINVAL;
 	if (parse_dict(&prs, &props) < 0)
 		return -EINVAL;
 	spa_pod_parser_pop(&prs, &f[1]);
@@ -632,12 +596,9 @@ static int core_method_demarshal_destroy(void *object, const struct pw_protocol_
 	struct pw_resource *resource = object;
 	struct pw_impl_client *client = pw_resource_get_client(resource);
 	struct pw_resource *r;
-	struct spa_pod_parser prs;
 	uint32_t id;
 
-	spa_pod_parser_init(&prs, msg->data, msg->size);
-	if (spa_pod_parser_get_struct(&prs,
-			SPA_POD_Int(&id)) < 0)
+	if (parse_ints(msg->data, msg->size, 1, (void*[]) { &id }) < 0)
 		return -EINVAL;
 
 	pw_log_debug("client %p: destroy resource %u", client, id);
@@ -692,7 +653,7 @@ static void registry_marshal_global_remove(void *object, uint32_t id)
 
 	b = pw_protocol_native_begin_resource(resource, PW_REGISTRY_EVENT_GLOBAL_REMOVE, NULL);
 
-	spa_pod_builder_add_struct(b, SPA_POD_Int(id));
+	push_ints(b, 1, (int32_t[]) { id });
 
 	pw_protocol_native_end_resource(resource, b);
 }
@@ -718,12 +679,9 @@ static int registry_demarshal_bind(void *object, const struct pw_protocol_native
 static int registry_demarshal_destroy(void *object, const struct pw_protocol_native_message *msg)
 {
 	struct pw_resource *resource = object;
-	struct spa_pod_parser prs;
 	uint32_t id;
 
-	spa_pod_parser_init(&prs, msg->data, msg->size);
-	if (spa_pod_parser_get_struct(&prs,
-			SPA_POD_Int(&id)) < 0)
+	if (parse_ints(msg->data, msg->size, 1, (void*[]) { &id }) < 0)
 		return -EINVAL;
 
 	return pw_resource_notify(resource, struct pw_registry_methods, destroy, 0, id);
@@ -785,7 +743,9 @@ static int module_demarshal_info(void *object, const struct pw_protocol_native_m
 		return -EINVAL;
 
 	info.props = &props;
-	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
+	props.items = alloca_array(msg, props.n_items, sizeof(struct spa_dict_item));
+	if (props.items == NULL)
+		return -EINVAL;
 	if (parse_dict(&prs, &props) < 0)
 		return -EINVAL;
 
@@ -844,7 +804,9 @@ static int device_demarshal_info(void *object, const struct pw_protocol_native_m
 		return -EINVAL;
 
 	info.props = &props;
-	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
+	props.items = alloca_array(msg, props.n_items, sizeof(struct spa_dict_item));
+	if (props.items == NULL)
+		return -EINVAL;
 	if (parse_dict(&prs, &props) < 0)
 		return -EINVAL;
 	spa_pod_parser_pop(&prs, &f[1]);
@@ -855,7 +817,9 @@ static int device_demarshal_info(void *object, const struct pw_protocol_native_m
 			       NULL) < 0)
 		return -EINVAL;
 
-	info.params = alloca(info.n_params * sizeof(struct spa_param_info));
+	info.params = alloca_array(msg, info.n_params, sizeof(struct spa_param_info));
+	if (info.params == NULL)
+		return -EINVAL;
 	for (i = 0; i < info.n_params; i++) {
 		if (spa_pod_parser_get(&prs,
 				       SPA_POD_Id(&info.params[i].id),
@@ -1065,7 +1029,9 @@ static int factory_demarshal_info(void *object, const struct pw_protocol_native_
 		return -EINVAL;
 
 	info.props = &props;
-	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
+	props.items = alloca_array(msg, props.n_items, sizeof(struct spa_dict_item));
+	if (props.items == NULL)
+		return -EINVAL;
 	if (parse_dict(&prs, &props) < 0)
 		return -EINVAL;
 
@@ -1136,7 +1102,9 @@ static int node_demarshal_info(void *object, const struct pw_protocol_native_mes
 		return -EINVAL;
 
 	info.props = &props;
-	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
+	props.items = alloca_array(msg, props.n_items, sizeof(struct spa_dict_item));
+	if (props.items == NULL)
+		return -EINVAL;
 	if (parse_dict(&prs, &props) < 0)
 		return -EINVAL;
 	spa_pod_parser_pop(&prs, &f[1]);
@@ -1147,7 +1115,9 @@ static int node_demarshal_info(void *object, const struct pw_protocol_native_mes
 			       NULL) < 0)
 		return -EINVAL;
 
-	info.params = alloca(info.n_params * sizeof(struct spa_param_info));
+	info.params = alloca_array(msg, info.n_params, sizeof(struct spa_param_info));
+	if (info.params == NULL)
+		return -EINVAL;
 	for (i = 0; i < info.n_params; i++) {
 		if (spa_pod_parser_get(&prs,
 				       SPA_POD_Id(&info.params[i].id),
@@ -1380,7 +1350,9 @@ static int port_demarshal_info(void *object, const struct pw_protocol_native_mes
 		return -EINVAL;
 
 	info.props = &props;
-	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
+	props.items = alloca_array(msg, props.n_items, sizeof(struct spa_dict_item));
+	if (props.items == NULL)
+		return -EINVAL;
 	if (parse_dict(&prs, &props) < 0)
 		return -EINVAL;
 	spa_pod_parser_pop(&prs, &f[1]);
@@ -1391,7 +1363,9 @@ static int port_demarshal_info(void *object, const struct pw_protocol_native_mes
 			       NULL) < 0)
 		return -EINVAL;
 
-	info.params = alloca(info.n_params * sizeof(struct spa_param_info));
+	info.params = alloca_array(msg, info.n_params, sizeof(struct spa_param_info));
+	if (info.params == NULL)
+		return -EINVAL;
 	for (i = 0; i < info.n_params; i++) {
 		if (spa_pod_parser_get(&prs,
 				       SPA_POD_Id(&info.params[i].id),
@@ -1562,7 +1536,9 @@ static int client_demarshal_info(void *object, const struct pw_protocol_native_m
 		return -EINVAL;
 
 	info.props = &props;
-	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
+	props.items = alloca_array(msg, props.n_items, sizeof(struct spa_dict_item));
+	if (props.items == NULL)
+		return -EINVAL;
 	if (parse_dict(&prs, &props) < 0)
 		return -EINVAL;
 
@@ -1620,7 +1596,9 @@ static int client_demarshal_permissions(void *object, const struct pw_protocol_n
 		    SPA_POD_Int(&n_permissions), NULL) < 0)
 		return -EINVAL;
 
-	permissions = alloca(n_permissions * sizeof(struct pw_permission));
+	permissions = alloca_array(msg, n_permissions, sizeof(struct pw_permission));
+	if (permissions == NULL)
+		return -EINVAL;
 	for (i = 0; i < n_permissions; i++) {
 		if (spa_pod_parser_get(&prs,
 				SPA_POD_Int(&permissions[i].id),
@@ -1667,9 +1645,7 @@ static int client_marshal_get_permissions(void *object, uint32_t index, uint32_t
 
 	b = pw_protocol_native_begin_proxy(proxy, PW_CLIENT_METHOD_GET_PERMISSIONS, NULL);
 
-	spa_pod_builder_add_struct(b,
-			SPA_POD_Int(index),
-			SPA_POD_Int(num));
+	push_ints(b, 2, (int32_t[]) { index, num });
 
 	return pw_protocol_native_end_proxy(proxy, b);
 }
@@ -1703,7 +1679,9 @@ static int client_demarshal_update_properties(void *object, const struct pw_prot
 		    SPA_POD_Int(&props.n_items), NULL) < 0)
 		return -EINVAL;
 
-	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
+	props.items = alloca_array(msg, props.n_items, sizeof(struct spa_dict_item));
+	if (props.items == NULL)
+		return -EINVAL;
 	if (parse_dict(&prs, &props) < 0)
 		return -EINVAL;
 
@@ -1714,13 +1692,9 @@ static int client_demarshal_update_properties(void *object, const struct pw_prot
 static int client_demarshal_get_permissions(void *object, const struct pw_protocol_native_message *msg)
 {
 	struct pw_resource *resource = object;
-	struct spa_pod_parser prs;
 	uint32_t index, num;
 
-	spa_pod_parser_init(&prs, msg->data, msg->size);
-	if (spa_pod_parser_get_struct(&prs,
-				SPA_POD_Int(&index),
-				SPA_POD_Int(&num)) < 0)
+	if (parse_ints(msg->data, msg->size, 2, (void*[]) { &index, &num }) < 0)
 		return -EINVAL;
 
 	return pw_resource_notify(resource, struct pw_client_methods, get_permissions, 0, index, num);
@@ -1761,7 +1735,9 @@ static int client_demarshal_update_permissions(void *object, const struct pw_pro
 				SPA_POD_Int(&n_permissions), NULL) < 0)
 		return -EINVAL;
 
-	permissions = alloca(n_permissions * sizeof(struct pw_permission));
+	permissions = alloca_array(msg, n_permissions, sizeof(struct pw_permission));
+	if (permissions == NULL)
+		return -EINVAL;
 	for (i = 0; i < n_permissions; i++) {
 		if (spa_pod_parser_get(&prs,
 				SPA_POD_Int(&permissions[i].id),
@@ -1836,7 +1812,9 @@ static int link_demarshal_info(void *object, const struct pw_protocol_native_mes
 		return -EINVAL;
 
 	info.props = &props;
-	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
+	props.items = alloca_array(msg, props.n_items, sizeof(struct spa_dict_item));
+	if (props.items == NULL)
+		return -EINVAL;
 	if (parse_dict(&prs, &props) < 0)
 		return -EINVAL;
 
@@ -1866,7 +1844,9 @@ static int registry_demarshal_global(void *object, const struct pw_protocol_nati
 			SPA_POD_Int(&props.n_items), NULL) < 0)
 		return -EINVAL;
 
-	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
+	props.items = alloca_array(msg, props.n_items, sizeof(struct spa_dict_item));
+	if (props.items == NULL)
+		return -EINVAL;
 	if (parse_dict(&prs, &props) < 0)
 		return -EINVAL;
 
@@ -1878,12 +1858,9 @@ static int registry_demarshal_global(void *object, const struct pw_protocol_nati
 static int registry_demarshal_global_remove(void *object, const struct pw_protocol_native_message *msg)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_parser prs;
 	uint32_t id;
 
-	spa_pod_parser_init(&prs, msg->data, msg->size);
-	if (spa_pod_parser_get_struct(&prs,
-				SPA_POD_Int(&id)) < 0)
+	if (parse_ints(msg->data, msg->size, 1, (void*[]) { &id }) < 0)
 		return -EINVAL;
 
 	return pw_proxy_notify(proxy, struct pw_registry_events, global_remove, 0, id);
@@ -1922,8 +1899,7 @@ static int registry_marshal_destroy(void *object, uint32_t id)
 	struct spa_pod_builder *b;
 
 	b = pw_protocol_native_begin_proxy(proxy, PW_REGISTRY_METHOD_DESTROY, NULL);
-	spa_pod_builder_add_struct(b,
-			       SPA_POD_Int(id));
+	push_ints(b, 1, (int32_t[]) { id });
 	return pw_protocol_native_end_proxy(proxy, b);
 }
 
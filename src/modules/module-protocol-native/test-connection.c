@@ -119,6 +119,21 @@ static void test_read_write(struct pw_protocol_native_connection *in,
 	spa_assert(read_message(in) == -1);
 }
 
+static void test_many_fds(struct pw_protocol_native_connection *in,
+		struct pw_protocol_native_connection *out)
+{
+	int i;
+
+	/* more fds than fit in one sendmsg */
+	for (i = 0; i < 100; i++)
+		write_message(out, i % 3);
+	spa_assert(pw_protocol_native_connection_flush(out) == 0);
+
+	for (i = 0; i < 100; i++)
+		spa_assert(read_message(in) == 0);
+	spa_assert(read_message(in) == -1);
+}
+
 int main(int argc, char *argv[])
 {
 	struct pw_main_loop *loop;
@@ -144,6 +159,7 @@ int main(int argc, char *argv[])
 	test_create(in);
 	test_create(out);
 	test_read_write(in, out);
+	test_many_fds(in, out);
 
 	return 0;
 }
@@ -0,0 +1,87 @@
+/* PipeWire
+ *
+ * Copyright © 2018 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef PIPEWIRE_PROTOCOL_NATIVE_TYPED_H
+#define PIPEWIRE_PROTOCOL_NATIVE_TYPED_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <errno.h>
+
+#include <spa/pod/builder.h>
+
+#define MAX_INTS	4
+
+/* Messages that only carry a few ints have a fixed layout. Build them with
+ * one precomputed write instead of going through the varargs builder. */
+static inline int push_ints(struct spa_pod_builder *b, uint32_t n_vals, const int32_t *vals)
+{
+	struct {
+		struct spa_pod_struct s;
+		struct spa_pod_int v[MAX_INTS];
+	} data;
+	uint32_t i;
+
+	spa_assert(n_vals <= MAX_INTS);
+
+	data.s = SPA_POD_INIT_Struct(n_vals * sizeof(struct spa_pod_int));
+	for (i = 0; i < n_vals; i++)
+		data.v[i] = SPA_POD_INIT_Int(vals[i]);
+
+	return spa_pod_builder_raw(b, &data, sizeof(struct spa_pod_struct) + data.s.pod.size);
+}
+
+/* Parse the first n_vals ints of a fixed layout message into the 32 bits
+ * values pointed to by vals. Trailing fields of newer versions are ignored. */
+static inline int parse_ints(const void *data, uint32_t size,
+		uint32_t n_vals, void **vals)
+{
+	const struct spa_pod_struct *s = data;
+	const struct spa_pod_int *v;
+	uint32_t i;
+
+	if (size < sizeof(*s) + n_vals * sizeof(*v) ||
+	    s->pod.type != SPA_TYPE_Struct ||
+	    s->pod.size < n_vals * sizeof(*v) ||
+	    SPA_POD_SIZE(&s->pod) > size)
+		return -EINVAL;
+
+	v = SPA_MEMBER(s, sizeof(*s), const struct spa_pod_int);
+	for (i = 0; i < n_vals; i++) {
+		if (v[i].pod.type != SPA_TYPE_Int ||
+		    v[i].pod.size != sizeof(int32_t))
+			return -EINVAL;
+		*(int32_t*)vals[i] = v[i].value;
+	}
+	return 0;
+}
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* PIPEWIRE_PROTOCOL_NATIVE_TYPED_H */
@@ -228,15 +228,52 @@ static struct spa_pod *find_param(struct spa_pod **params, uint32_t n_params, ui
 	return NULL;
 }
 
+/* make a key with all the Buffers and Meta params of the ports, used to look
+ * up the result of a previous negotiation */
+static struct spa_pod *make_key(struct port *input, struct port *output,
+		struct spa_pod_builder *b)
+{
+	static const uint32_t ids[] = { SPA_PARAM_Buffers, SPA_PARAM_Meta };
+	struct port *ports[] = { output, input };
+	struct spa_pod_frame f[2];
+	struct spa_pod *param;
+	uint32_t i, j, idx;
+	int res;
+
+	spa_pod_builder_push_struct(b, &f[0]);
+	for (i = 0; i < SPA_N_ELEMENTS(ids); i++) {
+		for (j = 0; j < SPA_N_ELEMENTS(ports); j++) {
+			spa_pod_builder_push_struct(b, &f[1]);
+			for (idx = 0;;) {
+				res = spa_node_port_enum_params_sync(ports[j]->node,
+						ports[j]->direction, ports[j]->port_id,
+						ids[i], &idx, NULL, &param, b);
+				if (res < 1)
+					break;
+			}
+			if (res < 0 && res != -ENOENT)
+				return NULL;
+			spa_pod_builder_pop(b, &f[1]);
+		}
+	}
+	spa_pod_builder_pop(b, &f[0]);
+
+	if (b->state.offset > b->size)
+		return NULL;
+	return spa_pod_builder_deref(b, 0);
+}
+
 SPA_EXPORT
 int pw_buffers_negotiate(struct pw_context *context, uint32_t flags,
 		struct spa_node *outnode, uint32_t out_port_id,
 		struct spa_node *innode, uint32_t in_port_id,
 		struct pw_buffers *result)
 {
-	struct spa_pod **params, *param;
+	struct spa_pod **params, *param, *key;
 	uint8_t buffer[4096];
 	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	uint8_t kbuffer[4096];
+	struct spa_pod_builder kb = SPA_POD_BUILDER_INIT(kbuffer, sizeof(kbuffer));
 	uint32_t i, offset, n_params;
 	uint32_t max_buffers;
 	size_t minsize, stride, align;
@@ -249,12 +286,25 @@ int pw_buffers_negotiate(struct pw_context *context, uint32_t flags,
 	const char *str;
 	int res;
 
-	res = param_filter(result, &input, &output, SPA_PARAM_Buffers, &b);
-	if (res < 0)
-		return res;
-	n_params = res;
-	if ((res = param_filter(result, &input, &output, SPA_PARAM_Meta, &b)) > 0)
-		n_params += res;
+	/* the same ports are often linked again, try to reuse a previous result */
+	key = make_key(&input, &output, &kb);
+
+	if (key != NULL &&
+	    (res = pw_context_negotiate_cache_lookup(context, SPA_PARAM_Buffers, key, &b)) > 0) {
+		pw_log_debug(NAME" %p: using %d cached params", result, res);
+		n_params = res;
+	} else {
+		res = param_filter(result, &input, &output, SPA_PARAM_Buffers, &b);
+		if (res < 0)
+			return res;
+		n_params = res;
+		if ((res = param_filter(result, &input, &output, SPA_PARAM_Meta, &b)) > 0)
+			n_params += res;
+
+		if (key != NULL && b.state.offset <= b.size)
+			pw_context_negotiate_cache_add(context, SPA_PARAM_Buffers, key,
+					buffer, b.state.offset, n_params);
+	}
 
 	params = alloca(n_params * sizeof(struct spa_pod *));
 	for (i = 0, offset = 0; i < n_params; i++) {
@@ -57,6 +57,18 @@
 #define DEFAULT_LINK_MAX_BUFFERS	64u
 #define DEFAULT_MEM_ALLOW_MLOCK		true
 
+#define MAX_NEGOTIATE_CACHE		64u
+
+struct negotiate_entry {
+	struct spa_list link;
+	uint32_t id;
+	uint32_t hash;
+	uint32_t key_size;
+	uint32_t result_size;
+	uint32_t n_results;
+	/* followed by key and result */
+};
+
 /** \cond */
 struct impl {
 	struct pw_context this;
@@ -295,6 +307,7 @@ struct pw_context *pw_context_new(struct pw_loop *main_loop,
 	spa_list_init(&this->control_list[1]);
 	spa_list_init(&this->export_list);
 	spa_list_init(&this->driver_list);
+	spa_list_init(&this->negotiate_cache);
 	spa_hook_list_init(&this->listener_list);
 	spa_hook_list_init(&this->driver_listener_list);
 
@@ -349,6 +362,7 @@ void pw_context_destroy(struct pw_context *context)
 	struct pw_resource *resource;
 	struct pw_impl_node *node;
 	struct factory_entry *entry;
+	struct negotiate_entry *ne;
 	struct pw_impl_core *core_impl;
 
 	pw_log_debug(NAME" %p: destroy", context);
@@ -397,6 +411,11 @@ void pw_context_destroy(struct pw_context *context)
 
 	pw_map_clear(&context->globals);
 
+	spa_list_consume(ne, &context->negotiate_cache, link) {
+		spa_list_remove(&ne->link);
+		free(ne);
+	}
+
 	free(context);
 }
 
@@ -586,6 +605,90 @@ struct pw_impl_port *pw_context_find_port(struct pw_context *context,
 	return best;
 }
 
+static uint32_t hash_bytes(const void *data, uint32_t size)
+{
+	const uint8_t *p = data;
+	uint32_t i, hash = 2166136261u;
+
+	for (i = 0; i < size; i++) {
+		hash ^= p[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+int pw_context_negotiate_cache_lookup(struct pw_context *context, uint32_t id,
+		const struct spa_pod *key, struct spa_pod_builder *builder)
+{
+	struct negotiate_entry *e;
+	uint32_t key_size = SPA_POD_SIZE(key);
+	uint32_t hash = hash_bytes(key, key_size);
+
+	spa_list_for_each(e, &context->negotiate_cache, link) {
+		if (e->id != id || e->hash != hash || e->key_size != key_size ||
+		    memcmp(SPA_MEMBER(e, sizeof(*e), void), key, key_size) != 0)
+			continue;
+
+		pw_log_debug(NAME" %p: negotiate cache hit id:%d (%s) hash:%08x", context,
+				id, spa_debug_type_find_name(spa_type_param, id), hash);
+
+		/* most recently used entries go first */
+		spa_list_remove(&e->link);
+		spa_list_prepend(&context->negotiate_cache, &e->link);
+
+		if (spa_pod_builder_raw_padded(builder,
+				SPA_MEMBER(e, sizeof(*e) + key_size, void),
+				e->result_size) < 0)
+			return -ENOSPC;
+		return e->n_results;
+	}
+	return 0;
+}
+
+int pw_context_negotiate_cache_add(struct pw_context *context, uint32_t id,
+		const struct spa_pod *key, const void *result, uint32_t size,
+		uint32_t n_results)
+{
+	struct negotiate_entry *e;
+	uint32_t key_size = SPA_POD_SIZE(key);
+
+	e = malloc(sizeof(*e) + key_size + size);
+	if (e == NULL)
+		return -errno;
+
+	e->id = id;
+	e->hash = hash_bytes(key, key_size);
+	e->key_size = key_size;
+	e->result_size = size;
+	e->n_results = n_results;
+	memcpy(SPA_MEMBER(e, sizeof(*e), void), key, key_size);
+	memcpy(SPA_MEMBER(e, sizeof(*e) + key_size, void), result, size);
+
+	pw_log_debug(NAME" %p: negotiate cache add id:%d (%s) hash:%08x", context,
+			id, spa_debug_type_find_name(spa_type_param, id), e->hash);
+
+	spa_list_prepend(&context->negotiate_cache, &e->link);
+
+	if (++context->n_negotiate_cache > MAX_NEGOTIATE_CACHE) {
+		e = spa_list_last(&context->negotiate_cache, struct negotiate_entry, link);
+		spa_list_remove(&e->link);
+		free(e);
+		context->n_negotiate_cache--;
+	}
+	return 0;
+}
+
+/* make a key for the result of a previous negotiation between the ports.
+ * The param generation of a port changes whenever its params are updated
+ * so the key does not need the formats themselves. */
+static struct spa_pod *make_format_key(struct pw_impl_port *output, struct pw_impl_port *input,
+		struct spa_pod_builder *b)
+{
+	return spa_pod_builder_add_struct(b,
+			SPA_POD_Long(output->param_generation),
+			SPA_POD_Long(input->param_generation));
+}
+
 /** Find a common format between two ports
  *
  * \param context a context object
@@ -617,7 +720,10 @@ int pw_context_find_format(struct pw_context *context,
 	uint32_t iidx = 0, oidx = 0;
 	struct spa_pod_builder fb = { 0 };
 	uint8_t fbuf[4096];
-	struct spa_pod *filter;
+	struct spa_pod_builder kb = { 0 };
+	uint8_t kbuf[64];
+	struct spa_pod *filter, *key = NULL;
+	uint32_t offset;
 
 	out_state = output->state;
 	in_state = input->state;
@@ -687,6 +793,23 @@ int pw_context_find_format(struct pw_context *context,
 			goto error;
 		}
 	} else if (in_state == PW_IMPL_PORT_STATE_CONFIGURE && out_state == PW_IMPL_PORT_STATE_CONFIGURE) {
+		/* both ports need a format, the same ports are often linked again,
+		 * try to reuse a previous result */
+		if (n_format_filters == 0) {
+			spa_pod_builder_init(&kb, kbuf, sizeof(kbuf));
+			key = make_format_key(output, input, &kb);
+		}
+		offset = builder->state.offset;
+		if (key != NULL &&
+		    pw_context_negotiate_cache_lookup(context, SPA_PARAM_EnumFormat,
+				    key, builder) > 0 &&
+		    (*format = spa_pod_builder_deref(builder, offset)) != NULL) {
+			pw_log_debug(NAME" %p: Got cached:", context);
+			if (pw_log_level_enabled(SPA_LOG_LEVEL_DEBUG))
+				spa_debug_format(2, NULL, *format);
+			return 1;
+		}
+		builder->state.offset = offset;
 	      again:
 		/* both ports need a format */
 		pw_log_debug(NAME" %p: do enum input %d", context, iidx);
@@ -724,6 +847,10 @@ int pw_context_find_format(struct pw_context *context,
 		pw_log_debug(NAME" %p: Got filtered:", context);
 		if (pw_log_level_enabled(SPA_LOG_LEVEL_DEBUG))
 			spa_debug_format(2, NULL, *format);
+
+		if (key != NULL)
+			pw_context_negotiate_cache_add(context, SPA_PARAM_EnumFormat,
+					key, *format, SPA_POD_SIZE(*format), 1);
 	} else {
 		res = -EBADF;
 		*error = spa_aprintf("error bad node state");
@@ -106,6 +106,8 @@ struct port {
 	struct queue dequeued;
 	struct queue queued;
 
+	struct buffer *cycle;	/* buffer of the current cycle in batch mode */
+
 	/* from here is what the caller gets as user_data */
 	uint8_t user_data[0];
 };
@@ -127,6 +129,9 @@ struct filter {
 	struct spa_list port_list;;
 	struct port *ports[2][MAX_PORTS];
 
+	struct pw_filter_buffer batch[2 * MAX_PORTS];
+	uint32_t n_batch;
+
 	uint32_t change_mask_all;
 	struct spa_node_info info;
 	struct spa_list param_list;
@@ -850,6 +855,86 @@ static int impl_node_process(void *object)
 	return SPA_STATUS_NEED_DATA | SPA_STATUS_HAVE_DATA;
 }
 
+/* Batch mode: the buffer in the io area is handed to the process callback
+ * and given back in place afterwards. The queues are only used for output
+ * ports that don't have a buffer in flight yet or got one recycled with
+ * reuse_buffer. */
+static int impl_node_process_batch(void *object)
+{
+	struct filter *impl = object;
+	struct pw_filter_buffer *fb = impl->batch;
+	struct port *p;
+	struct buffer *b;
+	bool drained = true;
+	uint32_t i;
+
+	pw_log_trace(NAME" %p: do batch process %p", impl, impl->position);
+
+	spa_list_for_each(p, &impl->port_list, link) {
+		struct spa_io_buffers *io = p->io;
+
+		b = NULL;
+		if (io == NULL)
+			goto next;
+
+		if (p->direction == SPA_DIRECTION_INPUT) {
+			if (io->status == SPA_STATUS_HAVE_DATA &&
+			    io->buffer_id < p->n_buffers) {
+				b = &p->buffers[io->buffer_id];
+				drained = false;
+			}
+		} else if (io->status != SPA_STATUS_HAVE_DATA) {
+			if (io->buffer_id < p->n_buffers)
+				b = &p->buffers[io->buffer_id];
+			else if ((b = pop_queue(p, &p->dequeued)) == NULL)
+				b = pop_queue(p, &p->queued);
+		}
+	      next:
+		p->cycle = b;
+		fb->port_data = p->user_data;
+		fb->buffer = b ? &b->this : NULL;
+		fb++;
+	}
+	impl->n_batch = fb - impl->batch;
+
+	copy_position(impl);
+	do_call_process(NULL, false, 1, NULL, 0, impl);
+
+	for (i = 0; i < impl->n_batch; i++) {
+		struct spa_io_buffers *io;
+
+		p = SPA_CONTAINER_OF(impl->batch[i].port_data, struct port, user_data);
+		if ((io = p->io) == NULL)
+			continue;
+
+		b = p->cycle;
+		p->cycle = NULL;
+
+		if (p->direction == SPA_DIRECTION_INPUT) {
+			/* the same buffer is recycled */
+			if (io->status == SPA_STATUS_HAVE_DATA)
+				io->status = SPA_STATUS_NEED_DATA;
+		} else {
+			if (io->status == SPA_STATUS_HAVE_DATA)
+				continue;
+
+			if (b != NULL) {
+				pw_log_trace(NAME" %p: push %d %p", impl, b->id, io);
+				io->buffer_id = b->id;
+				io->status = SPA_STATUS_HAVE_DATA;
+				drained = false;
+			} else {
+				io->buffer_id = SPA_ID_INVALID;
+				io->status = SPA_STATUS_NEED_DATA;
+			}
+		}
+	}
+	if (drained && impl->draining)
+		call_drained(impl);
+
+	return SPA_STATUS_NEED_DATA | SPA_STATUS_HAVE_DATA;
+}
+
 static const struct spa_node_methods impl_node = {
 	SPA_VERSION_NODE_METHODS,
 	.add_listener = impl_add_listener,
@@ -864,6 +949,20 @@ static const struct spa_node_methods impl_node = {
 	.process = impl_node_process,
 };
 
+static const struct spa_node_methods impl_node_batch = {
+	SPA_VERSION_NODE_METHODS,
+	.add_listener = impl_add_listener,
+	.set_callbacks = impl_set_callbacks,
+	.set_io = impl_set_io,
+	.send_command = impl_send_command,
+	.port_set_io = impl_port_set_io,
+	.port_enum_params = impl_port_enum_params,
+	.port_set_param = impl_port_set_param,
+	.port_use_buffers = impl_port_use_buffers,
+	.port_reuse_buffer = impl_port_reuse_buffer,
+	.process = impl_node_process_batch,
+};
+
 static void proxy_destroy(void *_data)
 {
 	struct pw_filter *filter = _data;
@@ -1164,6 +1263,8 @@ pw_filter_connect(struct pw_filter *filter,
 	uint32_t i;
 
 	pw_log_debug(NAME" %p: connect", filter);
+	if (SPA_FLAG_IS_SET(flags, PW_FILTER_FLAG_BATCH_BUFFERS))
+		flags |= PW_FILTER_FLAG_RT_PROCESS;
 	impl->flags = flags;
 
 	impl->warn_mlock = SPA_FLAG_IS_SET(flags, PW_FILTER_FLAG_RT_PROCESS);
@@ -1173,7 +1274,8 @@ pw_filter_connect(struct pw_filter *filter,
 	impl->impl_node.iface = SPA_INTERFACE_INIT(
 			SPA_TYPE_INTERFACE_Node,
 			SPA_VERSION_NODE,
-			&impl_node, impl);
+			SPA_FLAG_IS_SET(flags, PW_FILTER_FLAG_BATCH_BUFFERS) ?
+				&impl_node_batch : &impl_node, impl);
 
 	impl->change_mask_all =
 		SPA_NODE_CHANGE_MASK_FLAGS |
@@ -1498,7 +1600,7 @@ do_process(struct spa_loop *loop,
                  bool async, uint32_t seq, const void *data, size_t size, void *user_data)
 {
 	struct filter *impl = user_data;
-	int res = impl_node_process(impl);
+	int res = spa_node_process(&impl->impl_node);
 	return spa_node_call_ready(&impl->callbacks, res);
 }
 
@@ -1553,7 +1655,11 @@ void *pw_filter_get_dsp_buffer(void *port_data, uint32_t n_samples)
 	struct pw_buffer *buf;
 	struct spa_data *d;
 
-	if ((buf = pw_filter_dequeue_buffer(port_data)) == NULL)
+	if (SPA_FLAG_IS_SET(p->filter->flags, PW_FILTER_FLAG_BATCH_BUFFERS)) {
+		if (p->cycle == NULL)
+			return empty;
+		buf = &p->cycle->this;
+	} else if ((buf = pw_filter_dequeue_buffer(port_data)) == NULL)
 		return empty;
 
 	d = &buf->buffer->datas[0];
@@ -1565,11 +1671,24 @@ void *pw_filter_get_dsp_buffer(void *port_data, uint32_t n_samples)
 		d->chunk->flags = 0;
 	}
 
-	pw_filter_queue_buffer(port_data, buf);
+	if (p->cycle == NULL)
+		pw_filter_queue_buffer(port_data, buf);
 
 	return d->data;
 }
 
+SPA_EXPORT
+int pw_filter_get_buffers(struct pw_filter *filter, const struct pw_filter_buffer **buffers)
+{
+	struct filter *impl = SPA_CONTAINER_OF(filter, struct filter, this);
+
+	if (!SPA_FLAG_IS_SET(impl->flags, PW_FILTER_FLAG_BATCH_BUFFERS))
+		return -ENOTSUP;
+
+	*buffers = impl->batch;
+	return impl->n_batch;
+}
+
 static int
 do_flush(struct spa_loop *loop,
                  bool async, uint32_t seq, const void *data, size_t size, void *user_data)
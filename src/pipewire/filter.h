@@ -112,6 +112,17 @@ enum pw_filter_flags {
 	PW_FILTER_FLAG_DRIVER		= (1 << 1),	/**< be a driver */
 	PW_FILTER_FLAG_RT_PROCESS	= (1 << 2),	/**< call process from the realtime
 							  *  thread */
+	PW_FILTER_FLAG_BATCH_BUFFERS	= (1 << 3),	/**< hand the buffers of all ports to
+							  *  the process callback, see
+							  *  pw_filter_get_buffers(). Implies
+							  *  PW_FILTER_FLAG_RT_PROCESS */
+};
+
+/** A port and its buffer for the current cycle \memberof pw_filter */
+struct pw_filter_buffer {
+	void *port_data;		/**< data associated with the port */
+	struct pw_buffer *buffer;	/**< the buffer or NULL when the port has no
+					  *  buffer this cycle */
 };
 
 enum pw_filter_port_flags {
@@ -226,6 +237,12 @@ int pw_filter_queue_buffer(void *port_data, struct pw_buffer *buffer);
 /** Get a data pointer to the buffer data */
 void *pw_filter_get_dsp_buffer(void *port_data, uint32_t n_samples);
 
+/** Get the buffers of all ports for the current cycle. Only valid from the
+ * process callback of a filter connected with PW_FILTER_FLAG_BATCH_BUFFERS.
+ * The buffers are given back to the graph after the process callback and
+ * should not be queued. Returns the number of entries in \a buffers */
+int pw_filter_get_buffers(struct pw_filter *filter, const struct pw_filter_buffer **buffers);
+
 /** Activate or deactivate the filter \memberof pw_filter */
 int pw_filter_set_active(struct pw_filter *filter, bool active);
 
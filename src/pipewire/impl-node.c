@@ -348,6 +348,42 @@ static int suspend_node(struct pw_impl_node *this)
 	return res;
 }
 
+/* drop the cached params with id, SPA_ID_INVALID drops all of them */
+static void clear_param_cache(struct pw_impl_node *node, uint32_t id)
+{
+	uint32_t i;
+
+	pw_param_clear(&node->param_list, id);
+
+	for (i = 0; i < node->info.n_params; i++) {
+		if (id == SPA_ID_INVALID || node->info.params[i].id == id)
+			SPA_FLAG_CLEAR(node->param_cached, 1u << i);
+	}
+	if (id == SPA_ID_INVALID)
+		node->param_cached = 0;
+}
+
+/* a param change, on the node or on any of its ports, can have side effects
+ * on the other params of the node and all its ports, drop all caches */
+SPA_EXPORT
+void pw_impl_node_clear_param_caches(struct pw_impl_node *node)
+{
+	struct pw_impl_port *p;
+
+	clear_param_cache(node, SPA_ID_INVALID);
+
+	spa_list_for_each(p, &node->input_ports, link) {
+		pw_param_clear(&p->param_list, SPA_ID_INVALID);
+		p->param_cached = 0;
+		p->param_generation = ++node->context->param_generation;
+	}
+	spa_list_for_each(p, &node->output_ports, link) {
+		pw_param_clear(&p->param_list, SPA_ID_INVALID);
+		p->param_cached = 0;
+		p->param_generation = ++node->context->param_generation;
+	}
+}
+
 static void
 clear_info(struct pw_impl_node *this)
 {
@@ -432,6 +468,7 @@ static int node_set_param(void *object, uint32_t id, uint32_t flags,
 	pw_log_debug(NAME" %p: resource %p set param id:%d (%s) %08x", node, resource,
 			id, spa_debug_type_find_name(spa_type_param, id), flags);
 
+	pw_impl_node_clear_param_caches(node);
 	res = spa_node_set_param(node->node, id, flags, param);
 
 	if (res < 0) {
@@ -668,6 +705,9 @@ int pw_impl_node_set_driver(struct pw_impl_node *node, struct pw_impl_node *driv
 
 	node->driver_node = driver;
 
+	/* the params can depend on the clock of the driver */
+	pw_impl_node_clear_param_caches(node);
+
 	pw_impl_node_emit_driver_changed(node, old, driver);
 
 	if ((res = spa_node_set_io(node->node,
@@ -993,6 +1033,7 @@ struct pw_impl_node *pw_context_create_node(struct pw_context *context,
 	this->data_loop = context->data_loop;
 
 	spa_list_init(&this->follower_list);
+	spa_list_init(&this->param_list);
 
 	spa_hook_list_init(&this->listener_list);
 
@@ -1116,6 +1157,10 @@ static void node_info(void *data, const struct spa_node_info *info)
 	if (info->change_mask & SPA_NODE_CHANGE_MASK_PARAMS) {
 		uint32_t i;
 
+		/* the content of the params can change without a change of
+		 * the flags, drop all caches */
+		clear_param_cache(node, SPA_ID_INVALID);
+
 		node->info.change_mask |= PW_NODE_CHANGE_MASK_PARAMS;
 		node->info.n_params = SPA_MIN(info->n_params, SPA_N_ELEMENTS(node->params));
 
@@ -1545,6 +1590,7 @@ void pw_impl_node_destroy(struct pw_impl_node *node)
 	pw_properties_free(node->properties);
 
 	clear_info(node);
+	pw_param_clear(&node->param_list, SPA_ID_INVALID);
 
 	spa_system_close(node->context->data_system, node->source.fd);
 	free(impl);
@@ -1577,6 +1623,7 @@ struct result_node_params_data {
 			uint32_t id, uint32_t index, uint32_t next,
 			struct spa_pod *param);
 	int seq;
+	struct spa_list *cache;
 };
 
 static void result_node_params(void *data, int seq, int res, uint32_t type, const void *result)
@@ -1586,8 +1633,11 @@ static void result_node_params(void *data, int seq, int res, uint32_t type, cons
 	case SPA_RESULT_TYPE_NODE_PARAMS:
 	{
 		const struct spa_result_node_params *r = result;
-		if (d->seq == seq)
+		if (d->seq == seq) {
+			if (d->cache)
+				pw_param_add(d->cache, r->id, r->index, r->next, r->param);
 			d->callback(d->data, seq, r->id, r->index, r->next, r->param);
+		}
 		break;
 	}
 	default:
@@ -1605,8 +1655,8 @@ int pw_impl_node_for_each_param(struct pw_impl_node *node,
 					    struct spa_pod *param),
 			   void *data)
 {
-	int res;
-	struct result_node_params_data user_data = { data, callback, seq };
+	int res, idx = -1;
+	struct result_node_params_data user_data = { data, callback, seq, NULL };
 	struct spa_hook listener;
 	static const struct spa_node_events node_events = {
 		SPA_VERSION_NODE_EVENTS,
@@ -1620,6 +1670,21 @@ int pw_impl_node_for_each_param(struct pw_impl_node *node,
 			spa_debug_type_find_name(spa_type_param, param_id),
 			index, max);
 
+	/* only params announced in the info can be cached, we get notified
+	 * of their changes */
+	if (filter == NULL)
+		idx = pw_param_info_find(node->info.params, node->info.n_params, param_id);
+
+	if (idx >= 0 && SPA_FLAG_IS_SET(node->param_cached, 1u << idx)) {
+		pw_log_debug(NAME" %p: params id:%d from cache", node, param_id);
+		return pw_param_emit(&node->param_list, seq, param_id, index, max,
+				callback, data);
+	}
+	if (idx >= 0 && index == 0 && max == UINT32_MAX) {
+		pw_param_clear(&node->param_list, param_id);
+		user_data.cache = &node->param_list;
+	}
+
 	spa_zero(listener);
 	spa_node_add_listener(node->node, &listener, &node_events, &user_data);
 	res = spa_node_enum_params(node->node, seq,
@@ -1627,6 +1692,13 @@ int pw_impl_node_for_each_param(struct pw_impl_node *node,
 					filter);
 	spa_hook_remove(&listener);
 
+	if (user_data.cache) {
+		/* async results are not collected, don't cache partial results */
+		if (res == 0)
+			SPA_FLAG_SET(node->param_cached, 1u << idx);
+		else
+			pw_param_clear(&node->param_list, param_id);
+	}
 	return res;
 }
 
@@ -1636,6 +1708,7 @@ int pw_impl_node_set_param(struct pw_impl_node *node,
 {
 	pw_log_debug(NAME" %p: set_param id:%d (%s) flags:%08x param:%p", node, id,
 			spa_debug_type_find_name(spa_type_param, id), flags, param);
+	pw_impl_node_clear_param_caches(node);
 	return spa_node_set_param(node->node, id, flags, param);
 }
 
@@ -292,6 +292,25 @@ static int notify_param(void *data, int seq, uint32_t id,
 	return 0;
 }
 
+/* drop the cached params with id, SPA_ID_INVALID drops all of them */
+static void clear_param_cache(struct pw_impl_port *port, uint32_t id)
+{
+	uint32_t i;
+
+	pw_param_clear(&port->param_list, id);
+
+	for (i = 0; i < port->info.n_params; i++) {
+		if (id == SPA_ID_INVALID || port->info.params[i].id == id)
+			SPA_FLAG_CLEAR(port->param_cached, 1u << i);
+	}
+	if (id == SPA_ID_INVALID)
+		port->param_cached = 0;
+
+	/* a new port has a fresh generation until it is added to a node */
+	if (port->node != NULL)
+		port->param_generation = ++port->node->context->param_generation;
+}
+
 static void emit_params(struct pw_impl_port *port, uint32_t *changed_ids, uint32_t n_changed_ids)
 {
 	uint32_t i;
@@ -338,6 +357,10 @@ static void update_info(struct pw_impl_port *port, const struct spa_port_info *i
 	if (info->change_mask & SPA_PORT_CHANGE_MASK_PARAMS) {
 		uint32_t i;
 
+		/* the content of the params can change without a change of
+		 * the flags, drop all caches */
+		clear_param_cache(port, SPA_ID_INVALID);
+
 		port->info.change_mask |= PW_PORT_CHANGE_MASK_PARAMS;
 		port->info.n_params = SPA_MIN(info->n_params, SPA_N_ELEMENTS(port->params));
 
@@ -409,6 +432,8 @@ struct pw_impl_port *pw_context_create_port(
 	this->info.props = &this->properties->dict;
 
 	spa_list_init(&this->links);
+	spa_list_init(&this->param_list);
+	this->param_generation = ++context->param_generation;
 	spa_list_init(&this->mix_list);
 	spa_list_init(&this->rt.mix_list);
 	spa_list_init(&this->control_list[0]);
@@ -998,6 +1023,8 @@ void pw_impl_port_destroy(struct pw_impl_port *port)
 
 	pw_properties_free(port->properties);
 
+	pw_param_clear(&port->param_list, SPA_ID_INVALID);
+
 	free(port);
 }
 
@@ -1007,6 +1034,7 @@ struct result_port_params_data {
 			uint32_t id, uint32_t index, uint32_t next,
 			struct spa_pod *param);
 	int seq;
+	struct spa_list *cache;
 };
 
 static void result_port_params(void *data, int seq, int res, uint32_t type, const void *result)
@@ -1016,8 +1044,11 @@ static void result_port_params(void *data, int seq, int res, uint32_t type, cons
 	case SPA_RESULT_TYPE_NODE_PARAMS:
 	{
 		const struct spa_result_node_params *r = result;
-		if (d->seq == seq)
+		if (d->seq == seq) {
+			if (d->cache)
+				pw_param_add(d->cache, r->id, r->index, r->next, r->param);
 			d->callback(d->data, seq, r->id, r->index, r->next, r->param);
+		}
 		break;
 	}
 	default:
@@ -1035,9 +1066,9 @@ int pw_impl_port_for_each_param(struct pw_impl_port *port,
 					    struct spa_pod *param),
 			   void *data)
 {
-	int res;
+	int res, idx = -1;
 	struct pw_impl_node *node = port->node;
-	struct result_port_params_data user_data = { data, callback, seq };
+	struct result_port_params_data user_data = { data, callback, seq, NULL };
 	struct spa_hook listener;
 	static const struct spa_node_events node_events = {
 		SPA_VERSION_NODE_EVENTS,
@@ -1051,6 +1082,19 @@ int pw_impl_port_for_each_param(struct pw_impl_port *port,
 			spa_debug_type_find_name(spa_type_param, param_id),
 			index, max);
 
+	if (filter == NULL)
+		idx = pw_param_info_find(port->info.params, port->info.n_params, param_id);
+
+	if (idx >= 0 && SPA_FLAG_IS_SET(port->param_cached, 1u << idx)) {
+		pw_log_debug(NAME" %p: params id:%d from cache", port, param_id);
+		return pw_param_emit(&port->param_list, seq, param_id, index, max,
+				callback, data);
+	}
+	if (idx >= 0 && index == 0 && max == UINT32_MAX) {
+		pw_param_clear(&port->param_list, param_id);
+		user_data.cache = &port->param_list;
+	}
+
 	spa_zero(listener);
 	spa_node_add_listener(node->node, &listener, &node_events, &user_data);
 	res = spa_node_port_enum_params(node->node, seq,
@@ -1059,6 +1103,13 @@ int pw_impl_port_for_each_param(struct pw_impl_port *port,
 					filter);
 	spa_hook_remove(&listener);
 
+	if (user_data.cache) {
+		if (res == 0)
+			SPA_FLAG_SET(port->param_cached, 1u << idx);
+		else
+			pw_param_clear(&port->param_list, param_id);
+	}
+
 	pw_log_debug(NAME" %p: res %d: (%s)", port, res, spa_strerror(res));
 	return res;
 }
@@ -1139,6 +1190,9 @@ int pw_impl_port_set_param(struct pw_impl_port *port, uint32_t id, uint32_t flag
 
 	pw_log_debug(NAME" %p: %d set param %d %p", port, port->state, id, param);
 
+	/* the other ports of the node can depend on the format of this one */
+	pw_impl_node_clear_param_caches(node);
+
 	/* set parameter on node */
 	res = spa_node_port_set_param(node->node,
 			port->direction, port->port_id,
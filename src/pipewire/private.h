@@ -61,6 +61,86 @@ struct defaults {
 
 #define MAX_PARAMS	32
 
+/** a cached param, used to answer enum_params without going to the
+ * implementation */
+struct pw_param {
+	uint32_t id;
+	uint32_t index;
+	uint32_t next;
+	struct spa_list link;
+	struct spa_pod *param;
+};
+
+static inline struct pw_param *pw_param_add(struct spa_list *param_list, uint32_t id,
+		uint32_t index, uint32_t next, const struct spa_pod *param)
+{
+	struct pw_param *p;
+
+	if (param == NULL)
+		return NULL;
+
+	p = malloc(sizeof(struct pw_param) + SPA_POD_SIZE(param));
+	if (p == NULL)
+		return NULL;
+
+	p->id = id;
+	p->index = index;
+	p->next = next;
+	p->param = SPA_MEMBER(p, sizeof(struct pw_param), struct spa_pod);
+	memcpy(p->param, param, SPA_POD_SIZE(param));
+	spa_list_append(param_list, &p->link);
+
+	return p;
+}
+
+/** remove cached params with \a id, SPA_ID_INVALID removes all */
+static inline void pw_param_clear(struct spa_list *param_list, uint32_t id)
+{
+	struct pw_param *p, *t;
+
+	spa_list_for_each_safe(p, t, param_list, link) {
+		if (id == SPA_ID_INVALID || p->id == id) {
+			spa_list_remove(&p->link);
+			free(p);
+		}
+	}
+}
+
+/** find the index of \a id in \a params or -1 when the id is not listed */
+static inline int pw_param_info_find(const struct spa_param_info *params,
+		uint32_t n_params, uint32_t id)
+{
+	uint32_t i;
+	for (i = 0; i < n_params; i++) {
+		if (params[i].id == id)
+			return i;
+	}
+	return -1;
+}
+
+/** emit the cached params with \a id, starting from \a index */
+static inline int pw_param_emit(struct spa_list *param_list, int seq,
+		uint32_t id, uint32_t index, uint32_t max,
+		int (*callback) (void *data, int seq,
+				 uint32_t id, uint32_t index, uint32_t next,
+				 struct spa_pod *param),
+		void *data)
+{
+	struct pw_param *p;
+	uint32_t count = 0;
+	int res;
+
+	spa_list_for_each(p, param_list, link) {
+		if (p->id != id || p->index < index)
+			continue;
+		if (count++ == max)
+			break;
+		if ((res = callback(data, seq, p->id, p->index, p->next, p->param)) != 0)
+			return res;
+	}
+	return 0;
+}
+
 #define pw_protocol_emit_destroy(p) spa_hook_list_call(&p->listener_list, struct pw_protocol_events, destroy, 0)
 
 struct pw_protocol {
@@ -304,6 +384,10 @@ struct pw_context {
 
 	struct pw_impl_client *current_client;	/**< client currently executing code in mainloop */
 
+	struct spa_list negotiate_cache;	/**< cache of negotiation results */
+	uint32_t n_negotiate_cache;
+	uint64_t param_generation;		/**< last param generation given to a port */
+
 	long sc_pagesize;
 
 	void *user_data;		/**< extra user data */
@@ -506,6 +590,8 @@ struct pw_impl_node {
 
 	struct pw_node_info info;		/**< introspectable node info */
 	struct spa_param_info params[MAX_PARAMS];
+	struct spa_list param_list;		/**< cached params */
+	uint32_t param_cached;			/**< mask of params with a complete cache */
 
 	char *name;				/** for debug */
 
@@ -646,6 +732,10 @@ struct pw_impl_port {
 	struct pw_properties *properties;	/**< properties of the port */
 	struct pw_port_info info;
 	struct spa_param_info params[MAX_PARAMS];
+	struct spa_list param_list;	/**< cached params */
+	uint32_t param_cached;		/**< mask of params with a complete cache */
+	uint64_t param_generation;	/**< changes when the cached params are dropped,
+					  *  unique in the context */
 
 	struct pw_buffers buffers;	/**< buffers managed by this port, only on
 					  *  output ports, shared with all links */
@@ -961,6 +1051,17 @@ pw_context_find_port(struct pw_context *context,
 
 const struct pw_export_type *pw_context_find_export_type(struct pw_context *context, const char *type);
 
+/** Look up a negotiation result for the param sets in \a key, the result
+ * is appended to \a builder. Returns the number of params or 0 when not found */
+int pw_context_negotiate_cache_lookup(struct pw_context *context, uint32_t id,
+		const struct spa_pod *key, struct spa_pod_builder *builder);
+
+/** Store \a n_results params in \a result as the negotiation result for
+ * the param sets in \a key */
+int pw_context_negotiate_cache_add(struct pw_context *context, uint32_t id,
+		const struct spa_pod *key, const void *result, uint32_t size,
+		uint32_t n_results);
+
 int pw_proxy_init(struct pw_proxy *proxy, const char *type, uint32_t version);
 
 void pw_proxy_remove(struct pw_proxy *proxy);
@@ -1038,6 +1139,9 @@ int pw_impl_node_update_ports(struct pw_impl_node *node);
 
 int pw_impl_node_set_driver(struct pw_impl_node *node, struct pw_impl_node *driver);
 
+/** Drop the cached params of the node and all its ports */
+void pw_impl_node_clear_param_caches(struct pw_impl_node *node);
+
 /** Prepare a link \memberof pw_impl_link
   * Starts the negotiation of formats and buffers on \a link */
 int pw_impl_link_prepare(struct pw_impl_link *link);
@@ -401,8 +401,20 @@ SPA_EXPORT
 int pw_properties_setva(struct pw_properties *properties,
 		   const char *key, const char *format, va_list args)
 {
-	char *value = NULL;
+	char buffer[256], *value = NULL;
+	va_list copy;
+	int len;
+
 	if (format != NULL) {
+		/* most values are short, format on the stack so that setting
+		 * an unchanged value does not allocate */
+		va_copy(copy, args);
+		len = vsnprintf(buffer, sizeof(buffer), format, copy);
+		va_end(copy);
+		if (len < 0)
+			return -errno;
+		if ((size_t)len < sizeof(buffer))
+			return do_replace(properties, key, buffer, true);
 		if (vasprintf(&value, format, args) < 0)
 			return -errno;
 	}
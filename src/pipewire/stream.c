@@ -122,6 +122,12 @@ struct stream {
 	struct queue dequeued;
 	struct queue queued;
 
+	struct buffer *direct;		/* buffer rendered in place this cycle */
+#define DIRECT_AVAILABLE	0
+#define DIRECT_DEQUEUED		1
+#define DIRECT_QUEUED		2
+	uint32_t direct_state;
+
 	struct data data;
 	uintptr_t seq;
 	struct pw_time time;
@@ -804,6 +810,79 @@ exit:
 	return res;
 }
 
+/* Direct render: when nothing is queued, the buffer the peer gave back is
+ * handed to the process callback again and, when it is queued from there,
+ * sent out without touching the queues. Buffers queued outside of the
+ * cycle go through the queued ring like in the normal output path. */
+static int impl_node_process_direct(void *object)
+{
+	struct stream *impl = object;
+	struct pw_stream *stream = &impl->this;
+	struct spa_io_buffers *io = impl->io;
+	struct buffer *b;
+	uint32_t index;
+
+	pw_log_trace(NAME" %p: process direct status:%d id:%d ticks:%"PRIu64, stream,
+			io->status, io->buffer_id, impl->time.ticks);
+
+	if (io->status == SPA_STATUS_HAVE_DATA)
+		goto exit;
+
+	b = get_buffer(stream, io->buffer_id);
+
+	io->buffer_id = SPA_ID_INVALID;
+	io->status = SPA_STATUS_NEED_DATA;
+
+	/* buffers queued outside of the cycle are older, send them first and
+	 * refill the queue like the normal output path does */
+	if (spa_ringbuffer_get_read_index(&impl->queued.ring, &index) > 0) {
+		if (b != NULL)
+			push_queue(impl, &impl->dequeued, b);
+		return impl_node_process_output(object);
+	}
+
+	/* the first cycle has no buffer to render in yet */
+	if (b == NULL)
+		b = pop_queue(impl, &impl->dequeued);
+
+	if (b != NULL) {
+		b->this.size = impl->position ? impl->position->clock.duration : 0;
+		impl->direct = b;
+		impl->direct_state = DIRECT_AVAILABLE;
+
+		if (!impl->draining)
+			do_call_process(NULL, false, 1, NULL, 0, impl);
+
+		impl->direct = NULL;
+		switch (impl->direct_state) {
+		case DIRECT_QUEUED:
+			impl->queued.incount += b->this.size;
+			impl->queued.outcount += b->this.size;
+			io->buffer_id = b->id;
+			io->status = SPA_STATUS_HAVE_DATA;
+			goto exit;
+		case DIRECT_AVAILABLE:
+			push_queue(impl, &impl->dequeued, b);
+			break;
+		default:
+			/* the application keeps the buffer */
+			break;
+		}
+	}
+
+	if ((b = pop_queue(impl, &impl->queued)) != NULL) {
+		io->buffer_id = b->id;
+		io->status = SPA_STATUS_HAVE_DATA;
+		pw_log_trace(NAME" %p: pop %d %p", stream, b->id, io);
+	} else if (impl->draining) {
+		call_drained(impl);
+	}
+exit:
+	copy_position(impl, impl->queued.outcount);
+
+	return io->status;
+}
+
 static const struct spa_node_methods impl_node = {
 	SPA_VERSION_NODE_METHODS,
 	.add_listener = impl_add_listener,
@@ -1370,11 +1449,23 @@ pw_stream_connect(struct pw_stream *stream,
 	pw_log_debug(NAME" %p: connect target:%d", stream, target_id);
 	impl->direction =
 	    direction == PW_DIRECTION_INPUT ? SPA_DIRECTION_INPUT : SPA_DIRECTION_OUTPUT;
+	if (SPA_FLAG_IS_SET(flags, PW_STREAM_FLAG_DIRECT_RENDER)) {
+		if (impl->direction == SPA_DIRECTION_OUTPUT &&
+		    !SPA_FLAG_IS_SET(flags, PW_STREAM_FLAG_DRIVER)) {
+			flags |= PW_STREAM_FLAG_RT_PROCESS | PW_STREAM_FLAG_MAP_BUFFERS;
+		} else {
+			pw_log_warn(NAME" %p: direct render only for non-driver output streams",
+					stream);
+			flags &= ~PW_STREAM_FLAG_DIRECT_RENDER;
+		}
+	}
 	impl->flags = flags;
 	impl->node_methods = impl_node;
 
 	if (impl->direction == SPA_DIRECTION_INPUT)
 		impl->node_methods.process = impl_node_process_input;
+	else if (SPA_FLAG_IS_SET(flags, PW_STREAM_FLAG_DIRECT_RENDER))
+		impl->node_methods.process = impl_node_process_direct;
 	else
 		impl->node_methods.process = impl_node_process_output;
 
@@ -1721,6 +1812,13 @@ struct pw_buffer *pw_stream_dequeue_buffer(struct pw_stream *stream)
 	struct buffer *b;
 	int res;
 
+	if ((b = impl->direct) != NULL &&
+	    impl->direct_state == DIRECT_AVAILABLE) {
+		impl->direct_state = DIRECT_DEQUEUED;
+		pw_log_trace(NAME" %p: dequeue direct buffer %d", stream, b->id);
+		return &b->this;
+	}
+
 	if ((b = pop_queue(impl, &impl->dequeued)) == NULL) {
 		res = -errno;
 		pw_log_trace(NAME" %p: no more buffers: %m", stream);
@@ -1740,6 +1838,10 @@ int pw_stream_queue_buffer(struct pw_stream *stream, struct pw_buffer *buffer)
 	int res;
 
 	pw_log_trace(NAME" %p: queue buffer %d", stream, b->id);
+	if (b == impl->direct && impl->direct_state == DIRECT_DEQUEUED) {
+		impl->direct_state = DIRECT_QUEUED;
+		return 0;
+	}
 	if ((res = push_queue(impl, &impl->queued, b)) < 0)
 		return res;
 
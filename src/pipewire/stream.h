@@ -134,6 +134,14 @@ extern "C" {
  * The process event is emited when PipeWire has emptied a buffer that
  * can now be refilled.
  *
+ * With \ref PW_STREAM_FLAG_DIRECT_RENDER and no buffers queued, the
+ * buffer returned by \ref pw_stream_dequeue_buffer() in the process event
+ * is the one that just came back from the graph, with the size field set
+ * to the number of samples in the quantum. Queueing it again in the same
+ * process event sends it out without using the buffer queues. Buffers
+ * queued outside of the process event are sent first, in order, and the
+ * process event then works like without the flag until they are gone.
+ *
  * \section sec_stream_disconnect Disconnect
  *
  * Use \ref pw_stream_disconnect() to disconnect a stream after use.
@@ -256,6 +264,11 @@ enum pw_stream_flags {
 	PW_STREAM_FLAG_ALLOC_BUFFERS	= (1 << 8),	/**< the application will allocate buffer
 							  *  memory. In the add_buffer event, the
 							  *  data of the buffer should be set */
+	PW_STREAM_FLAG_DIRECT_RENDER	= (1 << 9),	/**< render one quantum in place in the
+							  *  process event. Only for output
+							  *  streams that are not a driver,
+							  *  implies PW_STREAM_FLAG_RT_PROCESS
+							  *  and PW_STREAM_FLAG_MAP_BUFFERS */
 };
 
 /** Create a new unconneced \ref pw_stream \memberof pw_stream
@@ -26,6 +26,8 @@
 #include <pipewire/main-loop.h>
 #include <pipewire/stream.h>
 
+#include <spa/param/video/format-utils.h>
+
 #define TEST_FUNC(a,b,func)	\
 do {				\
 	a.func = b.func;	\
@@ -235,6 +237,166 @@ static void test_properties(void)
 	pw_main_loop_destroy(loop);
 }
 
+struct update_data {
+	struct pw_main_loop *loop;
+	struct pw_core *core;
+	struct spa_hook core_listener;
+	int pending;
+	uint32_t node_id;
+	uint32_t port_ids[8];
+	uint32_t port_node_ids[8];
+	uint32_t n_ports;
+	struct spa_rectangle size;
+	uint32_t n_params;
+};
+
+static void update_core_done(void *data, uint32_t id, int seq)
+{
+	struct update_data *d = data;
+	if (id == PW_ID_CORE && seq == d->pending)
+		pw_main_loop_quit(d->loop);
+}
+
+static const struct pw_core_events update_core_events = {
+	PW_VERSION_CORE_EVENTS,
+	.done = update_core_done,
+};
+
+static void roundtrip(struct update_data *d)
+{
+	d->pending = pw_core_sync(d->core, PW_ID_CORE, 0);
+	pw_main_loop_run(d->loop);
+}
+
+static void update_registry_global(void *data, uint32_t id,
+		uint32_t permissions, const char *type, uint32_t version,
+		const struct spa_dict *props)
+{
+	struct update_data *d = data;
+	const char *str;
+
+	if (strcmp(type, PW_TYPE_INTERFACE_Port) != 0 ||
+	    d->n_ports == SPA_N_ELEMENTS(d->port_ids) ||
+	    props == NULL || (str = spa_dict_lookup(props, PW_KEY_NODE_ID)) == NULL)
+		return;
+
+	d->port_ids[d->n_ports] = id;
+	d->port_node_ids[d->n_ports] = atoi(str);
+	d->n_ports++;
+}
+
+static const struct pw_registry_events update_registry_events = {
+	PW_VERSION_REGISTRY_EVENTS,
+	.global = update_registry_global,
+};
+
+static void update_port_param(void *data, int seq, uint32_t id,
+		uint32_t index, uint32_t next, const struct spa_pod *param)
+{
+	struct update_data *d = data;
+
+	spa_assert(id == SPA_PARAM_EnumFormat);
+	spa_assert(spa_pod_parse_object(param,
+				SPA_TYPE_OBJECT_Format, NULL,
+				SPA_FORMAT_VIDEO_size, SPA_POD_Rectangle(&d->size)) >= 0);
+	d->n_params++;
+}
+
+static const struct pw_port_events update_port_events = {
+	PW_VERSION_PORT_EVENTS,
+	.param = update_port_param,
+};
+
+static const struct spa_pod *make_format(struct spa_pod_builder *b, uint32_t width)
+{
+	return spa_pod_builder_add_object(b,
+			SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat,
+			SPA_FORMAT_mediaType,       SPA_POD_Id(SPA_MEDIA_TYPE_video),
+			SPA_FORMAT_mediaSubtype,    SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+			SPA_FORMAT_VIDEO_format,    SPA_POD_Id(SPA_VIDEO_FORMAT_RGB),
+			SPA_FORMAT_VIDEO_size,      SPA_POD_Rectangle(&SPA_RECTANGLE(width, 240)),
+			SPA_FORMAT_VIDEO_framerate, SPA_POD_Fraction(&SPA_FRACTION(25, 1)));
+}
+
+static void enum_formats(struct update_data *d, struct pw_port *port)
+{
+	spa_zero(d->size);
+	d->n_params = 0;
+	pw_port_enum_params(port, 0, SPA_PARAM_EnumFormat, 0, 0, NULL);
+	roundtrip(d);
+}
+
+static void test_update_params(void)
+{
+	struct update_data d;
+	struct pw_context *context;
+	struct pw_stream *stream;
+	struct pw_registry *registry;
+	struct pw_port *port = NULL;
+	struct spa_hook registry_listener = { NULL, }, port_listener = { NULL, };
+	const struct spa_pod *params[1];
+	uint8_t buffer[1024];
+	struct spa_pod_builder b;
+	uint32_t i;
+
+	spa_zero(d);
+	d.loop = pw_main_loop_new(NULL);
+	context = pw_context_new(pw_main_loop_get_loop(d.loop), NULL, 0);
+	spa_assert(context != NULL);
+	d.core = pw_context_connect_self(context, NULL, 0);
+	spa_assert(d.core != NULL);
+	pw_core_add_listener(d.core, &d.core_listener, &update_core_events, &d);
+
+	registry = pw_core_get_registry(d.core, PW_VERSION_REGISTRY, 0);
+	pw_registry_add_listener(registry, &registry_listener, &update_registry_events, &d);
+
+	stream = pw_stream_new(d.core, "test", NULL);
+	spa_assert(stream != NULL);
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	params[0] = make_format(&b, 320);
+	spa_assert(pw_stream_connect(stream, PW_DIRECTION_OUTPUT, PW_ID_ANY,
+				PW_STREAM_FLAG_NONE, params, 1) >= 0);
+
+	for (i = 0; i < 10 && pw_stream_get_node_id(stream) == SPA_ID_INVALID; i++)
+		roundtrip(&d);
+	d.node_id = pw_stream_get_node_id(stream);
+	spa_assert(d.node_id != SPA_ID_INVALID);
+	roundtrip(&d);
+
+	for (i = 0; i < d.n_ports; i++) {
+		if (d.port_node_ids[i] == d.node_id)
+			port = pw_registry_bind(registry, d.port_ids[i],
+					PW_TYPE_INTERFACE_Port, PW_VERSION_PORT, 0);
+	}
+	spa_assert(port != NULL);
+	pw_port_add_listener(port, &port_listener, &update_port_events, &d);
+
+	/* the first enumeration fills the cache of the port */
+	enum_formats(&d, port);
+	spa_assert(d.n_params == 1);
+	spa_assert(d.size.width == 320);
+	enum_formats(&d, port);
+	spa_assert(d.n_params == 1);
+	spa_assert(d.size.width == 320);
+
+	/* the new params replace the old ones with the same flags */
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	params[0] = make_format(&b, 640);
+	spa_assert(pw_stream_update_params(stream, params, 1) >= 0);
+	roundtrip(&d);
+
+	enum_formats(&d, port);
+	spa_assert(d.n_params == 1);
+	spa_assert(d.size.width == 640);
+
+	pw_proxy_destroy((struct pw_proxy*)port);
+	pw_proxy_destroy((struct pw_proxy*)registry);
+	pw_stream_destroy(stream);
+	pw_context_destroy(context);
+	pw_main_loop_destroy(d.loop);
+}
+
 int main(int argc, char *argv[])
 {
 	pw_init(&argc, &argv);
@@ -242,6 +404,7 @@ int main(int argc, char *argv[])
 	test_abi();
 	test_create();
 	test_properties();
+	test_update_params();
 
 	return 0;
 }